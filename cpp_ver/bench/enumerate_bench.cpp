@@ -0,0 +1,131 @@
+// Enumeration benchmark: reads one wide folder with fs::directory_iterator and
+// with DirectoryReader at several buffer sizes, and reports entries per second.
+// Point --dir at the filesystem to measure (an NFS mount is the interesting case).
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "directory_reader.h"
+#include "path_list.h"
+#include "plan.h"
+#include "treegen.h"
+
+// Best of rounds, in entries per second
+static double Throughput(int rounds, const std::function<size_t()>& read) {
+    double best = 0;
+    for (int round = 0; round < rounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        size_t entries = read();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, entries / seconds);
+    }
+    return best;
+}
+
+// Folders seen, so resolving types cannot be optimized away
+static size_t foldersSeen = 0;
+
+// Names and types through a reader with a buffer of size bytes
+static size_t ReadNames(const fs::path& folder, size_t size, bool paths) {
+    std::unique_ptr<uint64_t[]> buffer(new uint64_t[size / sizeof(uint64_t)]);
+    DirectoryReader reader(buffer.get(), size);
+    DirectoryEntry entry;
+    std::error_code ec;
+    std::vector<fs::path> listed;
+    size_t count = 0;
+    if (reader.Open(folder, ec)) {
+        while (reader.Next(entry, ec)) {
+            foldersSeen += reader.Resolve(entry) == EntryType::Directory;
+            if (paths) {
+                listed.push_back(ChildPath(folder, entry.name));
+            }
+            count++;
+        }
+    }
+    return ec ? 0 : count;
+}
+
+int main(int argc, char* argv[]) {
+    fs::path dir;
+    uint64_t entries = 200000;
+    int rounds = 5;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--dir=", 6) == 0) {
+            dir = argv[i] + 6;
+        } else if (std::strncmp(argv[i], "--entries=", 10) == 0) {
+            entries = std::strtoull(argv[i] + 10, nullptr, 10);
+        } else if (std::strncmp(argv[i], "--rounds=", 9) == 0) {
+            rounds = std::atoi(argv[i] + 9);
+        } else {
+            dir.clear();
+            break;
+        }
+    }
+    if (dir.empty() || entries == 0 || rounds <= 0) {
+        std::fprintf(stderr, "Usage: unfolder_enumerate_bench --dir=DIR [--entries=N] [--rounds=N]\n");
+        return 1;
+    }
+
+    // A tree left by an earlier run is reused, so slow mounts are only filled once
+    fs::path root = dir / ("enumerate-" + std::to_string(entries));
+    std::error_code ec;
+    if (!fs::exists(root, ec)) {
+        TreeSpec spec;
+        DefaultTreeSpec("wide-flat", 1, spec);
+        spec.entries = entries;
+        TreeInfo tree;
+        std::string error;
+        if (!GenerateTree(root, spec, tree, error)) {
+            std::fprintf(stderr, "failed to build tree: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    std::vector<fs::path> chain;
+    fs::path folder;
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec) && it.depth() == 1) {
+            folder = it->path();
+            break;
+        }
+    }
+    if (folder.empty()) {
+        std::fprintf(stderr, "no payload folder under %s\n", root.c_str());
+        return 1;
+    }
+    FindPayloadFolder(folder, 0, chain);
+    folder = chain.back();
+
+    std::printf("%s: %llu entries, best of %d\n", folder.c_str(), static_cast<unsigned long long>(entries), rounds);
+    std::printf("%-36s %14s\n", "reader", "entries/s");
+    auto print = [](const char* name, double rate) { std::printf("%-36s %14.0f\n", name, rate); };
+
+    print("directory_iterator, names", Throughput(rounds, [&]() {
+        size_t count = 0;
+        for (fs::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+            count += !it->path().filename().empty();
+        }
+        return count;
+    }));
+    print("directory_iterator, paths + type", Throughput(rounds, [&]() {
+        std::vector<fs::path> listed;
+        for (fs::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+            foldersSeen += it->is_directory(ec);
+            listed.push_back(it->path());
+        }
+        return listed.size();
+    }));
+    const size_t sizes[] = { 32 << 10, DIRECTORY_BUFFER_SIZE, 1 << 20 };
+    for (size_t size : sizes) {
+        std::string names = "DirectoryReader " + std::to_string(size >> 10) + "K, names + type";
+        std::string paths = "DirectoryReader " + std::to_string(size >> 10) + "K, paths + type";
+        print(names.c_str(), Throughput(rounds, [&]() { return ReadNames(folder, size, false); }));
+        print(paths.c_str(), Throughput(rounds, [&]() { return ReadNames(folder, size, true); }));
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "move_engine.h"
+#include "path_list.h"
+
+// Every allocation made by the process, so a builder's cost can be read off
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* block = std::malloc(size != 0 ? size : 1)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    std::free(block);
+}
+
+typedef PathList::Char Char;
+
+// Result of one builder over the whole item list
+struct Measurement {
+    double allocationsPerEntry;
+    double nanosPerEntry;
+};
+
+// Run build rounds times and average allocations and time per entry
+template <typename Build>
+static Measurement Measure(size_t entries, int rounds, Build build) {
+    size_t before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    size_t sink = 0;
+    for (int round = 0; round < rounds; round++) {
+        sink += build();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    size_t count = allocations.load() - before;
+    if (sink == 0) {
+        std::fprintf(stderr, "empty build\n");
+    }
+    double total = static_cast<double>(entries) * rounds;
+    return { count / total, std::chrono::duration<double, std::nano>(elapsed).count() / total };
+}
+
+static void Print(const char* name, const Measurement& m) {
+    std::printf("%-34s %10.3f %10.1f\n", name, m.allocationsPerEntry, m.nanosPerEntry);
+}
+
+// Allocations and time per entry of building the slow path's path lists, the
+// way they used to be built against PathList
+int main(int argc, char* argv[]) {
+    size_t entries = 100000;
+    int rounds = 10;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--entries=", 10) == 0) {
+            entries = std::strtoul(argv[i] + 10, nullptr, 10);
+        } else if (std::strncmp(argv[i], "--rounds=", 9) == 0) {
+            rounds = std::atoi(argv[i] + 9);
+        } else {
+            std::fprintf(stderr, "Usage: unfolder_path_list_bench [--entries=N] [--rounds=N]\n");
+            return 1;
+        }
+    }
+    if (entries == 0 || rounds <= 0) {
+        return 1;
+    }
+
+    // Entries of a selected folder, and the parent they are lifted into
+    fs::path parent = "/mnt/data/downloads/archive";
+    std::vector<MoveItem> items;
+    items.reserve(entries);
+    for (size_t i = 0; i < entries; i++) {
+        fs::path from = parent / "Some Release Folder" / ("entry-" + std::to_string(i) + ".dat");
+        items.push_back({ from, parent / from.filename() });
+    }
+
+    std::printf("%zu entries x %d rounds\n", entries, rounds);
+    std::printf("%-34s %10s %10s\n", "builder", "allocs/e", "ns/e");
+
+    Print("double-null, string +=", Measure(entries, rounds, [&]() {
+        fs::path::string_type from;
+        fs::path::string_type to;
+        for (const auto& item : items) {
+            from += fs::path::string_type(item.from.native()) + Char(0);
+            to += fs::path::string_type(item.to.native()) + Char(0);
+        }
+        from += Char(0);
+        to += Char(0);
+        return from.size() + to.size();
+    }));
+
+    Print("double-null, PathList", Measure(entries, rounds, [&]() {
+        PathList from;
+        PathList to;
+        for (const auto& item : items) {
+            from.Measure(item.from);
+            to.Measure(item.to);
+        }
+        from.Reserve();
+        to.Reserve();
+        for (const auto& item : items) {
+            from.Append(item.from);
+            to.Append(item.to);
+        }
+        return static_cast<size_t>(from.DoubleNull()[0] + to.DoubleNull()[0]);
+    }));
+
+    Print("array, vector<string>", Measure(entries, rounds, [&]() {
+        std::vector<fs::path::string_type> paths;
+        std::vector<const Char*> array;
+        for (const auto& item : items) {
+            paths.push_back(item.from.native());
+        }
+        for (const auto& path : paths) {
+            array.push_back(path.c_str());
+        }
+        array.push_back(nullptr);
+        return array.size();
+    }));
+
+    Print("array, PathList", Measure(entries, rounds, [&]() {
+        PathList from;
+        for (const auto& item : items) {
+            from.Measure(item.from);
+        }
+        from.Reserve();
+        for (const auto& item : items) {
+            from.Append(item.from);
+        }
+        const Char* const* array = from.Array();
+        return static_cast<size_t>(array[0][0]);
+    }));
+
+    Print("destinations, parent / filename()", Measure(entries, rounds, [&]() {
+        std::vector<fs::path> to;
+        to.reserve(items.size());
+        for (const auto& item : items) {
+            to.push_back(parent / item.from.filename());
+        }
+        return to.size();
+    }));
+
+    Print("destinations, ChildPath", Measure(entries, rounds, [&]() {
+        std::vector<fs::path> to;
+        to.reserve(items.size());
+        for (const auto& item : items) {
+            to.push_back(ChildPath(parent, item.from));
+        }
+        return to.size();
+    }));
+
+    Print("destinations, PathList", Measure(entries, rounds, [&]() {
+        PathList to;
+        for (const auto& item : items) {
+            to.Measure(parent, item.from);
+        }
+        to.Reserve();
+        for (const auto& item : items) {
+            to.Append(parent, item.from);
+        }
+        return to.Size();
+    }));
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "json.h"
+#include "timing.h"
+
+// Microseconds per phase, for one mode
+typedef std::map<std::string, std::vector<int64_t>> PhaseSamples;
+
+// Nearest-rank percentile of sorted samples
+static int64_t Percentile(const std::vector<int64_t>& sorted, double percent) {
+    size_t rank = static_cast<size_t>(percent / 100 * sorted.size() + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// Add every record in a timing log to samples, keyed by mode
+static bool ReadTimingLog(const char* path, const std::string& onlyMode, std::map<std::string, PhaseSamples>& samples,
+                          std::map<std::string, size_t>& runs) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        JsonValue record;
+        if (!ParseJson(line, record)) {
+            continue; // a record cut short by a crash or a full disk
+        }
+        const JsonValue* mode = record.Find("mode");
+        const JsonValue* phases = record.Find("us");
+        if (mode == nullptr || phases == nullptr || (!onlyMode.empty() && mode->string != onlyMode)) {
+            continue;
+        }
+        runs[mode->string]++;
+        for (const auto& phase : phases->object) {
+            // A phase the run never entered says nothing about its cost
+            if (phase.second.integer > 0) {
+                samples[mode->string][phase.first].push_back(phase.second.integer);
+            }
+        }
+    }
+    return true;
+}
+
+// Print p50/p95/p99 per phase over the records of one or more timing logs
+int main(int argc, char* argv[]) {
+    std::string onlyMode;
+    std::vector<const char*> logs;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--mode=", 7) == 0) {
+            onlyMode = argv[i] + 7;
+        } else {
+            logs.push_back(argv[i]);
+        }
+    }
+    if (logs.empty()) {
+        std::cerr << "Usage: unfolder_timings [--mode=first|join|daemon-client|daemon|plan] <timing.log>...\n";
+        return 1;
+    }
+
+    std::map<std::string, PhaseSamples> samples;
+    std::map<std::string, size_t> runs;
+    for (const char* log : logs) {
+        if (!ReadTimingLog(log, onlyMode, samples, runs)) {
+            std::cerr << "Cannot read " << log << "\n";
+            return 1;
+        }
+    }
+
+    for (auto& mode : samples) {
+        std::printf("%s: %zu runs\n", mode.first.c_str(), runs[mode.first]);
+        std::printf("  %-10s %6s %10s %10s %10s %10s\n", "phase", "runs", "p50 ms", "p95 ms", "p99 ms", "max ms");
+        // Phases in pipeline order rather than by name
+        for (size_t i = 0; i < static_cast<size_t>(Phase::Count); i++) {
+            auto found = mode.second.find(PhaseName(static_cast<Phase>(i)));
+            if (found == mode.second.end()) {
+                continue;
+            }
+            std::vector<int64_t>& values = found->second;
+            std::sort(values.begin(), values.end());
+            std::printf("  %-10s %6zu %10.3f %10.3f %10.3f %10.3f\n", found->first.c_str(), values.size(),
+                        Percentile(values, 50) / 1000.0, Percentile(values, 95) / 1000.0,
+                        Percentile(values, 99) / 1000.0, values.back() / 1000.0);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "treegen.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#define PATTERN_SIZE (1 << 20)
+
+std::vector<std::string> TreeShapes() {
+    return { "wide-flat", "deep", "small-files", "huge-files", "conflicts" };
+}
+
+static uint64_t Scaled(uint64_t count, double scale) {
+    return std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(count * scale)));
+}
+
+bool DefaultTreeSpec(const std::string& shape, double scale, TreeSpec& spec) {
+    spec = TreeSpec();
+    spec.shape = shape;
+    if (shape == "wide-flat") {
+        spec.entries = Scaled(1000000, scale);
+    } else if (shape == "deep") {
+        spec.entries = Scaled(10000, scale);
+        spec.depth = 64;
+        spec.maxSize = 4096;
+    } else if (shape == "small-files") {
+        spec.entries = Scaled(100000, scale);
+        spec.folders = 16;
+        spec.minSize = 512;
+        spec.maxSize = 16 << 10;
+    } else if (shape == "huge-files") {
+        // Few entries; scale shrinks the files instead
+        spec.entries = 4;
+        spec.minSize = spec.maxSize = Scaled(256, scale) << 20;
+    } else if (shape == "conflicts") {
+        spec.entries = Scaled(100000, scale);
+        spec.maxSize = 1024;
+        spec.conflictRatio = 0.5;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool WriteFile(const fs::path& path, uint64_t size, const std::vector<char>& pattern, uint64_t offset, std::string& error) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = path.string() + ": " + std::strerror(errno);
+        return false;
+    }
+    offset %= pattern.size();
+    while (size > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(size, pattern.size() - offset));
+        ssize_t written = write(fd, pattern.data() + offset, chunk);
+        if (written <= 0) {
+            error = path.string() + ": " + std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        size -= written;
+        offset = (offset + written) % pattern.size();
+    }
+    close(fd);
+    return true;
+}
+
+bool GenerateTree(const fs::path& root, const TreeSpec& spec, TreeInfo& info, std::string& error) {
+    info = TreeInfo();
+    std::error_code ec;
+    fs::create_directories(root, ec);
+    if (ec) {
+        error = root.string() + ": " + ec.message();
+        return false;
+    }
+
+    std::mt19937_64 rng(spec.seed);
+    std::vector<char> pattern(PATTERN_SIZE);
+    for (size_t i = 0; i < pattern.size(); i += sizeof(uint64_t)) {
+        uint64_t word = rng();
+        std::memcpy(pattern.data() + i, &word, sizeof(word));
+    }
+    std::uniform_int_distribution<uint64_t> sizes(spec.minSize, std::max(spec.minSize, spec.maxSize));
+    std::bernoulli_distribution conflicting(spec.conflictRatio);
+
+    int folders = std::max(1, spec.folders);
+    uint64_t next = 0;
+    for (int f = 0; f < folders; f++) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "p%02d", f);
+        fs::path parent = root / name;
+        fs::path folder = parent / spec.shape;
+
+        // Wrappers between the selected folder and the payload
+        fs::path payload = folder;
+        for (int level = 1; level < spec.depth; level++) {
+            std::snprintf(name, sizeof(name), "w%02d", level);
+            payload /= name;
+        }
+        fs::create_directories(payload, ec);
+        if (ec) {
+            error = payload.string() + ": " + ec.message();
+            return false;
+        }
+        info.folders.push_back(folder);
+
+        // Spread the entries evenly, the first folders take the remainder
+        uint64_t count = spec.entries / folders + (static_cast<uint64_t>(f) < spec.entries % folders ? 1 : 0);
+        for (uint64_t i = 0; i < count; i++, next++) {
+            std::snprintf(name, sizeof(name), "f%07llu.dat", static_cast<unsigned long long>(next));
+            uint64_t size = sizes(rng);
+            if (!WriteFile(payload / name, size, pattern, next * 4099, error)) {
+                return false;
+            }
+            info.entries++;
+            info.bytes += size;
+
+            if (spec.conflictRatio > 0 && conflicting(rng)) {
+                if (!WriteFile(parent / name, spec.minSize, pattern, next * 8191, error)) {
+                    return false;
+                }
+                info.conflicts++;
+            }
+        }
+    }
+    return true;
+}
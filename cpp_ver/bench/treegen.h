@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Shape and size of a synthetic tree. Every byte and name is derived from the
+// seed, so the same spec always builds the same tree.
+struct TreeSpec {
+    std::string shape;          // wide-flat, deep, small-files, huge-files, conflicts
+    uint64_t entries = 0;       // entries to unfold, summed over all folders
+    int folders = 1;            // selected folders, each under its own parent
+    int depth = 1;              // single-folder wrappers above the payload (deep)
+    uint64_t minSize = 0;       // file size range, inclusive
+    uint64_t maxSize = 0;
+    double conflictRatio = 0;   // share of names already taken in the parent
+    uint64_t seed = 1;
+};
+
+// What was built
+struct TreeInfo {
+    std::vector<fs::path> folders;  // folders to hand to the unfolder
+    uint64_t entries = 0;           // entries directly inside the payload folders
+    uint64_t bytes = 0;             // file data inside the payload folders
+    uint64_t conflicts = 0;         // payload names that already exist in a parent
+};
+
+// Names accepted by DefaultTreeSpec
+std::vector<std::string> TreeShapes();
+
+// Default spec for a shape, with entry counts (file sizes for huge-files)
+// multiplied by scale.
+// Returns false for an unknown shape.
+bool DefaultTreeSpec(const std::string& shape, double scale, TreeSpec& spec);
+
+// Build the tree under root, which must not exist yet or be empty
+bool GenerateTree(const fs::path& root, const TreeSpec& spec, TreeInfo& info, std::string& error);
@@ -0,0 +1,63 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "treegen.h"
+
+// Build one synthetic tree and print the folders to unfold, one per line
+int main(int argc, char* argv[]) {
+    std::string shape;
+    fs::path root;
+    double scale = 1;
+    TreeSpec overrides;
+    bool haveEntries = false;
+    bool haveRatio = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--scale=", 8) == 0) {
+            scale = std::atof(argv[i] + 8);
+        } else if (std::strncmp(argv[i], "--entries=", 10) == 0) {
+            overrides.entries = std::strtoull(argv[i] + 10, nullptr, 10);
+            haveEntries = true;
+        } else if (std::strncmp(argv[i], "--conflicts=", 12) == 0) {
+            overrides.conflictRatio = std::atof(argv[i] + 12);
+            haveRatio = true;
+        } else if (std::strncmp(argv[i], "--seed=", 7) == 0) {
+            overrides.seed = std::strtoull(argv[i] + 7, nullptr, 10);
+        } else if (shape.empty()) {
+            shape = argv[i];
+        } else {
+            root = argv[i];
+        }
+    }
+
+    TreeSpec spec;
+    if (root.empty() || !DefaultTreeSpec(shape, scale, spec)) {
+        std::cerr << "Usage: unfolder_treegen [--scale=F] [--entries=N] [--conflicts=RATIO] [--seed=N] <shape> <dir>\n"
+                  << "Shapes:";
+        for (const auto& name : TreeShapes()) {
+            std::cerr << " " << name;
+        }
+        std::cerr << "\n";
+        return 1;
+    }
+    if (haveEntries) {
+        spec.entries = overrides.entries;
+    }
+    if (haveRatio) {
+        spec.conflictRatio = overrides.conflictRatio;
+    }
+    spec.seed = overrides.seed;
+
+    TreeInfo info;
+    std::string error;
+    if (!GenerateTree(root, spec, info, error)) {
+        std::cerr << "Failed to build tree: " << error << "\n";
+        return 1;
+    }
+    for (const auto& folder : info.folders) {
+        std::cout << folder.string() << "\n";
+    }
+    std::cerr << info.entries << " entries, " << info.bytes << " bytes, " << info.conflicts << " conflicts\n";
+    return 0;
+}
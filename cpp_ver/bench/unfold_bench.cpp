@@ -0,0 +1,476 @@
+// Unfold benchmark: builds synthetic trees and times the engine on them.
+// Every case runs in its own child process so peak RSS is per case; with
+// --syscalls the child is traced and every syscall made while unfolding is counted.
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "json.h"
+#include "move_engine.h"
+#include "plan.h"
+#include "treegen.h"
+#include "unfold.h"
+
+#define DEFAULT_TOLERANCE 10.0  // percent of entries/s a case may lose against the baseline
+#define TMPFS_MAGIC_NUMBER 0x01021994
+
+struct BenchOptions {
+    fs::path dir;
+    fs::path crossDir;               // move payloads here instead of into their parents
+    std::vector<std::string> cases;
+    double scale = 1;
+    uint64_t seed = 1;
+    int workers = 0;
+    ConflictPolicy policy = ConflictPolicy::RenameSuffix;
+    bool journal = false;
+    bool trace = false;
+    unsigned ringDepth = 0;
+    bool swapParent = false;
+    bool syscalls = false;
+    bool keep = false;
+    fs::path out;
+    fs::path baseline;
+    double tolerance = DEFAULT_TOLERANCE;
+};
+
+struct CaseResult {
+    std::string name;
+    bool ok = false;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;         // payload data moved, whether renamed or copied
+    uint64_t bytesCopied = 0;   // data copied because it crossed devices
+    double seconds = 0;
+    int64_t succeeded = 0;
+    int64_t failed = 0;
+    int64_t peakRssKb = 0;
+    int64_t syscalls = -1;      // -1 when not counted
+};
+
+static std::string FilesystemName(const fs::path& dir) {
+    struct statfs info;
+    if (statfs(dir.c_str(), &info) != 0) {
+        return "unknown";
+    }
+    if (static_cast<unsigned long>(info.f_type) == TMPFS_MAGIC_NUMBER) {
+        return "tmpfs";
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "0x%lx", static_cast<unsigned long>(info.f_type));
+    return name;
+}
+
+// Child side: build the tree, unfold it, write the measurements to fd
+static int RunCase(const std::string& name, const BenchOptions& options, int fd) {
+    TreeSpec spec;
+    DefaultTreeSpec(name, options.scale, spec);
+    spec.seed = options.seed;
+
+    TreeInfo tree;
+    std::string error;
+    if (!GenerateTree(options.dir / name, spec, tree, error)) {
+        std::cerr << name << ": failed to build tree: " << error << "\n";
+        return 1;
+    }
+
+    // Cross-device runs move the payload folders' entries straight into crossDir
+    std::vector<MoveItem> items;
+    if (!options.crossDir.empty()) {
+        for (size_t f = 0; f < tree.folders.size(); f++) {
+            std::vector<fs::path> chain;
+            FindPayloadFolder(tree.folders[f], 0, chain);
+            fs::path target = options.crossDir / name / tree.folders[f].parent_path().filename();
+            fs::create_directories(target);
+            for (const auto& entry : fs::directory_iterator(chain.back())) {
+                items.push_back({ entry.path(), target / entry.path().filename() });
+            }
+        }
+    }
+
+    UnfoldOptions unfold;
+    unfold.depth = spec.depth > 1 ? 0 : 1;
+    unfold.workers = options.workers;
+    unfold.conflictPolicy = options.policy;
+    if (options.journal) {
+        unfold.journalDirectory = options.dir / (name + "-journal");
+    }
+    unfold.ioRingDepth = options.ringDepth;
+    unfold.swapParent = options.swapParent;
+    if (options.trace) {
+        unfold.traceDirectory = options.dir / (name + "-trace");
+    }
+    std::vector<std::wstring> folders;
+    for (const auto& folder : tree.folders) {
+        folders.push_back(folder.wstring());
+    }
+
+    // Marks the start and the end of the counted window for the tracer
+    if (options.syscalls) {
+        raise(SIGSTOP);
+    }
+    auto start = std::chrono::steady_clock::now();
+    CaseResult result;
+    if (options.crossDir.empty()) {
+        FolderProcessResult processed = ProcessMultipleFolders(folders, unfold);
+        result.succeeded = processed.successCount;
+        result.failed = processed.failureCount;
+        result.bytesCopied = processed.bytesCopied;
+    } else {
+        MoveReport report = MoveEntries(items, SameDevice(tree.folders.front(), options.crossDir), options.ringDepth);
+        result.succeeded = static_cast<int64_t>(items.size() - report.failed.size());
+        result.failed = static_cast<int64_t>(report.failed.size());
+        result.bytesCopied = report.bytesCopied;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (options.syscalls) {
+        raise(SIGSTOP);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    char line[256];
+    int length = std::snprintf(line, sizeof(line), "%llu %llu %llu %.9f %lld %lld %ld\n",
+                               static_cast<unsigned long long>(tree.entries),
+                               static_cast<unsigned long long>(tree.bytes),
+                               static_cast<unsigned long long>(result.bytesCopied), result.seconds,
+                               static_cast<long long>(result.succeeded), static_cast<long long>(result.failed),
+                               usage.ru_maxrss);
+    return write(fd, line, length) == length ? 0 : 1;
+}
+
+// Parent side of --syscalls: count syscall entries of every thread of the child
+// between its two SIGSTOP markers. Returns the child's wait status.
+static int TraceChild(pid_t child, int64_t& syscalls) {
+    std::map<pid_t, bool> inSyscall;
+    bool counting = false;
+    bool optionsSet = false;
+    int markers = 0;
+    int childStatus = 0;
+    syscalls = 0;
+
+    for (;;) {
+        int status;
+        pid_t tid = waitpid(-1, &status, __WALL);
+        if (tid < 0) {
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            inSyscall.erase(tid);
+            if (tid == child) {
+                childStatus = status;
+                break;
+            }
+            continue;
+        }
+        if (!WIFSTOPPED(status)) {
+            continue;
+        }
+
+        int sig = WSTOPSIG(status);
+        int deliver = 0;
+        if (sig == (SIGTRAP | 0x80)) {
+            bool& inside = inSyscall[tid];
+            if (!inside && counting) {
+                syscalls++;
+            }
+            inside = !inside;
+        } else if (sig == SIGTRAP && (status >> 16) != 0) {
+            // PTRACE_EVENT_CLONE: the new thread reports its own SIGSTOP
+        } else if (sig == SIGSTOP && tid == child) {
+            if (!optionsSet) {
+                ptrace(PTRACE_SETOPTIONS, child, nullptr,
+                       reinterpret_cast<void*>(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL));
+                optionsSet = true;
+            }
+            counting = ++markers == 1;
+            inSyscall.clear();
+        } else if (sig == SIGSTOP) {
+            // First stop of a cloned thread
+        } else {
+            deliver = sig;
+        }
+        ptrace(counting ? PTRACE_SYSCALL : PTRACE_CONT, tid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(deliver)));
+    }
+    return childStatus;
+}
+
+static bool RunInChild(const std::string& name, const BenchOptions& options, CaseResult& result) {
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        return false;
+    }
+
+    pid_t child = fork();
+    if (child < 0) {
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        return false;
+    }
+    if (child == 0) {
+        close(pipeFds[0]);
+        if (options.syscalls) {
+            ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        }
+        _exit(RunCase(name, options, pipeFds[1]));
+    }
+    close(pipeFds[1]);
+
+    int status = 0;
+    if (options.syscalls) {
+        status = TraceChild(child, result.syscalls);
+    } else {
+        waitpid(child, &status, 0);
+    }
+
+    std::string text;
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(pipeFds[0], buffer, sizeof(buffer))) > 0) {
+        text.append(buffer, n);
+    }
+    close(pipeFds[0]);
+
+    std::istringstream in(text);
+    in >> result.entries >> result.bytes >> result.bytesCopied >> result.seconds >> result.succeeded >> result.failed >> result.peakRssKb;
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && !in.fail();
+    return result.ok;
+}
+
+static std::string ToJson(const BenchOptions& options, const std::vector<CaseResult>& results) {
+    std::string out = "{\n  \"version\": 1,\n  \"filesystem\": ";
+    AppendJsonString(out, FilesystemName(options.dir));
+    out += ",\n  \"crossDevice\": ";
+    out += options.crossDir.empty() ? "false" : "true";
+    out += ",\n  \"scale\": " + std::to_string(options.scale);
+    out += ",\n  \"seed\": " + std::to_string(options.seed);
+    out += ",\n  \"workers\": " + std::to_string(options.workers);
+    out += ",\n  \"journal\": ";
+    out += options.journal ? "true" : "false";
+    out += ",\n  \"trace\": ";
+    out += options.trace ? "true" : "false";
+    out += ",\n  \"ioRingDepth\": " + std::to_string(options.ringDepth);
+    out += ",\n  \"swapParent\": ";
+    out += options.swapParent ? "true" : "false";
+    out += ",\n  \"cases\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        double entriesPerSecond = r.seconds > 0 ? r.entries / r.seconds : 0;
+        double bytesPerSecond = r.seconds > 0 ? r.bytes / r.seconds : 0;
+        out += i == 0 ? "\n    {\"name\": " : ",\n    {\"name\": ";
+        AppendJsonString(out, r.name);
+        out += ", \"entries\": " + std::to_string(r.entries);
+        out += ", \"bytes\": " + std::to_string(r.bytes);
+        out += ", \"bytesCopied\": " + std::to_string(r.bytesCopied);
+        out += ", \"seconds\": " + std::to_string(r.seconds);
+        out += ", \"entriesPerSecond\": " + std::to_string(entriesPerSecond);
+        out += ", \"bytesPerSecond\": " + std::to_string(bytesPerSecond);
+        out += ", \"succeeded\": " + std::to_string(r.succeeded);
+        out += ", \"failed\": " + std::to_string(r.failed);
+        out += ", \"peakRssKb\": " + std::to_string(r.peakRssKb);
+        out += ", \"syscalls\": " + (r.syscalls < 0 ? std::string("null") : std::to_string(r.syscalls));
+        out += "}";
+    }
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+// Print each case against the baseline; false when a case got slower than the tolerance allows
+static bool CompareBaseline(const BenchOptions& options, const std::vector<CaseResult>& results) {
+    std::ifstream in(options.baseline, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    JsonValue root;
+    const JsonValue* cases = nullptr;
+    if (!in.is_open() || !ParseJson(text, root) || (cases = root.Find("cases")) == nullptr ||
+        cases->type != JsonValue::Type::Array) {
+        std::cerr << "Not a benchmark report: " << options.baseline.string() << "\n";
+        return false;
+    }
+    if (options.syscalls) {
+        std::cerr << "warning: --syscalls traces the run, timings are slower than the baseline's\n";
+    }
+    const JsonValue* scale = root.Find("scale");
+    if (scale != nullptr && scale->number != options.scale) {
+        std::cerr << "warning: baseline was recorded at scale " << scale->number << "\n";
+    }
+
+    bool ok = true;
+    for (const auto& r : results) {
+        const JsonValue* old = nullptr;
+        for (const auto& entry : cases->array) {
+            const JsonValue* name = entry.Find("name");
+            if (name != nullptr && name->string == r.name) {
+                old = entry.Find("entriesPerSecond");
+            }
+        }
+        if (old == nullptr || old->number <= 0 || r.seconds <= 0) {
+            continue;
+        }
+        double change = (r.entries / r.seconds / old->number - 1) * 100;
+        bool regressed = change < -options.tolerance;
+        std::fprintf(stderr, "%-12s %+7.1f%% entries/s vs baseline%s\n", r.name.c_str(), change,
+                     regressed ? "  REGRESSION" : "");
+        ok = ok && !regressed;
+    }
+    return ok;
+}
+
+static void Usage() {
+    std::cerr << "Usage: unfolder_bench [options]\n"
+              << "  --dir=PATH        where trees are built (tmpfs or a real disk)\n"
+              << "  --cross-dir=PATH  move payloads here, normally on another device\n"
+              << "  --cases=A,B       subset of:";
+    for (const auto& name : TreeShapes()) {
+        std::cerr << " " << name;
+    }
+    std::cerr << "\n"
+              << "  --scale=F         multiply the default tree sizes\n"
+              << "  --seed=N          generator seed\n"
+              << "  --workers=N       worker threads (0 = one per core)\n"
+              << "  --policy=NAME     conflict policy (default rename)\n"
+              << "  --journal         run with the write-ahead journal\n"
+              << "  --trace           record a Chrome trace of every case (kept with --keep)\n"
+              << "  --uring=N         rename and delete through io_uring, N in flight\n"
+              << "  --swap            swap a large payload into a small parent's place (SwapParent=1)\n"
+              << "  --syscalls        count syscalls made while unfolding (ptrace, slows the run)\n"
+              << "  --keep            leave the trees behind\n"
+              << "  --out=FILE        write the JSON report here instead of stdout\n"
+              << "  --baseline=FILE   compare with an earlier report\n"
+              << "  --tolerance=PCT   allowed entries/s loss against the baseline\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    options.dir = fs::temp_directory_path() / "unfolder-bench";
+    options.cases = TreeShapes();
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        std::string value = arg.find('=') == std::string::npos ? "" : arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--dir=", 0) == 0) {
+            options.dir = value;
+        } else if (arg.rfind("--cross-dir=", 0) == 0) {
+            options.crossDir = value;
+        } else if (arg.rfind("--cases=", 0) == 0) {
+            options.cases.clear();
+            std::istringstream list(value);
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                options.cases.push_back(name);
+            }
+        } else if (arg.rfind("--scale=", 0) == 0) {
+            options.scale = std::atof(value.c_str());
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            options.seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg.rfind("--workers=", 0) == 0) {
+            options.workers = std::atoi(value.c_str());
+        } else if (arg.rfind("--policy=", 0) == 0) {
+            if (!ParseConflictPolicy(fs::path(value).wstring(), options.policy)) {
+                std::cerr << "Unknown conflict policy: " << value << "\n";
+                return 1;
+            }
+        } else if (arg == "--journal") {
+            options.journal = true;
+        } else if (arg == "--trace") {
+            options.trace = true;
+        } else if (arg == "--swap") {
+            options.swapParent = true;
+        } else if (arg.rfind("--uring=", 0) == 0) {
+            options.ringDepth = static_cast<unsigned>(std::atoi(value.c_str()));
+        } else if (arg == "--syscalls") {
+            options.syscalls = true;
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else if (arg.rfind("--out=", 0) == 0) {
+            options.out = value;
+        } else if (arg.rfind("--baseline=", 0) == 0) {
+            options.baseline = value;
+        } else if (arg.rfind("--tolerance=", 0) == 0) {
+            options.tolerance = std::atof(value.c_str());
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+
+    TreeSpec spec;
+    for (const auto& name : options.cases) {
+        if (!DefaultTreeSpec(name, options.scale, spec)) {
+            std::cerr << "Unknown case: " << name << "\n";
+            Usage();
+            return 1;
+        }
+    }
+    std::error_code ec;
+    fs::create_directories(options.dir, ec);
+    if (ec) {
+        std::cerr << options.dir.string() << ": " << ec.message() << "\n";
+        return 1;
+    }
+
+    std::vector<CaseResult> results;
+    bool allOk = true;
+    for (const auto& name : options.cases) {
+        // Leftovers of an earlier run would change the shape
+        fs::remove_all(options.dir / name, ec);
+        if (!options.crossDir.empty()) {
+            fs::remove_all(options.crossDir / name, ec);
+        }
+
+        CaseResult result;
+        result.name = name;
+        if (!RunInChild(name, options, result)) {
+            std::cerr << name << ": run failed\n";
+            allOk = false;
+        }
+        std::fprintf(stderr, "%-12s %10llu entries %9.3f s %12.0f entries/s %9.1f MB/s %8lld KB RSS",
+                     name.c_str(), static_cast<unsigned long long>(result.entries), result.seconds,
+                     result.seconds > 0 ? result.entries / result.seconds : 0.0,
+                     result.seconds > 0 ? result.bytes / result.seconds / (1024 * 1024) : 0.0,
+                     static_cast<long long>(result.peakRssKb));
+        if (result.syscalls >= 0) {
+            std::fprintf(stderr, " %10lld syscalls", static_cast<long long>(result.syscalls));
+        }
+        std::fprintf(stderr, "\n");
+        results.push_back(result);
+
+        if (!options.keep) {
+            fs::remove_all(options.dir / name, ec);
+            fs::remove_all(options.dir / (name + "-journal"), ec);
+            fs::remove_all(options.dir / (name + "-trace"), ec);
+            if (!options.crossDir.empty()) {
+                fs::remove_all(options.crossDir / name, ec);
+            }
+        }
+    }
+
+    std::string report = ToJson(options, results);
+    if (options.out.empty()) {
+        std::cout << report;
+    } else {
+        std::ofstream out(options.out, std::ios::binary);
+        out << report;
+        if (!out) {
+            std::cerr << "Failed to write report: " << options.out.string() << "\n";
+            return 1;
+        }
+    }
+
+    if (!options.baseline.empty() && !CompareBaseline(options, results)) {
+        return 2;
+    }
+    return allOk ? 0 : 1;
+}
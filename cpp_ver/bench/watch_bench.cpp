@@ -0,0 +1,128 @@
+// Watch-folder benchmark: creates a burst of wrapper folders (name/contents/files,
+// as an archive extracts) in a watched folder and reports how long the watcher
+// takes to unfold them all, and the CPU it burns while idle before and after.
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job.h"
+#include "watch.h"
+
+static double Seconds(std::chrono::steady_clock::duration elapsed) {
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+// User plus system CPU seconds of this process
+static double CpuSeconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+    fs::path dir;
+    int folders = 1000;
+    int files = 4;
+    int settleMs = 200;
+    int idleMs = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--dir=", 6) == 0) {
+            dir = argv[i] + 6;
+        } else if (std::strncmp(argv[i], "--folders=", 10) == 0) {
+            folders = std::atoi(argv[i] + 10);
+        } else if (std::strncmp(argv[i], "--files=", 8) == 0) {
+            files = std::atoi(argv[i] + 8);
+        } else if (std::strncmp(argv[i], "--settle=", 9) == 0) {
+            settleMs = std::atoi(argv[i] + 9);
+        } else if (std::strncmp(argv[i], "--idle=", 7) == 0) {
+            idleMs = std::atoi(argv[i] + 7);
+        } else {
+            dir.clear();
+            break;
+        }
+    }
+    if (dir.empty() || folders <= 0 || files < 0 || settleMs < 0 || idleMs <= 0) {
+        std::fprintf(stderr, "Usage: unfolder_watch_bench --dir=DIR [--folders=N] [--files=N] [--settle=MS] [--idle=MS]\n");
+        return 1;
+    }
+
+    fs::path root = dir / "watch";
+    std::error_code ec;
+    fs::remove_all(root, ec);
+    fs::create_directories(root, ec);
+    FolderWatcher watcher(settleMs);
+    if (ec || !watcher.Watch(root, ec)) {
+        std::fprintf(stderr, "cannot watch %s: %s\n", root.c_str(), ec.message().c_str());
+        return 1;
+    }
+
+    // Jobs run as under --watch: whatever settles while one runs joins it
+    std::atomic<int> unfolded(0);
+    std::atomic<int> failed(0);
+    std::atomic<int> jobs(0);
+    UnfoldOptions options;
+    std::thread server([&] {
+        for (;;) {
+            std::vector<std::wstring> paths;
+            if (watcher.Receive(paths, -1) == 0) {
+                return; // stopped
+            }
+            UnfoldJob job(options);
+            job.Add(paths);
+            AdmitPaths(watcher, job);
+            FolderProcessResult result = job.Finish();
+            unfolded += result.successCount;
+            failed += result.failureCount;
+            jobs++;
+        }
+    });
+
+    double idleBefore = CpuSeconds();
+    std::this_thread::sleep_for(std::chrono::milliseconds(idleMs));
+    idleBefore = CpuSeconds() - idleBefore;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < folders; f++) {
+        fs::path contents = root / ("archive-" + std::to_string(f)) / "contents";
+        fs::create_directories(contents, ec);
+        for (int i = 0; i < files; i++) {
+            std::ofstream(contents / ("file-" + std::to_string(i) + ".txt")) << "payload " << i << "\n";
+        }
+    }
+    auto created = std::chrono::steady_clock::now();
+
+    auto limit = created + std::chrono::milliseconds(settleMs) + std::chrono::seconds(60);
+    while (unfolded + failed < folders && std::chrono::steady_clock::now() < limit) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto done = std::chrono::steady_clock::now();
+
+    // The last job tears down its pool first; idle is what comes after that
+    std::this_thread::sleep_for(std::chrono::milliseconds(idleMs));
+    double idleAfter = CpuSeconds();
+    std::this_thread::sleep_for(std::chrono::milliseconds(idleMs));
+    idleAfter = CpuSeconds() - idleAfter;
+    watcher.Stop();
+    server.join();
+
+    // Past the settle time, what is left is the watcher's and the jobs' own work
+    double afterSettle = Seconds(done - created) - settleMs / 1e3;
+    std::printf("%d folders of %d files, settle %d ms\n", folders, files, settleMs);
+    std::printf("%-28s %10.3f s\n", "burst created in", Seconds(created - start));
+    std::printf("%-28s %10.3f s\n", "last unfolded after burst", Seconds(done - created));
+    std::printf("%-28s %10.0f folders/s\n", "unfolded past settle time", afterSettle > 0 ? folders / afterSettle : 0.0);
+    std::printf("%-28s %10d\n", "jobs", jobs.load());
+    std::printf("%-28s %10d\n", "failed", failed.load());
+    std::printf("%-28s %10.3f ms CPU per s\n", "idle before burst", idleBefore * 1e6 / idleMs);
+    std::printf("%-28s %10.3f ms CPU per s\n", "idle after burst", idleAfter * 1e6 / idleMs);
+    fs::remove_all(root, ec);
+    return unfolded == folders ? 0 : 1;
+}
@@ -0,0 +1,1506 @@
+#include "archive.h"
+#include "stage_queue.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#define ARCHIVE_READ_SIZE (4 << 20)                // bytes per sequential read, and per block handed to the writer
+#define ARCHIVE_READ_AHEAD (4 * ARCHIVE_READ_SIZE) // how far the reader runs ahead of the writer
+#define ZIP_TASK_BYTES (8 << 20)                   // compressed bytes per zip extraction task
+#define ZIP_TASK_ENTRIES 512
+#define ZIP_EOCD_SEARCH (22 + 65535)               // end record plus the longest comment
+#define TAR_BLOCK 512
+#define TAR_META_LIMIT (1 << 20)                   // largest long-name or pax header accepted
+#define FREE_FOLDER_ATTEMPTS 10000
+
+static std::wstring Widen(const std::string& text) {
+    return fs::u8path(text).wstring();
+}
+
+static std::wstring ErrorText(const wchar_t* what, const std::string& subject, const std::error_code& ec) {
+    std::wstring text = what + Widen(subject);
+    if (ec) {
+        text += L": " + fs::path(ec.message()).wstring();
+    }
+    return text;
+}
+
+static uint16_t Le16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+static uint32_t Le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+static uint64_t Le64(const unsigned char* p) {
+    return static_cast<uint64_t>(Le32(p)) | static_cast<uint64_t>(Le32(p + 4)) << 32;
+}
+
+static uint32_t Crc32(uint32_t crc, const char* data, size_t length) {
+#ifdef HAVE_ZLIB
+    return static_cast<uint32_t>(crc32(crc, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(length)));
+#else
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = value & 1 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+#endif
+}
+
+#ifdef HAVE_ZLIB
+// zlib stream released however extraction ends
+struct Inflater {
+    z_stream stream = {};
+    bool ready = false;
+
+    // windowBits -15 for raw deflate (zip), 31 for gzip
+    bool Init(int windowBits) {
+        ready = inflateInit2(&stream, windowBits) == Z_OK;
+        return ready;
+    }
+    ~Inflater() {
+        if (ready) {
+            inflateEnd(&stream);
+        }
+    }
+};
+#endif
+
+// Read-only archive. ReadAt is positional, so zip workers share one handle.
+class ArchiveFile {
+public:
+    ArchiveFile() = default;
+    ArchiveFile(const ArchiveFile&) = delete;
+    ArchiveFile& operator=(const ArchiveFile&) = delete;
+
+    ~ArchiveFile() {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+#else
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    bool Open(const fs::path& path, std::error_code& ec) {
+#ifdef _WIN32
+        handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        LARGE_INTEGER fileSize;
+        if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &fileSize)) {
+            ec.assign(static_cast<int>(GetLastError()), std::system_category());
+            return false;
+        }
+        size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            ec.assign(errno, std::generic_category());
+            return false;
+        }
+        size = static_cast<uint64_t>(st.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+        return true;
+    }
+
+    uint64_t Size() const { return size; }
+
+    // Fill buffer from offset; done falls short of length only at the end of the file
+    bool ReadAt(uint64_t offset, void* buffer, size_t length, size_t& done, std::error_code& ec) const {
+        char* out = static_cast<char*>(buffer);
+        done = 0;
+        while (done < length) {
+            uint64_t at = offset + done;
+#ifdef _WIN32
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(at);
+            overlapped.OffsetHigh = static_cast<DWORD>(at >> 32);
+            size_t want = length - done;
+            DWORD got = 0;
+            if (!ReadFile(handle, out + done, want > (1u << 30) ? (1u << 30) : static_cast<DWORD>(want), &got,
+                          &overlapped)) {
+                DWORD error = GetLastError();
+                if (error == ERROR_HANDLE_EOF) {
+                    break;
+                }
+                ec.assign(static_cast<int>(error), std::system_category());
+                return false;
+            }
+#else
+            ssize_t got = pread(fd, out + done, length - done, static_cast<off_t>(at));
+            if (got < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ec.assign(errno, std::generic_category());
+                return false;
+            }
+#endif
+            if (got == 0) {
+                break;
+            }
+            done += static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    uint64_t size = 0;
+};
+
+// A file being extracted. Placement guarantees the name was free in the
+// destination, so anything already there is an earlier copy of the same entry
+// and is replaced, as tar does.
+class OutputFile {
+public:
+    OutputFile() = default;
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+    ~OutputFile() { Close(); }
+
+    // mode holds Unix permission bits; 0 takes the default
+    bool Create(const fs::path& path, uint32_t mode, std::error_code& ec) {
+#ifdef _WIN32
+        (void)mode;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (handle != INVALID_HANDLE_VALUE) {
+                return true;
+            }
+            if (GetLastError() != ERROR_FILE_EXISTS || !DeleteFileW(path.c_str())) {
+                break;
+            }
+        }
+        ec.assign(static_cast<int>(GetLastError()), std::system_category());
+        return false;
+#else
+        mode_t permissions = mode != 0 ? static_cast<mode_t>(mode & 0777) : 0666;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, permissions);
+            if (fd >= 0) {
+                return true;
+            }
+            if (errno != EEXIST || unlink(path.c_str()) != 0) {
+                break;
+            }
+        }
+        ec.assign(errno, std::generic_category());
+        return false;
+#endif
+    }
+
+    bool Write(const char* data, size_t length, std::error_code& ec) {
+        while (length > 0) {
+#ifdef _WIN32
+            DWORD written = 0;
+            if (!WriteFile(handle, data, length > (1u << 30) ? (1u << 30) : static_cast<DWORD>(length), &written, NULL)) {
+                ec.assign(static_cast<int>(GetLastError()), std::system_category());
+                return false;
+            }
+#else
+            ssize_t written = write(fd, data, length);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ec.assign(errno, std::generic_category());
+                return false;
+            }
+#endif
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    // Stamp the modification time (seconds since 1970; negative leaves it) and close
+    bool Finish(int64_t mtime, std::error_code& ec) {
+#ifdef _WIN32
+        if (mtime >= 0) {
+            uint64_t ticks = (static_cast<uint64_t>(mtime) + 11644473600ull) * 10000000ull;
+            FILETIME time = { static_cast<DWORD>(ticks), static_cast<DWORD>(ticks >> 32) };
+            SetFileTime(handle, NULL, NULL, &time);
+        }
+        bool closed = CloseHandle(handle) != 0;
+        handle = INVALID_HANDLE_VALUE;
+        if (!closed) {
+            ec.assign(static_cast<int>(GetLastError()), std::system_category());
+        }
+        return closed;
+#else
+        if (mtime >= 0) {
+            struct timespec times[2] = { { static_cast<time_t>(mtime), 0 }, { static_cast<time_t>(mtime), 0 } };
+            futimens(fd, times);
+        }
+        bool closed = close(fd) == 0;
+        fd = -1;
+        if (!closed) {
+            ec.assign(errno, std::generic_category());
+        }
+        return closed;
+#endif
+    }
+
+private:
+    void Close() {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+            handle = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+};
+
+// Split an entry name into path components. Refuses absolute names, ".." and
+// components this system cannot hold, so no entry lands outside the destination.
+// Zip archives written on Windows may separate with backslashes.
+static bool SplitEntryName(const std::string& name, bool backslashes, std::vector<std::string>& parts) {
+#ifdef _WIN32
+    backslashes = true;
+#endif
+    const char* separators = backslashes ? "/\\" : "/";
+    parts.clear();
+    if (!name.empty() && std::strchr(separators, name[0]) != nullptr) {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find_first_of(separators, start);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        std::string part = name.substr(start, end - start);
+        start = end + 1;
+        if (part.empty() || part == ".") {
+            continue;
+        }
+        if (part == "..") {
+            return false;
+        }
+        for (unsigned char c : part) {
+            if (c < 0x20) {
+                return false;
+            }
+#ifdef _WIN32
+            if (std::strchr("<>:\"|?*", c) != nullptr) {
+                return false;
+            }
+#endif
+        }
+        parts.push_back(std::move(part));
+    }
+    return true;
+}
+
+static fs::path JoinParts(const fs::path& base, const std::vector<std::string>& parts, size_t first) {
+    fs::path path = base;
+    for (size_t i = first; i < parts.size(); i++) {
+        path /= fs::u8path(parts[i]);
+    }
+    return path;
+}
+
+// Decides where each entry goes. Entries are written under the destination with
+// the archive's top-level folder stripped for as long as every entry lies in that
+// one folder and no top-level name is already taken there. When an entry breaks
+// either, the entries placed so far move into a fresh folder and placement
+// carries on there, so the result is never worse than a plain extraction.
+class EntryPlacer {
+public:
+    EntryPlacer(const fs::path& destination, const std::string& archiveName)
+        : destination(destination), base(destination), archiveName(archiveName) {}
+
+    bool Load(std::error_code& ec) { return existing.Load(destination, ec); }
+
+    // Final path of the entry named by parts, moving earlier entries first when it
+    // breaks the layout so far. target is empty for the stripped folder itself.
+    bool Place(const std::vector<std::string>& parts, bool folder, fs::path& target, std::wstring& error);
+
+    // Where an entry placed earlier is now; empty for the stripped folder and for
+    // names outside it
+    fs::path Locate(const std::vector<std::string>& parts) const;
+
+    const fs::path& Base() const { return base; }
+    bool Stripped() const { return strip == 1; }
+
+private:
+    bool InRoot(const std::vector<std::string>& parts) const {
+        return parts[0] == root || SameName(fs::u8path(parts[0]), fs::u8path(root));
+    }
+    bool MakeFreeFolder(const std::string& name, fs::path& folder, std::wstring& error);
+    bool MovePlaced(const fs::path& into, std::wstring& error);
+
+    fs::path destination;
+    fs::path base;               // folder entries are placed under
+    std::string archiveName;     // fresh folder name when there is no single top-level folder
+    std::string root;            // the top-level folder being stripped
+    std::string lastTop;         // top-level name of the last entry placed
+    int strip = -1;              // leading components dropped; -1 until the first entry
+    bool fresh = false;          // base is a folder this extraction created
+    NameIndex existing;          // names in the destination before extraction
+    NameIndex placedNames;
+    std::vector<fs::path> placed;   // top-level names placed straight into the destination
+};
+
+bool EntryPlacer::Place(const std::vector<std::string>& parts, bool folder, fs::path& target, std::wstring& error) {
+    if (strip < 0) {
+        strip = parts.size() > 1 || folder ? 1 : 0;
+        root = parts[0];
+    }
+
+    // A second top-level entry: nothing is stripped after all
+    if (strip == 1 && (!InRoot(parts) || (parts.size() == 1 && !folder))) {
+        fs::path rootName = fs::u8path(root);
+        std::error_code ec;
+        if (!fresh && !existing.Contains(rootName) && !placedNames.Contains(rootName)) {
+            // Extract the archive as it is, straight into the destination
+            fs::path rootPath = destination / rootName;
+            if (!fs::create_directory(rootPath, ec)) {
+                error = ErrorText(L"Failed to create folder ", rootPath.u8string(), ec);
+                return false;
+            }
+            if (!MovePlaced(rootPath, error)) {
+                return false;
+            }
+            placedNames.Insert(rootName);
+            placed.push_back(rootName);
+        } else {
+            fs::path folderPath;
+            if (!MakeFreeFolder(archiveName, folderPath, error)) {
+                return false;
+            }
+            fs::path rootPath = folderPath / rootName;
+            if (fresh) {
+                if (RenameNoReplace(base, rootPath, ec) != MoveStatus::Moved) {
+                    error = ErrorText(L"Failed to move extracted entries into ", folderPath.u8string(), ec);
+                    return false;
+                }
+            } else if (!fs::create_directory(rootPath, ec) && ec) {
+                error = ErrorText(L"Failed to create folder ", rootPath.u8string(), ec);
+                return false;
+            } else if (!MovePlaced(rootPath, error)) {
+                return false;
+            }
+            base = folderPath;
+            fresh = true;
+        }
+        strip = 0;
+        lastTop.clear();
+    }
+
+    // Entries come grouped by folder, so most share the last one's top-level name
+    if (parts.size() > static_cast<size_t>(strip) && !fresh && parts[strip] != lastTop) {
+        lastTop = parts[strip];
+        fs::path top = fs::u8path(lastTop);
+        if (existing.Contains(top)) {
+            // The name is taken: keep what was there and extract into a folder of its own
+            fs::path folderPath;
+            if (!MakeFreeFolder(strip == 1 ? root : archiveName, folderPath, error) || !MovePlaced(folderPath, error)) {
+                return false;
+            }
+            base = folderPath;
+            fresh = true;
+        } else if (!placedNames.Contains(top)) {
+            placedNames.Insert(top);
+            placed.push_back(top);
+        }
+    }
+
+    target = Locate(parts);
+    return true;
+}
+
+fs::path EntryPlacer::Locate(const std::vector<std::string>& parts) const {
+    if (parts.size() <= static_cast<size_t>(strip < 0 ? 0 : strip)) {
+        return fs::path();
+    }
+    if (strip == 1 && !InRoot(parts)) {
+        return fs::path();
+    }
+    return JoinParts(base, parts, static_cast<size_t>(strip));
+}
+
+bool EntryPlacer::MakeFreeFolder(const std::string& name, fs::path& folder, std::wstring& error) {
+    for (int attempt = 1; attempt <= FREE_FOLDER_ATTEMPTS; attempt++) {
+        fs::path candidate = fs::u8path(attempt == 1 ? name : name + " (" + std::to_string(attempt) + ")");
+        if (existing.Contains(candidate) || placedNames.Contains(candidate)) {
+            continue;
+        }
+        std::error_code ec;
+        if (fs::create_directory(destination / candidate, ec)) {
+            folder = destination / candidate;
+            return true;
+        }
+        if (ec) {
+            error = ErrorText(L"Failed to create folder ", (destination / candidate).u8string(), ec);
+            return false;
+        }
+    }
+    error = L"No free folder name for " + Widen(name);
+    return false;
+}
+
+bool EntryPlacer::MovePlaced(const fs::path& into, std::wstring& error) {
+    for (const auto& name : placed) {
+        std::error_code ec;
+        MoveStatus status = RenameNoReplace(base / name, into / name, ec);
+        // A zip is placed before anything is written, so there may be nothing to move
+        if (status != MoveStatus::Moved && ec != std::errc::no_such_file_or_directory) {
+            error = ErrorText(L"Failed to move extracted entry ", (base / name).u8string(), ec);
+            return false;
+        }
+    }
+    placed.clear();
+    return true;
+}
+
+// A symbolic link, made once every file is written so no entry is written through one
+struct DeferredLink {
+    std::vector<std::string> parts;
+    std::string target;
+};
+
+// A folder whose time is set last, since writing into a folder changes it
+struct FolderTime {
+    std::vector<std::string> parts;
+    int64_t mtime;
+};
+
+static bool CreateDeferredLinks(const EntryPlacer& placer, const std::vector<DeferredLink>& links, std::wstring& error) {
+    for (const auto& link : links) {
+        fs::path path = placer.Locate(link.parts);
+        if (path.empty()) {
+            continue;
+        }
+        std::error_code ec;
+        fs::create_directories(path.parent_path(), ec);
+        // Links are made last, so anything already at path came from the archive:
+        // an earlier copy of the same link is replaced, as tar does, but a file or
+        // folder of the same name is kept and the link reported
+        fs::file_status existing = fs::symlink_status(path, ec);
+        if (fs::is_symlink(existing)) {
+            if (!fs::remove(path, ec)) {
+                error = ErrorText(L"Failed to replace link ", path.u8string(), ec);
+                return false;
+            }
+        } else if (fs::exists(existing)) {
+            error = ErrorText(L"Link collides with an extracted entry ", path.u8string(), std::make_error_code(std::errc::file_exists));
+            return false;
+        }
+        fs::create_symlink(fs::u8path(link.target), path, ec);
+        if (ec) {
+            error = ErrorText(L"Failed to create link ", path.u8string(), ec);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void SetFolderTimes(const EntryPlacer& placer, const std::vector<FolderTime>& folders) {
+#ifndef _WIN32
+    // Parents come before their children in an archive, so set the deepest first
+    for (auto it = folders.rbegin(); it != folders.rend(); ++it) {
+        fs::path path = placer.Locate(it->parts);
+        if (path.empty() || it->mtime < 0) {
+            continue;
+        }
+        struct timespec times[2] = { { static_cast<time_t>(it->mtime), 0 }, { static_cast<time_t>(it->mtime), 0 } };
+        utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW);
+    }
+#else
+    (void)placer;
+    (void)folders;
+#endif
+}
+
+struct ZipEntry {
+    std::string name;
+    std::vector<std::string> parts;
+    fs::path target;
+    uint64_t offset = 0;            // of the local header
+    uint64_t compressedSize = 0;
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    uint16_t method = 0;
+    uint32_t mode = 0;              // Unix mode, 0 when the archive was not made on Unix
+    int64_t mtime = -1;
+    bool folder = false;
+    bool link = false;
+};
+
+static int64_t DosTime(uint16_t time, uint16_t date) {
+    std::tm parts = {};
+    parts.tm_year = ((date >> 9) & 0x7F) + 80;
+    parts.tm_mon = ((date >> 5) & 0x0F) - 1;
+    parts.tm_mday = date & 0x1F;
+    parts.tm_hour = time >> 11;
+    parts.tm_min = (time >> 5) & 0x3F;
+    parts.tm_sec = (time & 0x1F) * 2;
+    parts.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&parts));
+}
+
+// Read the central directory: every entry's name, sizes and data offset in one read
+static bool ReadZipDirectory(const ArchiveFile& file, std::vector<ZipEntry>& entries, std::wstring& error) {
+    std::error_code ec;
+    size_t done = 0;
+    uint64_t fileSize = file.Size();
+    size_t tailSize = fileSize < ZIP_EOCD_SEARCH ? static_cast<size_t>(fileSize) : ZIP_EOCD_SEARCH;
+    std::vector<unsigned char> tail(tailSize);
+    if (!file.ReadAt(fileSize - tailSize, tail.data(), tailSize, done, ec) || done != tailSize) {
+        error = ErrorText(L"Failed to read archive", "", ec);
+        return false;
+    }
+    size_t end = tailSize < 22 ? 0 : tailSize - 22 + 1;
+    while (end > 0 && Le32(&tail[end - 1]) != 0x06054b50) {
+        end--;
+    }
+    if (end == 0) {
+        error = L"Not a zip archive: no central directory";
+        return false;
+    }
+    const unsigned char* record = &tail[end - 1];
+    uint64_t count = Le16(record + 10);
+    uint64_t directorySize = Le32(record + 12);
+    uint64_t directoryOffset = Le32(record + 16);
+
+    if (count == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF) {
+        // Zip64: a locator just before the end record points at the larger one
+        uint64_t recordAt = fileSize - tailSize + (end - 1);
+        unsigned char locator[20];
+        unsigned char zip64[56];
+        if (recordAt < sizeof(locator) || !file.ReadAt(recordAt - sizeof(locator), locator, sizeof(locator), done, ec) ||
+            done != sizeof(locator) || Le32(locator) != 0x07064b50 ||
+            !file.ReadAt(Le64(locator + 8), zip64, sizeof(zip64), done, ec) || done != sizeof(zip64) ||
+            Le32(zip64) != 0x06064b50) {
+            error = L"Corrupt zip64 end of central directory";
+            return false;
+        }
+        count = Le64(zip64 + 32);
+        directorySize = Le64(zip64 + 40);
+        directoryOffset = Le64(zip64 + 48);
+    }
+    if (directoryOffset > fileSize || directorySize > fileSize - directoryOffset) {
+        error = L"Corrupt zip central directory";
+        return false;
+    }
+
+    std::vector<unsigned char> directory(static_cast<size_t>(directorySize));
+    if (!file.ReadAt(directoryOffset, directory.data(), directory.size(), done, ec) || done != directory.size()) {
+        error = ErrorText(L"Failed to read archive", "", ec);
+        return false;
+    }
+
+    entries.reserve(static_cast<size_t>(count < directory.size() / 46 ? count : directory.size() / 46));
+    size_t at = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (directory.size() - at < 46 || Le32(&directory[at]) != 0x02014b50) {
+            error = L"Corrupt zip central directory";
+            return false;
+        }
+        const unsigned char* header = &directory[at];
+        uint16_t nameLength = Le16(header + 28);
+        uint16_t extraLength = Le16(header + 30);
+        uint16_t commentLength = Le16(header + 32);
+        if (directory.size() - at - 46 < static_cast<size_t>(nameLength) + extraLength + commentLength) {
+            error = L"Corrupt zip central directory";
+            return false;
+        }
+
+        ZipEntry entry;
+        uint16_t madeBy = Le16(header + 4);
+        uint16_t flags = Le16(header + 8);
+        entry.method = Le16(header + 10);
+        entry.mtime = DosTime(Le16(header + 12), Le16(header + 14));
+        entry.crc = Le32(header + 16);
+        entry.compressedSize = Le32(header + 20);
+        entry.size = Le32(header + 24);
+        uint32_t attributes = Le32(header + 38);
+        entry.offset = Le32(header + 42);
+        entry.name.assign(reinterpret_cast<const char*>(header + 46), nameLength);
+
+        const unsigned char* extra = header + 46 + nameLength;
+        for (size_t field = 0; field + 4 <= extraLength;) {
+            uint16_t id = Le16(extra + field);
+            uint16_t length = Le16(extra + field + 2);
+            const unsigned char* data = extra + field + 4;
+            if (field + 4 + length > extraLength) {
+                break;
+            }
+            if (id == 0x0001) {
+                // Zip64 sizes and offset, present for the fields that overflowed
+                size_t used = 0;
+                uint64_t* values[] = { &entry.size, &entry.compressedSize, &entry.offset };
+                for (uint64_t* value : values) {
+                    if (*value == 0xFFFFFFFF && used + 8 <= length) {
+                        *value = Le64(data + used);
+                        used += 8;
+                    }
+                }
+            } else if (id == 0x5455 && length >= 5 && (data[0] & 1)) {
+                // Extended timestamp: the Unix modification time
+                entry.mtime = static_cast<int32_t>(Le32(data + 1));
+            }
+            field += 4 + length;
+        }
+        at += 46 + static_cast<size_t>(nameLength) + extraLength + commentLength;
+
+        if (flags & 1) {
+            error = L"Encrypted entries are not supported: " + Widen(entry.name);
+            return false;
+        }
+        entry.folder = !entry.name.empty() && (entry.name.back() == '/' || entry.name.back() == '\\');
+        if ((madeBy >> 8) == 3) {
+            entry.mode = attributes >> 16;
+            entry.link = (entry.mode & 0170000) == 0120000;
+            entry.folder = entry.folder || (entry.mode & 0170000) == 0040000;
+        } else if (attributes & 0x10) {
+            entry.folder = true;
+        }
+        if (!SplitEntryName(entry.name, true, entry.parts)) {
+            error = L"Entry would be extracted outside the destination: " + Widen(entry.name);
+            return false;
+        }
+        if (!entry.parts.empty()) {
+            entries.push_back(std::move(entry));
+        }
+    }
+    return true;
+}
+
+// Each worker's buffers, kept for the tasks it runs after the first
+struct ZipBuffers {
+    std::vector<char> input;
+    std::vector<char> output;
+};
+
+// Copy or inflate one entry's data into sink, checking its size and CRC
+static bool ReadZipData(const ArchiveFile& file, const ZipEntry& entry, ZipBuffers& buffers,
+                        const std::function<bool(const char*, size_t)>& sink, std::wstring& error) {
+    std::error_code ec;
+    size_t done = 0;
+    unsigned char local[30];
+    if (!file.ReadAt(entry.offset, local, sizeof(local), done, ec) || done != sizeof(local) ||
+        Le32(local) != 0x04034b50) {
+        error = ErrorText(L"Corrupt zip entry ", entry.name, ec);
+        return false;
+    }
+    uint64_t at = entry.offset + sizeof(local) + Le16(local + 26) + Le16(local + 28);
+    uint64_t remaining = entry.compressedSize;
+    if (at > file.Size() || remaining > file.Size() - at) {
+        error = L"Truncated zip entry " + Widen(entry.name);
+        return false;
+    }
+    if (buffers.input.empty()) {
+        buffers.input.resize(ARCHIVE_READ_SIZE);
+        buffers.output.resize(ARCHIVE_READ_SIZE);
+    }
+
+    // The next piece of compressed data, read with one large positional read
+    auto read = [&](size_t& length) {
+        length = remaining < buffers.input.size() ? static_cast<size_t>(remaining) : buffers.input.size();
+        if (!file.ReadAt(at, buffers.input.data(), length, done, ec) || done != length) {
+            error = ErrorText(L"Failed to read zip entry ", entry.name, ec);
+            return false;
+        }
+        at += length;
+        remaining -= length;
+        return true;
+    };
+
+    uint32_t crc = 0;
+    uint64_t produced = 0;
+    if (entry.method == 0) {
+        while (remaining > 0) {
+            size_t length;
+            if (!read(length)) {
+                return false;
+            }
+            crc = Crc32(crc, buffers.input.data(), length);
+            produced += length;
+            if (!sink(buffers.input.data(), length)) {
+                return false;
+            }
+        }
+    } else if (entry.method == 8) {
+#ifdef HAVE_ZLIB
+        Inflater inflater;
+        if (!inflater.Init(-MAX_WBITS)) {
+            error = L"Failed to start inflating " + Widen(entry.name);
+            return false;
+        }
+        z_stream& stream = inflater.stream;
+        int status = Z_OK;
+        while (status != Z_STREAM_END) {
+            if (stream.avail_in == 0) {
+                size_t length;
+                if (remaining == 0) {
+                    error = L"Truncated zip entry " + Widen(entry.name);
+                    return false;
+                }
+                if (!read(length)) {
+                    return false;
+                }
+                stream.next_in = reinterpret_cast<Bytef*>(buffers.input.data());
+                stream.avail_in = static_cast<uInt>(length);
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(buffers.output.data());
+            stream.avail_out = static_cast<uInt>(buffers.output.size());
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                error = L"Corrupt compressed data in " + Widen(entry.name);
+                return false;
+            }
+            size_t length = buffers.output.size() - stream.avail_out;
+            crc = Crc32(crc, buffers.output.data(), length);
+            produced += length;
+            if (length > 0 && !sink(buffers.output.data(), length)) {
+                return false;
+            }
+        }
+#else
+        error = L"Compressed entries need a build with zlib: " + Widen(entry.name);
+        return false;
+#endif
+    } else {
+        error = L"Unsupported compression method " + std::to_wstring(entry.method) + L": " + Widen(entry.name);
+        return false;
+    }
+
+    if (produced != entry.size || crc != entry.crc) {
+        error = L"Checksum mismatch in " + Widen(entry.name);
+        return false;
+    }
+    return true;
+}
+
+static bool ExtractZipFile(const ArchiveFile& file, const ZipEntry& entry, ZipBuffers& buffers, std::wstring& error) {
+    std::error_code ec;
+    OutputFile out;
+    if (!out.Create(entry.target, entry.mode, ec)) {
+        error = ErrorText(L"Failed to create ", entry.target.u8string(), ec);
+        return false;
+    }
+    auto write = [&](const char* data, size_t length) {
+        if (!out.Write(data, length, ec)) {
+            error = ErrorText(L"Failed to write ", entry.target.u8string(), ec);
+            return false;
+        }
+        return true;
+    };
+    if (!ReadZipData(file, entry, buffers, write, error)) {
+        return false;
+    }
+    if (!out.Finish(entry.mtime, ec)) {
+        error = ErrorText(L"Failed to write ", entry.target.u8string(), ec);
+        return false;
+    }
+    return true;
+}
+
+// Every entry's place is known from the central directory before anything is
+// written, so folders are made up front and the files spread over the workers
+// in offset order, each worker streaming its own run of the archive.
+static bool ExtractZip(const ArchiveFile& file, EntryPlacer& placer, int workers, ArchiveResult& result) {
+    std::vector<ZipEntry> entries;
+    if (!ReadZipDirectory(file, entries, result.error)) {
+        return false;
+    }
+    for (auto& entry : entries) {
+        if (!placer.Place(entry.parts, entry.folder, entry.target, result.error)) {
+            return false;
+        }
+    }
+
+    std::vector<fs::path> folders;
+    std::vector<FolderTime> folderTimes;
+    std::vector<size_t> files;
+    std::vector<DeferredLink> links;
+    folders.push_back(placer.Base());
+    for (size_t i = 0; i < entries.size(); i++) {
+        ZipEntry& entry = entries[i];
+        // A later entry may have moved the base since the first ones were placed
+        entry.target = placer.Locate(entry.parts);
+        if (entry.folder) {
+            if (!entry.target.empty()) {
+                folders.push_back(entry.target);
+                folderTimes.push_back({ entry.parts, entry.mtime });
+                result.folders++;
+            }
+            continue;
+        }
+        if (entry.target.empty()) {
+            continue;
+        }
+        if (folders.back() != entry.target.parent_path()) {
+            folders.push_back(entry.target.parent_path());
+        }
+        files.push_back(i);
+    }
+    std::sort(folders.begin(), folders.end());
+    folders.erase(std::unique(folders.begin(), folders.end()), folders.end());
+    for (const auto& folder : folders) {
+        std::error_code ec;
+        fs::create_directories(folder, ec);
+        if (ec) {
+            result.error = ErrorText(L"Failed to create folder ", folder.u8string(), ec);
+            return false;
+        }
+    }
+
+    std::sort(files.begin(), files.end(), [&](size_t a, size_t b) { return entries[a].offset < entries[b].offset; });
+    std::mutex mutex;
+    std::atomic<bool> failed(false);
+    std::atomic<size_t> written(0);
+    std::atomic<uint64_t> bytes(0);
+    {
+        TraceSpan span("archive", "zip entries");
+        ThreadPool pool(workers);
+        size_t begin = 0;
+        while (begin < files.size()) {
+            size_t end = begin;
+            uint64_t batchBytes = 0;
+            while (end < files.size() && end - begin < ZIP_TASK_ENTRIES && batchBytes < ZIP_TASK_BYTES) {
+                batchBytes += entries[files[end]].compressedSize;
+                end++;
+            }
+            pool.Submit([&, begin, end] {
+                thread_local ZipBuffers buffers;
+                for (size_t i = begin; i < end && !failed.load(std::memory_order_relaxed); i++) {
+                    const ZipEntry& entry = entries[files[i]];
+                    std::wstring error;
+                    bool ok;
+                    if (entry.link) {
+                        std::string target;
+                        ok = ReadZipData(file, entry, buffers, [&](const char* data, size_t length) {
+                            target.append(data, length);
+                            return true;
+                        }, error);
+                        if (ok) {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            links.push_back({ entry.parts, std::move(target) });
+                        }
+                    } else {
+                        ok = ExtractZipFile(file, entry, buffers, error);
+                        if (ok) {
+                            written.fetch_add(1, std::memory_order_relaxed);
+                            bytes.fetch_add(entry.size, std::memory_order_relaxed);
+                        }
+                    }
+                    if (!ok) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (!failed.exchange(true)) {
+                            result.error = error;
+                        }
+                    }
+                }
+            });
+            begin = end;
+        }
+        pool.Wait();
+    }
+    result.files = written.load();
+    result.bytes = bytes.load();
+    if (failed.load()) {
+        return false;
+    }
+
+    result.links = links.size();
+    if (!CreateDeferredLinks(placer, links, result.error)) {
+        return false;
+    }
+    SetFolderTimes(placer, folderTimes);
+    return true;
+}
+
+// Archive data read ahead on a thread of its own, and inflated there when it
+// is gzipped, so reading and decompression overlap with the writes. A gzip
+// stream decodes strictly in order, so this is as parallel as it gets.
+class StreamReader {
+public:
+    StreamReader(const ArchiveFile& file, bool gzip) : file(file), gzip(gzip), blocks(ARCHIVE_READ_AHEAD) {
+        producer = std::thread(&StreamReader::Produce, this);
+    }
+
+    ~StreamReader() {
+        stopping = true;
+        std::vector<char> block;
+        while (blocks.Pop(block)) {
+        }
+        producer.join();
+    }
+
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+
+    // Up to length bytes of the stream, in place; 0 at its end
+    size_t Next(const char*& data, uint64_t length) {
+        while (position == current.size()) {
+            if (current.capacity() > 0) {
+                std::lock_guard<std::mutex> lock(spareMutex);
+                spare.push_back(std::move(current));
+            }
+            if (!blocks.Pop(current)) {
+                return 0;
+            }
+            position = 0;
+        }
+        size_t available = current.size() - position;
+        if (available > length) {
+            available = static_cast<size_t>(length);
+        }
+        data = current.data() + position;
+        position += available;
+        return available;
+    }
+
+    bool Read(char* out, size_t length) {
+        while (length > 0) {
+            const char* data;
+            size_t got = Next(data, length);
+            if (got == 0) {
+                return false;
+            }
+            std::memcpy(out, data, got);
+            out += got;
+            length -= got;
+        }
+        return true;
+    }
+
+    bool Skip(uint64_t length) {
+        while (length > 0) {
+            const char* data;
+            size_t got = Next(data, length);
+            if (got == 0) {
+                return false;
+            }
+            length -= got;
+        }
+        return true;
+    }
+
+    // Why the stream ended early; read once Next has returned 0
+    const std::wstring& Error() const { return error; }
+
+private:
+    void Produce();
+
+    // A block the reader has finished with, so blocks are not faulted in afresh
+    std::vector<char> TakeBlock() {
+        std::vector<char> block;
+        {
+            std::lock_guard<std::mutex> lock(spareMutex);
+            if (!spare.empty()) {
+                block = std::move(spare.back());
+                spare.pop_back();
+            }
+        }
+        block.resize(ARCHIVE_READ_SIZE);
+        return block;
+    }
+
+    const ArchiveFile& file;
+    bool gzip;
+    StageQueue<std::vector<char>> blocks;
+    std::vector<char> current;
+    size_t position = 0;
+    std::mutex spareMutex;
+    std::vector<std::vector<char>> spare;
+    std::atomic<bool> stopping{ false };
+    std::wstring error;   // written before blocks is closed
+    std::thread producer;
+};
+
+void StreamReader::Produce() {
+    TraceSpan span("archive", "read ahead");
+    uint64_t offset = 0;
+    std::vector<char> input = TakeBlock();
+#ifdef HAVE_ZLIB
+    Inflater inflater;
+    if (gzip && !inflater.Init(16 + MAX_WBITS)) {
+        error = L"Failed to start inflating the archive";
+        blocks.Close();
+        return;
+    }
+    std::vector<char> output;
+    bool ended = false;
+#endif
+    while (!stopping && error.empty()) {
+        std::error_code ec;
+        size_t done = 0;
+        if (!file.ReadAt(offset, input.data(), input.size(), done, ec)) {
+            error = ErrorText(L"Failed to read archive", "", ec);
+            break;
+        }
+        offset += done;
+        if (!gzip) {
+            if (done == 0) {
+                break;
+            }
+            input.resize(done);
+            blocks.Push(std::move(input), done);
+            input = TakeBlock();
+            continue;
+        }
+#ifdef HAVE_ZLIB
+        if (done == 0) {
+            if (!ended) {
+                error = L"Archive is truncated";
+            }
+            break;
+        }
+        z_stream& stream = inflater.stream;
+        stream.next_in = reinterpret_cast<Bytef*>(input.data());
+        stream.avail_in = static_cast<uInt>(done);
+        while (stream.avail_in > 0 && !stopping) {
+            if (ended) {
+                // Another gzip member follows
+                inflateReset(&stream);
+                ended = false;
+            }
+            if (output.empty()) {
+                output = TakeBlock();
+                stream.next_out = reinterpret_cast<Bytef*>(output.data());
+                stream.avail_out = static_cast<uInt>(output.size());
+            }
+            int status = inflate(&stream, Z_NO_FLUSH);
+            if (status == Z_STREAM_END) {
+                ended = true;
+            } else if (status != Z_OK && status != Z_BUF_ERROR) {
+                error = L"Corrupt compressed data in the archive";
+                break;
+            }
+            if (stream.avail_out == 0) {
+                blocks.Push(std::move(output), ARCHIVE_READ_SIZE);
+                output = std::vector<char>();
+            }
+        }
+#endif
+    }
+#ifdef HAVE_ZLIB
+    // Whatever inflated before an error still reaches the reader, so an archive
+    // followed by padding or junk extracts up to its closing blocks
+    if (!output.empty()) {
+        size_t length = output.size() - inflater.stream.avail_out;
+        output.resize(length);
+        blocks.Push(std::move(output), length);
+    }
+#endif
+    blocks.Close();
+}
+
+// Overrides from GNU long-name and pax headers for the entry that follows them
+struct TarOverrides {
+    std::string path;
+    std::string linkPath;
+    uint64_t size = 0;
+    bool hasSize = false;
+    int64_t mtime = 0;
+    bool hasMtime = false;
+};
+
+static uint64_t TarNumber(const char* field, size_t length) {
+    uint64_t value = 0;
+    if (static_cast<unsigned char>(field[0]) & 0x80) {
+        // GNU base-256, for sizes past 8 GiB
+        value = static_cast<unsigned char>(field[0]) & 0x3F;
+        for (size_t i = 1; i < length; i++) {
+            value = value << 8 | static_cast<unsigned char>(field[i]);
+        }
+        return value;
+    }
+    size_t i = 0;
+    while (i < length && field[i] == ' ') {
+        i++;
+    }
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + static_cast<uint64_t>(field[i] - '0');
+    }
+    return value;
+}
+
+static std::string TarString(const char* field, size_t length) {
+    const void* end = std::memchr(field, '\0', length);
+    return std::string(field, end != nullptr ? static_cast<const char*>(end) - field : length);
+}
+
+// The header checksum counts its own field as spaces; old writers summed signed bytes
+static bool TarChecksumOk(const char* header) {
+    uint64_t stored = TarNumber(header + 148, 8);
+    uint64_t unsignedSum = 0;
+    int64_t signedSum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        char c = i >= 148 && i < 156 ? ' ' : header[i];
+        unsignedSum += static_cast<unsigned char>(c);
+        signedSum += static_cast<signed char>(c);
+    }
+    return stored == unsignedSum || static_cast<int64_t>(stored) == signedSum;
+}
+
+// "length key=value\n" records of a pax extended header
+static void ParsePax(const std::string& data, TarOverrides& overrides) {
+    size_t at = 0;
+    while (at < data.size()) {
+        size_t space = data.find(' ', at);
+        if (space == std::string::npos) {
+            break;
+        }
+        size_t length = std::strtoul(data.c_str() + at, nullptr, 10);
+        if (length <= space - at + 1 || length > data.size() - at) {
+            break;
+        }
+        std::string record = data.substr(space + 1, at + length - space - 2);
+        at += length;
+        size_t equals = record.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = record.substr(0, equals);
+        std::string value = record.substr(equals + 1);
+        if (key == "path") {
+            overrides.path = value;
+        } else if (key == "linkpath") {
+            overrides.linkPath = value;
+        } else if (key == "size") {
+            overrides.size = std::strtoull(value.c_str(), nullptr, 10);
+            overrides.hasSize = true;
+        } else if (key == "mtime") {
+            overrides.mtime = std::strtoll(value.c_str(), nullptr, 10);
+            overrides.hasMtime = true;
+        }
+    }
+}
+
+// Entries arrive one at a time and are placed as they come: a tar has no index,
+// so the single top-level folder is assumed from the first entry and given up
+// (moving what was written) if a later one disagrees.
+static bool ExtractTar(StreamReader& input, EntryPlacer& placer, ArchiveResult& result) {
+    char header[TAR_BLOCK];
+    TarOverrides next;
+    std::vector<std::string> parts;
+    std::vector<DeferredLink> links;
+    std::vector<FolderTime> folderTimes;
+    fs::path lastParent;
+
+    auto truncated = [&] {
+        result.error = input.Error().empty() ? std::wstring(L"Archive is truncated") : input.Error();
+        return false;
+    };
+
+    for (;;) {
+        if (!input.Read(header, TAR_BLOCK)) {
+            // Archives cut off after an entry, without the closing blocks, still extract
+            if (!input.Error().empty()) {
+                return truncated();
+            }
+            break;
+        }
+        if (std::all_of(header, header + TAR_BLOCK, [](char c) { return c == '\0'; })) {
+            break;
+        }
+        if (!TarChecksumOk(header)) {
+            result.error = L"Corrupt tar header";
+            return false;
+        }
+
+        char type = header[156];
+        uint64_t size = TarNumber(header + 124, 12);
+        if (type == 'L' || type == 'K' || type == 'x' || type == 'g') {
+            if (size > TAR_META_LIMIT) {
+                result.error = L"Tar extended header is too large";
+                return false;
+            }
+            std::string data(static_cast<size_t>((size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK), '\0');
+            if (!input.Read(&data[0], data.size())) {
+                return truncated();
+            }
+            data.resize(static_cast<size_t>(size));
+            if (type == 'x') {
+                ParsePax(data, next);
+            } else if (type != 'g') {
+                (type == 'L' ? next.path : next.linkPath) = data.substr(0, data.find('\0'));
+            }
+            continue;
+        }
+
+        std::string name = TarString(header, 100);
+        if (std::memcmp(header + 257, "ustar", 5) == 0 && header[345] != '\0') {
+            name = TarString(header + 345, 155) + "/" + name;
+        }
+        std::string linkName = TarString(header + 157, 100);
+        int64_t mtime = static_cast<int64_t>(TarNumber(header + 136, 12));
+        uint32_t mode = static_cast<uint32_t>(TarNumber(header + 100, 8));
+        if (!next.path.empty()) {
+            name = next.path;
+        }
+        if (!next.linkPath.empty()) {
+            linkName = next.linkPath;
+        }
+        if (next.hasSize) {
+            size = next.size;
+        }
+        if (next.hasMtime) {
+            mtime = next.mtime;
+        }
+        next = TarOverrides();
+        uint64_t padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+
+        bool folder = type == '5';
+        bool file = type == '0' || type == '\0' || type == '7';
+        if (type == '3' || type == '4' || type == '6' || type == 'V') {
+            // Devices, fifos and volume labels are not extracted
+            if (!input.Skip(size + padding)) {
+                return truncated();
+            }
+            continue;
+        }
+        if (!folder && !file && type != '1' && type != '2') {
+            result.error = L"Unsupported tar entry type '" + std::wstring(1, static_cast<wchar_t>(type)) + L"': " + Widen(name);
+            return false;
+        }
+        if (!SplitEntryName(name, false, parts)) {
+            result.error = L"Entry would be extracted outside the destination: " + Widen(name);
+            return false;
+        }
+        if (parts.empty()) {
+            if (!input.Skip(size + padding)) {
+                return truncated();
+            }
+            continue;
+        }
+
+        fs::path target;
+        if (!placer.Place(parts, folder, target, result.error)) {
+            return false;
+        }
+        std::error_code ec;
+        if (folder) {
+            if (!target.empty()) {
+                fs::create_directories(target, ec);
+                if (ec) {
+                    result.error = ErrorText(L"Failed to create folder ", target.u8string(), ec);
+                    return false;
+                }
+                folderTimes.push_back({ parts, mtime });
+                result.folders++;
+            }
+        } else if (type == '2') {
+            links.push_back({ parts, linkName });
+            result.links++;
+        } else if (!target.empty()) {
+            if (target.parent_path() != lastParent) {
+                lastParent = target.parent_path();
+                fs::create_directories(lastParent, ec);
+                if (ec) {
+                    result.error = ErrorText(L"Failed to create folder ", lastParent.u8string(), ec);
+                    return false;
+                }
+            }
+            if (type == '1') {
+                std::vector<std::string> linkParts;
+                fs::path existing;
+                if (SplitEntryName(linkName, false, linkParts)) {
+                    existing = placer.Locate(linkParts);
+                }
+                if (existing.empty()) {
+                    result.error = L"Hard link points outside the archive: " + Widen(name);
+                    return false;
+                }
+                fs::remove(target, ec);
+                fs::create_hard_link(existing, target, ec);
+                if (ec) {
+                    result.error = ErrorText(L"Failed to create link ", target.u8string(), ec);
+                    return false;
+                }
+                result.links++;
+            } else {
+                OutputFile out;
+                if (!out.Create(target, mode, ec)) {
+                    result.error = ErrorText(L"Failed to create ", target.u8string(), ec);
+                    return false;
+                }
+                for (uint64_t remaining = size; remaining > 0;) {
+                    const char* data;
+                    size_t got = input.Next(data, remaining);
+                    if (got == 0) {
+                        return truncated();
+                    }
+                    if (!out.Write(data, got, ec)) {
+                        result.error = ErrorText(L"Failed to write ", target.u8string(), ec);
+                        return false;
+                    }
+                    remaining -= got;
+                }
+                if (!out.Finish(mtime, ec)) {
+                    result.error = ErrorText(L"Failed to write ", target.u8string(), ec);
+                    return false;
+                }
+                result.files++;
+                result.bytes += size;
+                size = 0;
+            }
+        }
+        if (!input.Skip(size + padding)) {
+            return truncated();
+        }
+    }
+
+    if (!CreateDeferredLinks(placer, links, result.error)) {
+        return false;
+    }
+    SetFolderTimes(placer, folderTimes);
+    return true;
+}
+
+ArchiveFormat DetectArchiveFormat(const fs::path& archive) {
+    ArchiveFile file;
+    std::error_code ec;
+    char header[TAR_BLOCK];
+    size_t done = 0;
+    if (!file.Open(archive, ec) || !file.ReadAt(0, header, sizeof(header), done, ec) || done < 4) {
+        return ArchiveFormat::Unknown;
+    }
+    if (std::memcmp(header, "PK\x03\x04", 4) == 0 || std::memcmp(header, "PK\x05\x06", 4) == 0) {
+        return ArchiveFormat::Zip;
+    }
+    if (static_cast<unsigned char>(header[0]) == 0x1f && static_cast<unsigned char>(header[1]) == 0x8b) {
+        return ArchiveFormat::TarGzip;
+    }
+    if (done == sizeof(header) && TarChecksumOk(header)) {
+        return ArchiveFormat::Tar;
+    }
+    return ArchiveFormat::Unknown;
+}
+
+// "name" for name.zip, name.tar and name.tar.gz
+static std::string ArchiveName(const fs::path& archive) {
+    fs::path stem = archive.stem();
+    if (stem.extension() == ".tar") {
+        stem = stem.stem();
+    }
+    return stem.empty() ? std::string("archive") : stem.u8string();
+}
+
+bool ExtractArchive(const fs::path& archive, const fs::path& destination, int workers, ArchiveResult& result) {
+    TraceSpan span("archive", "extract", archive);
+    result = ArchiveResult();
+    result.destination = destination;
+
+    ArchiveFormat format = DetectArchiveFormat(archive);
+    if (format == ArchiveFormat::Unknown) {
+        result.error = L"Not a zip or tar archive";
+        return false;
+    }
+#ifndef HAVE_ZLIB
+    if (format == ArchiveFormat::TarGzip) {
+        result.error = L"Gzip-compressed archives need a build with zlib";
+        return false;
+    }
+#endif
+
+    ArchiveFile file;
+    EntryPlacer placer(destination, ArchiveName(archive));
+    std::error_code ec;
+    if (!file.Open(archive, ec)) {
+        result.error = ErrorText(L"Failed to open archive", "", ec);
+        return false;
+    }
+    if (!placer.Load(ec)) {
+        result.error = ErrorText(L"Failed to read folder ", destination.u8string(), ec);
+        return false;
+    }
+
+    bool ok;
+    if (format == ArchiveFormat::Zip) {
+        ok = ExtractZip(file, placer, workers, result);
+    } else {
+        StreamReader input(file, format == ArchiveFormat::TarGzip);
+        ok = ExtractTar(input, placer, result);
+    }
+    result.destination = placer.Base();
+    result.stripped = placer.Stripped();
+    return ok;
+}
+
+FolderProcessResult ExtractArchives(const std::vector<std::wstring>& archivePaths, const UnfoldOptions& options) {
+    FolderProcessResult result = { 0, 0, L"" };
+    if (!options.traceDirectory.empty()) {
+        StartTrace();
+    }
+    for (const auto& path : archivePaths) {
+        std::error_code ec;
+        fs::path archive = fs::absolute(path, ec);
+        ArchiveResult extracted;
+        if (!ec && ExtractArchive(archive, archive.parent_path(), options.workers, extracted)) {
+            result.successCount++;
+            continue;
+        }
+        result.errorMessages += fs::path(path).wstring() + L"\n";
+        result.errorMessages += L"  Reason: " + (ec ? fs::path(ec.message()).wstring() : extracted.error) + L"\n\n";
+        result.failureCount++;
+    }
+    if (!options.traceDirectory.empty()) {
+        FlushTrace(options.traceDirectory);
+    }
+    return result;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "unfold.h"
+
+namespace fs = std::filesystem;
+
+// Archive formats ExtractArchive reads, told apart by their first bytes
+enum class ArchiveFormat {
+    Unknown,
+    Zip,      // stored entries always; deflated ones need zlib
+    Tar,      // ustar, GNU long names and pax headers
+    TarGzip   // needs zlib
+};
+
+ArchiveFormat DetectArchiveFormat(const fs::path& archive);
+
+// What one extraction wrote
+struct ArchiveResult {
+    fs::path destination;    // folder the entries went into
+    bool stripped = false;   // the archive's single top-level folder was dropped
+    size_t files = 0;
+    size_t folders = 0;
+    size_t links = 0;
+    uint64_t bytes = 0;      // file data written
+    std::wstring error;      // why extraction stopped; empty on success
+};
+
+// Extract-and-unfold: write every entry of archive straight to its final path
+// under destination, with the top-level folder stripped when all entries share
+// one. Nothing in destination is replaced: if an entry would land on a name that
+// was already there, or turns out to lie outside the shared folder, what has been
+// written moves into a fresh folder (named after that folder, or the archive) and
+// the rest follows it. Zip entries are inflated in parallel on workers threads
+// (0 = one per core); tar streams are read ahead, and inflated, on their own
+// thread. Entries that would land outside destination are refused, and so is a
+// symbolic link whose name an extracted file or folder already has.
+bool ExtractArchive(const fs::path& archive, const fs::path& destination, int workers, ArchiveResult& result);
+
+// Extract each archive into the folder that holds it, counting every archive
+// like a selected folder
+FolderProcessResult ExtractArchives(const std::vector<std::wstring>& archivePaths, const UnfoldOptions& options);
@@ -0,0 +1,271 @@
+#include "compare.h"
+#include "metadata.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#define COMPARE_SPLIT_BYTES (1 << 20)     // files this large are split between threads
+#define COMPARE_CHUNK_BYTES (4 << 20)     // one thread's share of a split file, and the most read past a difference
+#define COMPARE_READ_BYTES (256 << 10)    // buffer per side for smaller files
+#define COMPARE_OPEN_PAIRS 32             // split pairs held open at once
+
+// Run work(i) for every i below count on up to one thread per core, the caller included
+static void ParallelFor(size_t count, const std::function<void(size_t)>& work) {
+    size_t threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+    if (threads > count) {
+        threads = count;
+    }
+    std::atomic<size_t> next(0);
+    auto run = [&] {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            work(i);
+        }
+    };
+    std::vector<std::thread> helpers;
+    for (size_t t = 1; t < threads; t++) {
+        helpers.emplace_back(run);
+    }
+    run();
+    for (auto& helper : helpers) {
+        helper.join();
+    }
+}
+
+// One side of a comparison: a regular file, read in order or at given offsets.
+// Files are read rather than mapped, so one truncated mid-compare fails a read
+// instead of faulting.
+class CompareFile {
+public:
+    CompareFile() = default;
+    CompareFile(const CompareFile&) = delete;
+    CompareFile& operator=(const CompareFile&) = delete;
+
+    ~CompareFile() {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+#else
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    // Fails for anything but a regular file, so a symlink swapped in is not followed
+    bool Open(const fs::path& path) {
+#ifdef _WIN32
+        handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                             OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        BY_HANDLE_FILE_INFORMATION info;
+        if (handle == INVALID_HANDLE_VALUE || !GetFileInformationByHandle(handle, &info) ||
+            (info.dwFileAttributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_REPARSE_POINT))) {
+            return false;
+        }
+        size = static_cast<uint64_t>(info.nFileSizeHigh) << 32 | info.nFileSizeLow;
+        device = info.dwVolumeSerialNumber;
+        identity = static_cast<uint64_t>(info.nFileIndexHigh) << 32 | info.nFileIndexLow;
+#else
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        size = static_cast<uint64_t>(st.st_size);
+        device = static_cast<uint64_t>(st.st_dev);
+        identity = static_cast<uint64_t>(st.st_ino);
+#endif
+        return true;
+    }
+
+    uint64_t Size() const { return size; }
+
+    // Hard links to one file need no reading
+    bool SameFile(const CompareFile& other) const { return device == other.device && identity == other.identity; }
+
+    // Fill buffer with the next length bytes; false on an error or a file that shrank
+    bool Read(char* buffer, size_t length) {
+        while (length > 0) {
+#ifdef _WIN32
+            DWORD got = 0;
+            if (!ReadFile(handle, buffer, static_cast<DWORD>(length), &got, NULL)) {
+                return false;
+            }
+#else
+            ssize_t got = read(fd, buffer, length);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0) {
+                return false;
+            }
+#endif
+            if (got == 0) {
+                return false;
+            }
+            buffer += got;
+            length -= static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+    // Fill buffer with length bytes from offset, leaving the read position alone,
+    // so threads can share one file; false on an error or a file that shrank
+    bool ReadAt(uint64_t offset, char* buffer, size_t length) {
+        while (length > 0) {
+#ifdef _WIN32
+            OVERLAPPED at = {};
+            at.Offset = static_cast<DWORD>(offset);
+            at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD got = 0;
+            if (!ReadFile(handle, buffer, static_cast<DWORD>(length), &got, &at)) {
+                return false;
+            }
+#else
+            ssize_t got = pread(fd, buffer, length, static_cast<off_t>(offset));
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0) {
+                return false;
+            }
+#endif
+            if (got == 0) {
+                return false;
+            }
+            buffer += got;
+            offset += static_cast<uint64_t>(got);
+            length -= static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    uint64_t size = 0;
+    uint64_t device = 0;
+    uint64_t identity = 0;
+};
+
+// A pair too small to split, compared through one buffer per side
+static bool SmallFilesIdentical(const MoveItem& item) {
+    thread_local std::unique_ptr<char[]> buffers(new char[2 * COMPARE_READ_BYTES]);
+    CompareFile a, b;
+    if (!a.Open(item.from) || !b.Open(item.to) || a.Size() != b.Size()) {
+        return false;
+    }
+    if (a.SameFile(b)) {
+        return true;
+    }
+    for (uint64_t remaining = a.Size(); remaining > 0;) {
+        size_t length = remaining < COMPARE_READ_BYTES ? static_cast<size_t>(remaining) : COMPARE_READ_BYTES;
+        char* left = buffers.get();
+        char* right = left + COMPARE_READ_BYTES;
+        if (!a.Read(left, length) || !b.Read(right, length) || std::memcmp(left, right, length) != 0) {
+            return false;
+        }
+        remaining -= length;
+    }
+    return true;
+}
+
+// A pair of large files whose chunks are spread over the threads
+struct SplitPair {
+    size_t item;
+    CompareFile a;
+    CompareFile b;
+    bool ready = false;       // both open, sizes equal, not one file
+    bool sameFile = false;
+    std::atomic<bool> differs{ false };
+};
+
+void CompareFiles(const std::vector<const MoveItem*>& items, std::vector<bool>& identical) {
+    TraceSpan span("fs", "compare files");
+    identical.assign(items.size(), false);
+
+    // One lstat per side: a size that differs needs no reading
+    std::vector<size_t> small;
+    std::vector<size_t> large;
+    for (size_t i = 0; i < items.size(); i++) {
+        std::error_code ec;
+        PathInfo source, target;
+        if (!StatPath(items[i]->from, false, source, ec) || !StatPath(items[i]->to, false, target, ec) ||
+            source.type != EntryType::File || target.type != EntryType::File || source.size != target.size) {
+            continue;
+        }
+        (source.size < COMPARE_SPLIT_BYTES ? small : large).push_back(i);
+    }
+
+    // Written from several threads, so not packed into bits
+    std::unique_ptr<bool[]> same(new bool[items.size()]());
+    ParallelFor(small.size(), [&](size_t k) {
+        same[small[k]] = SmallFilesIdentical(*items[small[k]]);
+    });
+
+    struct Chunk {
+        SplitPair* pair;
+        uint64_t offset;
+        size_t length;
+    };
+    for (size_t first = 0; first < large.size(); first += COMPARE_OPEN_PAIRS) {
+        size_t count = large.size() - first < COMPARE_OPEN_PAIRS ? large.size() - first : COMPARE_OPEN_PAIRS;
+        std::unique_ptr<SplitPair[]> pairs(new SplitPair[count]);
+        std::vector<Chunk> chunks;
+        for (size_t k = 0; k < count; k++) {
+            SplitPair& pair = pairs[k];
+            pair.item = large[first + k];
+            if (!pair.a.Open(items[pair.item]->from) || !pair.b.Open(items[pair.item]->to) ||
+                pair.a.Size() != pair.b.Size()) {
+                continue;
+            }
+            pair.sameFile = pair.a.SameFile(pair.b);
+            if (pair.sameFile) {
+                continue;
+            }
+            pair.ready = true;
+            for (uint64_t offset = 0; offset < pair.a.Size(); offset += COMPARE_CHUNK_BYTES) {
+                uint64_t left = pair.a.Size() - offset;
+                chunks.push_back({ &pair, offset, left < COMPARE_CHUNK_BYTES ? static_cast<size_t>(left) : COMPARE_CHUNK_BYTES });
+            }
+        }
+        // Chunks of one pair are claimed in order, so a difference near the start
+        // stops the threads still to reach the rest
+        ParallelFor(chunks.size(), [&](size_t c) {
+            thread_local std::unique_ptr<char[]> buffers(new char[2 * COMPARE_CHUNK_BYTES]);
+            const Chunk& chunk = chunks[c];
+            SplitPair& pair = *chunk.pair;
+            if (pair.differs.load(std::memory_order_relaxed)) {
+                return;
+            }
+            char* left = buffers.get();
+            char* right = left + COMPARE_CHUNK_BYTES;
+            if (!pair.a.ReadAt(chunk.offset, left, chunk.length) || !pair.b.ReadAt(chunk.offset, right, chunk.length) ||
+                std::memcmp(left, right, chunk.length) != 0) {
+                pair.differs.store(true, std::memory_order_relaxed);
+            }
+        });
+        for (size_t k = 0; k < count; k++) {
+            same[pairs[k].item] = pairs[k].sameFile || (pairs[k].ready && !pairs[k].differs.load());
+        }
+    }
+
+    for (size_t i = 0; i < items.size(); i++) {
+        identical[i] = same[i];
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <vector>
+
+#include "move_engine.h"
+
+// identical[i] is set when items[i].from and items[i].to are regular files
+// holding the same bytes. Sizes rule most pairs out without reading anything;
+// the rest are compared chunk by chunk on every core, large files read at
+// offsets and split between threads, and a pair stops at its first differing chunk.
+void CompareFiles(const std::vector<const MoveItem*>& items, std::vector<bool>& identical);
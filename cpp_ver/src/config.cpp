@@ -0,0 +1,123 @@
+#include "config.h"
+#include "io_ring.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+fs::path ConfigPath() {
+#ifdef _WIN32
+    wchar_t exePath[MAX_PATH];
+    GetModuleFileNameW(NULL, exePath, MAX_PATH);
+    return fs::path(exePath).remove_filename() / "config.ini";
+#else
+    std::error_code ec;
+    fs::path exePath = fs::read_symlink("/proc/self/exe", ec);
+    if (ec) {
+        return "config.ini";
+    }
+    return exePath.remove_filename() / "config.ini";
+#endif
+}
+
+#ifndef _WIN32
+fs::path RuntimeFile(const std::string& suffix) {
+    const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime != nullptr && *runtime != '\0') {
+        return fs::path(runtime) / ("unfolder" + suffix);
+    }
+    return "/tmp/unfolder-" + std::to_string(getuid()) + suffix;
+}
+#endif
+
+// Find a key and leave the stream positioned at its value
+static bool FindConfigKey(std::wifstream& configFile, const std::wstring& key, std::wistringstream& lineStream) {
+    std::wstring line;
+    while (std::getline(configFile, line)) {
+        lineStream.clear();
+        lineStream.str(line);
+        std::wstring currentKey;
+        if (std::getline(lineStream, currentKey, L'=') && currentKey == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ReadConfig(const fs::path& configPath, const std::wstring& key) {
+    return ReadConfigInt(configPath, key, 0) != 0;
+}
+
+int ReadConfigInt(const fs::path& configPath, const std::wstring& key, int defaultValue) {
+    std::wifstream configFile(configPath);
+    std::wistringstream lineStream;
+    while (FindConfigKey(configFile, key, lineStream)) {
+        int value;
+        if (lineStream >> value) {
+            return value;
+        }
+    }
+    return defaultValue;
+}
+
+std::wstring ReadConfigString(const fs::path& configPath, const std::wstring& key, const std::wstring& defaultValue) {
+    std::wifstream configFile(configPath);
+    std::wistringstream lineStream;
+    if (!FindConfigKey(configFile, key, lineStream)) {
+        return defaultValue;
+    }
+
+    std::wstring value;
+    std::getline(lineStream, value);
+    size_t first = value.find_first_not_of(L" \t\r");
+    size_t last = value.find_last_not_of(L" \t\r");
+    return first == std::wstring::npos ? std::wstring() : value.substr(first, last - first + 1);
+}
+
+UnfoldOptions ReadUnfoldOptions(const fs::path& configPath) {
+    UnfoldOptions options;
+    options.depth = ReadConfigInt(configPath, L"Depth", 1);
+    options.workers = ReadConfigInt(configPath, L"Workers", 0);
+    ParseConflictPolicy(ReadConfigString(configPath, L"ConflictPolicy", L"ask"), options.conflictPolicy);
+    options.swapParent = ReadConfigInt(configPath, L"SwapParent", 0) != 0;
+    int ringDepth = ReadConfigInt(configPath, L"IoUringDepth", 0);
+    if (ringDepth > 0) {
+        options.ioRingDepth = static_cast<unsigned>(ringDepth < IO_RING_MAX_DEPTH ? ringDepth : IO_RING_MAX_DEPTH);
+    }
+    if (ReadConfigInt(configPath, L"Journal", 1) != 0) {
+        std::wstring directory = ReadConfigString(configPath, L"JournalDir", L"");
+        options.journalDirectory = directory.empty() ? DefaultJournalDirectory() : fs::path(directory);
+    }
+    const char* traceDirectory = std::getenv("UNFOLDER_TRACE");
+    if (traceDirectory != nullptr && *traceDirectory != '\0') {
+        options.traceDirectory = traceDirectory;
+    } else {
+        options.traceDirectory = ReadConfigString(configPath, L"TraceDir", L"");
+    }
+    return options;
+}
+
+RecoveryMode ReadRecoveryMode(const fs::path& configPath) {
+    return ReadConfigString(configPath, L"JournalRecovery", L"replay") == L"rollback" ? RecoveryMode::Rollback : RecoveryMode::Replay;
+}
+
+fs::path ReadTimingLog(const fs::path& configPath) {
+    const char* environment = std::getenv("UNFOLDER_TIMING");
+    bool enabled = environment != nullptr && *environment != '\0' && std::strcmp(environment, "0") != 0;
+    if (!enabled && !ReadConfig(configPath, L"Timing")) {
+        return fs::path();
+    }
+    std::wstring log = ReadConfigString(configPath, L"TimingLog", L"");
+    return log.empty() ? DefaultJournalDirectory().parent_path() / "timing.log" : fs::path(log);
+}
+
+fs::path ReadMetricsFile(const fs::path& configPath) {
+    return ReadConfigString(configPath, L"MetricsFile", L"");
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+#include "journal.h"
+#include "unfold.h"
+
+namespace fs = std::filesystem;
+
+// config.ini next to the executable
+fs::path ConfigPath();
+
+#ifndef _WIN32
+// Per-user file for locks and sockets: $XDG_RUNTIME_DIR/unfolder<suffix>,
+// or /tmp/unfolder-<uid><suffix> without a runtime directory
+fs::path RuntimeFile(const std::string& suffix);
+#endif
+
+// Read config file
+bool ReadConfig(const fs::path& configPath, const std::wstring& key);
+
+// Read an integer key, or defaultValue when it is missing
+int ReadConfigInt(const fs::path& configPath, const std::wstring& key, int defaultValue);
+
+// Read a text key with surrounding whitespace trimmed, or defaultValue when it is missing
+std::wstring ReadConfigString(const fs::path& configPath, const std::wstring& key, const std::wstring& defaultValue);
+
+// Unfold settings from config.ini. UNFOLDER_TRACE in the environment overrides TraceDir.
+UnfoldOptions ReadUnfoldOptions(const fs::path& configPath);
+
+// Where per-run phase timings are appended, or empty when timing is off.
+// Timing=1 or UNFOLDER_TIMING=1 in the environment switches it on; TimingLog
+// overrides the default timing.log beside the journal directory.
+fs::path ReadTimingLog(const fs::path& configPath);
+
+// Prometheus text file the counters are merged into after every run
+// (MetricsFile), or empty to keep them in memory
+fs::path ReadMetricsFile(const fs::path& configPath);
+
+// How leftover journals are recovered (JournalRecovery=replay|rollback)
+RecoveryMode ReadRecoveryMode(const fs::path& configPath);
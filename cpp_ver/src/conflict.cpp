@@ -0,0 +1,184 @@
+#include "conflict.h"
+#include "directory_reader.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <chrono>
+#include <string>
+
+// Parents whose names the daemon keeps between jobs
+#define NAME_CACHE_LIMIT 256
+// Seconds a parent must have been unchanged before its names are kept: coarse
+// timestamps (FAT keeps 2 s) hide changes made in the same tick
+#define NAME_CACHE_SETTLE 2
+
+bool ParseConflictPolicy(const std::wstring& text, ConflictPolicy& policy) {
+    static const struct {
+        const wchar_t* name;
+        ConflictPolicy policy;
+    } names[] = {
+        { L"ask", ConflictPolicy::Ask },
+        { L"skip", ConflictPolicy::Skip },
+        { L"overwrite", ConflictPolicy::Overwrite },
+        { L"keep-newer", ConflictPolicy::KeepNewer },
+        { L"keep-larger", ConflictPolicy::KeepLarger },
+        { L"rename", ConflictPolicy::RenameSuffix },
+        { L"prefix", ConflictPolicy::RenamePrefix },
+        { L"merge", ConflictPolicy::Merge },
+        { L"drop-identical", ConflictPolicy::DropIdentical },
+    };
+    for (const auto& entry : names) {
+        if (text == entry.name) {
+            policy = entry.policy;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Key under which a name is stored: Windows names are case-insensitive
+static fs::path::string_type NameKey(NameView name) {
+    fs::path::string_type key(name);
+#ifdef _WIN32
+    if (!key.empty()) {
+        CharUpperBuffW(&key[0], static_cast<DWORD>(key.size()));
+    }
+#endif
+    return key;
+}
+
+static fs::path::string_type NameKey(const fs::path& name) {
+    return NameKey(NameView(name.native()));
+}
+
+bool SameName(const fs::path& a, const fs::path& b) {
+    return NameKey(a) == NameKey(b);
+}
+
+bool NameIndex::Load(const fs::path& folder, std::error_code& ec) {
+    TraceSpan span("fs", "scan parent", folder);
+    auto start = std::chrono::steady_clock::now();
+    names.clear();
+    DirectoryReader reader(ThreadDirectoryBuffer(), DIRECTORY_BUFFER_SIZE);
+    DirectoryEntry entry;
+    if (reader.Open(folder, ec)) {
+        while (reader.Next(entry, ec)) {
+            names.insert(NameKey(entry.name));
+        }
+    }
+    Metrics().Latency(Operation::Scan, std::chrono::steady_clock::now() - start);
+    return !ec;
+}
+
+bool NameIndex::Contains(const fs::path& name) const {
+    return names.count(NameKey(name)) != 0;
+}
+
+void NameIndex::Insert(const fs::path& name) {
+    names.insert(NameKey(name));
+}
+
+void NameIndex::Erase(const fs::path& name) {
+    names.erase(NameKey(name));
+}
+
+bool NameIndexCache::Take(const fs::path& parent, NameIndex& names) {
+    std::error_code ec;
+    fs::file_time_type stamp = fs::last_write_time(parent, ec);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(parent);
+    if (it == entries.end()) {
+        return false;
+    }
+    bool fresh = !ec && it->second.first == stamp;
+    if (fresh) {
+        names = std::move(it->second.second);
+    }
+    entries.erase(it);
+    return fresh;
+}
+
+void NameIndexCache::Put(const fs::path& parent, NameIndex&& names) {
+    std::error_code ec;
+    fs::file_time_type stamp = fs::last_write_time(parent, ec);
+    if (ec || fs::file_time_type::clock::now() - stamp < std::chrono::seconds(NAME_CACHE_SETTLE)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.size() >= NAME_CACHE_LIMIT) {
+        entries.clear();
+    }
+    entries[parent] = { stamp, std::move(names) };
+}
+
+// First "name (n).ext" that is not in the index; folders keep their whole name as the stem
+static fs::path FreeName(const fs::path& name, bool isFolder, const NameIndex& index) {
+    fs::path stem = isFolder ? name : name.stem();
+    fs::path extension = isFolder ? fs::path() : name.extension();
+    for (int n = 2;; n++) {
+        fs::path candidate = stem;
+        candidate += " (" + std::to_string(n) + ")";
+        candidate += extension;
+        if (!index.Contains(candidate)) {
+            return candidate;
+        }
+    }
+}
+
+Resolution ResolveConflict(ConflictPolicy policy, MoveItem& item, const fs::path& prefix, const NameIndex& index) {
+    // One lstat per side answers every policy
+    std::error_code sourceEc, targetEc;
+    PathInfo source, target;
+    StatPath(item.from, false, source, sourceEc);
+    StatPath(item.to, false, target, targetEc);
+    bool bothFiles = source.type == EntryType::File && target.type == EntryType::File;
+
+    switch (policy) {
+    case ConflictPolicy::Ask:
+        return Resolution::Ask;
+    case ConflictPolicy::Skip:
+        return Resolution::Skip;
+    case ConflictPolicy::Overwrite:
+        return Resolution::Replace;
+    case ConflictPolicy::KeepNewer:
+        // Only files are compared; a folder's time says little about its contents
+        return bothFiles && source.modified > target.modified ? Resolution::Replace : Resolution::Skip;
+    case ConflictPolicy::KeepLarger:
+        return bothFiles && source.size > target.size ? Resolution::Replace : Resolution::Skip;
+    case ConflictPolicy::RenameSuffix: {
+        fs::path name = FreeName(item.to.filename(), source.IsDirectory(), index);
+        item.to.replace_filename(name);
+        return Resolution::Move;
+    }
+    case ConflictPolicy::RenamePrefix: {
+        fs::path name = prefix;
+        name += "_";
+        name += item.to.filename();
+        if (index.Contains(name)) {
+            name = FreeName(name, source.IsDirectory(), index);
+        }
+        item.to.replace_filename(name);
+        return Resolution::Move;
+    }
+    case ConflictPolicy::Merge: {
+        // A name planned by an earlier selection has no entry yet; its folder
+        // is checked again when the merge runs
+        if (source.IsDirectory() && (target.IsDirectory() || !target.Exists())) {
+            return Resolution::Merge;
+        }
+        fs::path name = FreeName(item.to.filename(), source.IsDirectory(), index);
+        item.to.replace_filename(name);
+        return Resolution::Move;
+    }
+    case ConflictPolicy::DropIdentical:
+        // Sizes settle most pairs; the bytes are compared when the move runs. A
+        // modification time says nothing either way about copies made separately.
+        return bothFiles && source.size == target.size ? Resolution::Drop : Resolution::Ask;
+    }
+    return Resolution::Ask;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "move_engine.h"
+
+// What to do when an entry's name is already taken in the destination
+enum class ConflictPolicy {
+    Ask,           // leave it to the slow path (the shell dialog on Windows)
+    Skip,          // keep the entry where it is
+    Overwrite,     // replace the destination
+    KeepNewer,     // replace the destination file if the entry is newer, else skip
+    KeepLarger,    // replace the destination file if the entry is larger, else skip
+    RenameSuffix,  // move as "name (2).ext"
+    RenamePrefix,  // move as "<folder>_name"
+    Merge,         // fuse a folder into the folder of the same name; files move as "name (2).ext"
+    DropIdentical  // delete the entry when it is a byte-identical copy of the file it collides with, else ask
+};
+
+// Parse a ConflictPolicy value from config.ini
+bool ParseConflictPolicy(const std::wstring& text, ConflictPolicy& policy);
+
+// Names present in a destination folder, compared the way its filesystem compares
+// them. Built with one scan so every conflict is found by a hash lookup.
+class NameIndex {
+public:
+    bool Load(const fs::path& folder, std::error_code& ec);
+    bool Contains(const fs::path& name) const;
+    void Insert(const fs::path& name);
+    void Erase(const fs::path& name);
+
+private:
+    std::unordered_set<fs::path::string_type> names;
+};
+
+// True when a and b name the same entry of one folder on this filesystem
+bool SameName(const fs::path& a, const fs::path& b);
+
+// Name indexes a long-running process keeps between jobs, so a parent is not
+// rescanned while its modification time is unchanged. An index can still be
+// stale when the time does not move, and then the policy acts on a wrong view:
+// a name seen free fails its no-replace rename and goes to the slow path, and
+// one seen taken is resolved against whatever entry is there. Replacements
+// delete a destination only when their rename is what succeeds, or to make
+// room for a cross-device copy. Parents changed in the last two seconds
+// are not kept.
+class NameIndexCache {
+public:
+    // Move the index of parent into names if the parent has not changed since Put
+    bool Take(const fs::path& parent, NameIndex& names);
+
+    // Keep names for parent, stamped with its current modification time
+    void Put(const fs::path& parent, NameIndex&& names);
+
+private:
+    std::mutex mutex;
+    std::map<fs::path, std::pair<fs::file_time_type, NameIndex>> entries;
+};
+
+// How a conflicting entry is moved
+enum class Resolution {
+    Ask,      // hand it to the slow path unchanged
+    Skip,     // leave it at its source
+    Replace,  // remove the destination first
+    Move,     // move to item.to, which now names a free entry
+    Merge,    // fuse the folder into the existing folder item.to
+    Drop      // delete the source if its bytes still match item.to when it runs, else ask
+};
+
+// Decide what happens to an entry whose name is taken. prefix is the name of
+// the folder being unfolded.
+Resolution ResolveConflict(ConflictPolicy policy, MoveItem& item, const fs::path& prefix, const NameIndex& index);
@@ -0,0 +1,478 @@
+#include "daemon.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <memory>
+
+#include "config.h"
+#include "job.h"
+#include "metrics.h"
+#include "thread_pool.h"
+#include "timing.h"
+#include "trace.h"
+
+// A job message is "UNF1", the body size, then the body: a path count and
+// every path as a length-prefixed UTF-8 string. The daemon answers one byte.
+// "MTRC" with an empty body asks for the metrics, answered size-prefixed.
+#define DAEMON_MAGIC "UNF1"
+#define DAEMON_METRICS "MTRC"
+#define DAEMON_HEADER_SIZE 8
+#define DAEMON_MAX_BODY (64 << 20)
+#define DAEMON_ACK 'A'
+#define DAEMON_CLIENT_TIMEOUT 5000   // ms a client waits for the daemon
+#define DAEMON_READ_TIMEOUT 2000     // ms the daemon waits for a connected client's job
+#define DAEMON_PIPE_BUFFER 65536
+
+static void AppendU32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static bool ReadU32(const std::string& in, size_t& offset, uint32_t& value) {
+    if (in.size() - offset < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, in.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+// Paths are made absolute here, since the daemon runs in a directory of its own
+static std::string EncodeJob(const std::vector<std::wstring>& paths) {
+    std::string body;
+    AppendU32(body, static_cast<uint32_t>(paths.size()));
+    for (const auto& path : paths) {
+        std::string utf8 = fs::path(AbsolutePath(path)).u8string();
+        AppendU32(body, static_cast<uint32_t>(utf8.size()));
+        body += utf8;
+    }
+    std::string message = DAEMON_MAGIC;
+    AppendU32(message, static_cast<uint32_t>(body.size()));
+    return message + body;
+}
+
+// Body size from a message header, or -1 when it is not a job
+static int64_t BodySize(const char* header) {
+    uint32_t size;
+    std::memcpy(&size, header + 4, sizeof(size));
+    if (std::memcmp(header, DAEMON_MAGIC, 4) != 0 || size > DAEMON_MAX_BODY) {
+        return -1;
+    }
+    return size;
+}
+
+static bool DecodeJob(const std::string& body, std::vector<std::wstring>& paths) {
+    size_t offset = 0;
+    uint32_t count;
+    if (!ReadU32(body, offset, count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t length;
+        if (!ReadU32(body, offset, length) || body.size() - offset < length) {
+            return false;
+        }
+        paths.push_back(fs::u8path(body.data() + offset, body.data() + offset + length).wstring());
+        offset += length;
+    }
+    return !paths.empty();
+}
+
+#ifdef _WIN32
+// One pipe per session, so users on a shared machine get their own daemon
+static std::wstring PipeName() {
+    DWORD session = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &session);
+    return L"\\\\.\\pipe\\UnfolderDaemon-" + std::to_wstring(session);
+}
+
+static HANDLE CreatePipeInstance(bool first) {
+    return CreateNamedPipeW(PipeName().c_str(), PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                            PIPE_UNLIMITED_INSTANCES, DAEMON_PIPE_BUFFER, DAEMON_PIPE_BUFFER, 0, NULL);
+}
+
+typedef HANDLE Connection;
+static const Connection NO_CONNECTION = INVALID_HANDLE_VALUE;
+
+// Client end of the pipe, waiting a while when every instance is busy
+static Connection ConnectClient() {
+    std::wstring name = PipeName();
+    HANDLE pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY
+        && WaitNamedPipeW(name.c_str(), DAEMON_CLIENT_TIMEOUT)) {
+        pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    }
+    return pipe;
+}
+
+static void CloseConnection(Connection connection) {
+    CloseHandle(connection);
+}
+
+static bool ReadAll(HANDLE handle, char* buffer, size_t size) {
+    while (size > 0) {
+        DWORD read = 0;
+        if (!ReadFile(handle, buffer, static_cast<DWORD>(size), &read, NULL) || read == 0) {
+            return false;
+        }
+        buffer += read;
+        size -= read;
+    }
+    return true;
+}
+
+static bool WriteAll(HANDLE handle, const char* buffer, size_t size) {
+    while (size > 0) {
+        DWORD written = 0;
+        if (!WriteFile(handle, buffer, static_cast<DWORD>(size), &written, NULL) || written == 0) {
+            return false;
+        }
+        buffer += written;
+        size -= written;
+    }
+    return true;
+}
+#else
+static bool ReadAll(int fd, char* buffer, size_t size) {
+    while (size > 0) {
+        ssize_t n = read(fd, buffer, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool WriteAll(int fd, const char* buffer, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, buffer, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool SocketAddress(const fs::path& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.native().size());
+    return true;
+}
+
+// Connected socket to the daemon, or -1
+static int ConnectDaemon(const fs::path& path) {
+    sockaddr_un address;
+    if (!SocketAddress(path, address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static void SetTimeouts(int fd, int milliseconds) {
+    timeval timeout = { milliseconds / 1000, (milliseconds % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+typedef int Connection;
+static const Connection NO_CONNECTION = -1;
+
+static Connection ConnectClient() {
+    int fd = ConnectDaemon(RuntimeFile(".sock"));
+    if (fd >= 0) {
+        SetTimeouts(fd, DAEMON_CLIENT_TIMEOUT);
+    }
+    return fd;
+}
+
+static void CloseConnection(Connection connection) {
+    close(connection);
+}
+#endif
+
+// Answer one request from a connected client. True when it was a job, which
+// is acknowledged and left in paths.
+template <typename Handle>
+static bool ServeClient(Handle client, std::vector<std::wstring>& paths) {
+    char header[DAEMON_HEADER_SIZE];
+    if (!ReadAll(client, header, sizeof(header))) {
+        return false;
+    }
+    if (std::memcmp(header, DAEMON_METRICS, 4) == 0) {
+        std::string text = MetricsToPrometheus();
+        std::string reply;
+        AppendU32(reply, static_cast<uint32_t>(text.size()));
+        reply += text;
+        WriteAll(client, reply.data(), reply.size());
+        return false;
+    }
+    int64_t size = BodySize(header);
+    if (size < 0) {
+        return false;
+    }
+    std::string body(static_cast<size_t>(size), '\0');
+    if (!ReadAll(client, &body[0], body.size()) || !DecodeJob(body, paths)) {
+        return false;
+    }
+    char ack = DAEMON_ACK;
+    return WriteAll(client, &ack, 1);
+}
+
+DaemonServer::~DaemonServer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+#ifdef _WIN32
+    if (acceptor.joinable()) {
+        // Wake the acceptor out of ConnectNamedPipe with a connection of our own
+        HANDLE wake = CreateFileW(PipeName().c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (wake != INVALID_HANDLE_VALUE) {
+            CloseHandle(wake);
+        }
+        acceptor.join();
+    }
+    if (firstPipe != nullptr) {
+        CloseHandle(firstPipe);
+    }
+#else
+    if (listener >= 0) {
+        shutdown(listener, SHUT_RDWR);
+    }
+    if (acceptor.joinable()) {
+        acceptor.join();
+    }
+    if (listener >= 0) {
+        close(listener);
+        unlink(socketPath.c_str());
+    }
+#endif
+}
+
+bool DaemonServer::Listen() {
+#ifdef _WIN32
+    HANDLE pipe = CreatePipeInstance(true);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return false; // another daemon owns the pipe name
+    }
+    firstPipe = pipe;
+#else
+    socketPath = RuntimeFile(".sock");
+    sockaddr_un address;
+    if (!SocketAddress(socketPath, address)) {
+        return false;
+    }
+
+    // A socket file nobody answers on is left over from a daemon that died
+    int probe = ConnectDaemon(socketPath);
+    if (probe >= 0) {
+        close(probe);
+        return false;
+    }
+    unlink(socketPath.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t mask = umask(0077);
+    bool bound = listener >= 0 && bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    umask(mask);
+    if (!bound || listen(listener, SOMAXCONN) != 0) {
+        if (listener >= 0) {
+            close(listener);
+            listener = -1;
+        }
+        return false;
+    }
+#endif
+    acceptor = std::thread(&DaemonServer::AcceptLoop, this);
+    return true;
+}
+
+void DaemonServer::AcceptLoop() {
+#ifdef _WIN32
+    HANDLE pipe = firstPipe;
+    firstPipe = nullptr;
+    for (;;) {
+        bool connected = ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                break;
+            }
+        }
+
+        // Have the next instance listening before serving this client
+        HANDLE next = CreatePipeInstance(false);
+        std::vector<std::wstring> paths;
+        TraceSpan span("ipc", "serve client");
+        bool queued = connected && ServeClient(pipe, paths);
+        if (connected) {
+            FlushFileBuffers(pipe); // the client reads the answer before we disconnect
+        }
+        if (queued) {
+            std::lock_guard<std::mutex> lock(mutex);
+            submissions.push_back(std::move(paths));
+            arrived.notify_one();
+        }
+        DisconnectNamedPipe(pipe);
+        CloseHandle(pipe);
+        if (next == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        pipe = next;
+    }
+    CloseHandle(pipe);
+#else
+    for (;;) {
+        int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return; // listener shut down
+        }
+
+        // A client that connects and goes quiet must not hold up the others
+        SetTimeouts(client, DAEMON_READ_TIMEOUT);
+        TraceSpan span("ipc", "serve client");
+        std::vector<std::wstring> paths;
+        if (ServeClient(client, paths)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            submissions.push_back(std::move(paths));
+            arrived.notify_one();
+        }
+        close(client);
+    }
+#endif
+}
+
+size_t DaemonServer::Receive(std::vector<std::wstring>& paths, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto ready = [this] { return !submissions.empty(); };
+    if (timeoutMs < 0) {
+        arrived.wait(lock, ready);
+    } else if (!arrived.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready)) {
+        return 0;
+    }
+
+    size_t taken = submissions.size();
+    for (auto& submission : submissions) {
+        paths.insert(paths.end(), submission.begin(), submission.end());
+    }
+    submissions.clear();
+    return taken;
+}
+
+bool SubmitToDaemon(const std::vector<std::wstring>& folderPaths) {
+    Connection daemon = ConnectClient();
+    if (daemon == NO_CONNECTION) {
+        return false; // no daemon running
+    }
+    std::string message = EncodeJob(folderPaths);
+    char ack = 0;
+    bool delivered = WriteAll(daemon, message.data(), message.size()) && ReadAll(daemon, &ack, 1);
+    CloseConnection(daemon);
+    return delivered && ack == DAEMON_ACK;
+}
+
+bool QueryDaemonMetrics(std::string& text) {
+    Connection daemon = ConnectClient();
+    if (daemon == NO_CONNECTION) {
+        return false;
+    }
+    std::string request = DAEMON_METRICS;
+    AppendU32(request, 0);
+    uint32_t size = 0;
+    bool answered = WriteAll(daemon, request.data(), request.size())
+                 && ReadAll(daemon, reinterpret_cast<char*>(&size), sizeof(size)) && size <= DAEMON_MAX_BODY;
+    if (answered) {
+        text.assign(size, '\0');
+        answered = size == 0 || ReadAll(daemon, &text[0], size);
+    }
+    CloseConnection(daemon);
+    return answered;
+}
+
+int ServeJobs(PathSource& source, const fs::path& configPath, const char* mode,
+              const std::function<void(const FolderProcessResult&)>& report) {
+    UnfoldOptions options = ReadUnfoldOptions(configPath);
+    std::error_code ec;
+    fs::file_time_type configStamp = fs::last_write_time(configPath, ec);
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(options.workers));
+    NameIndexCache names;
+
+    for (;;) {
+        std::vector<std::wstring> paths;
+        if (source.Receive(paths, -1) == 0) {
+            continue;
+        }
+
+        // Each job gets its own timing record, measured from its first submission
+        ResetPhaseTimes();
+        auto received = std::chrono::steady_clock::now();
+
+        // Pick up config.ini edits without a restart
+        fs::file_time_type stamp = fs::last_write_time(configPath, ec);
+        if (stamp != configStamp) {
+            PhaseTimer timer(Phase::Config);
+            configStamp = stamp;
+            int workers = options.workers;
+            options = ReadUnfoldOptions(configPath);
+            if (options.workers != workers) {
+                pool.reset(new ThreadPool(options.workers));
+            }
+        }
+
+        // Jobs run one at a time; folders that arrive meanwhile join the running job
+        UnfoldJob job(options, pool.get(), &names);
+        job.Add(paths);
+        AdmitPaths(source, job);
+        FolderProcessResult result = job.Finish();
+
+        fs::path log = ReadTimingLog(configPath);
+        if (!log.empty()) {
+            AddPhaseTime(Phase::Total, std::chrono::steady_clock::now() - received);
+            WriteTimingRecord(log, mode, job.FolderCount(), result);
+        }
+        fs::path metricsFile = ReadMetricsFile(configPath);
+        if (!metricsFile.empty()) {
+            WriteMetricsFile(metricsFile);
+        }
+        report(result);
+    }
+}
+
+int RunDaemon(const fs::path& configPath, const std::function<void(const FolderProcessResult&)>& report) {
+    DaemonServer server;
+    if (!server.Listen()) {
+        return 1;
+    }
+    return ServeJobs(server, configPath, "daemon", report);
+}
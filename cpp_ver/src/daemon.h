@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "path_ring.h"
+#include "unfold.h"
+
+namespace fs = std::filesystem;
+
+// Listening end of the daemon's job endpoint: a Unix domain socket, or a named
+// pipe on Windows. A background thread accepts clients, reads their folders and
+// acknowledges them at once, so a client never waits for a running job.
+class DaemonServer : public PathSource {
+public:
+    DaemonServer() = default;
+    ~DaemonServer();
+
+    DaemonServer(const DaemonServer&) = delete;
+    DaemonServer& operator=(const DaemonServer&) = delete;
+
+    // Claim the endpoint; false when another daemon holds it
+    bool Listen();
+
+    size_t Receive(std::vector<std::wstring>& paths, int timeoutMs) override;
+
+private:
+    void AcceptLoop();
+
+    std::thread acceptor;
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::deque<std::vector<std::wstring>> submissions;
+    bool stopping = false;
+#ifdef _WIN32
+    void* firstPipe = nullptr;
+#else
+    int listener = -1;
+    fs::path socketPath;
+#endif
+};
+
+// Hand folders to a running daemon, relative ones resolved against our working
+// directory. False when no daemon answers, in which case the caller unfolds
+// them itself.
+bool SubmitToDaemon(const std::vector<std::wstring>& folderPaths);
+
+// The running daemon's metrics in Prometheus text format; false when none answers
+bool QueryDaemonMetrics(std::string& text);
+
+// Unfold whatever source delivers until the process is killed. The worker pool,
+// config and the parents' name indexes stay warm between jobs; each job writes
+// a timing record under mode, and report runs after it.
+int ServeJobs(PathSource& source, const fs::path& configPath, const char* mode,
+              const std::function<void(const FolderProcessResult&)>& report);
+
+// Serve daemon clients with ServeJobs; 1 when another daemon holds the endpoint
+int RunDaemon(const fs::path& configPath, const std::function<void(const FolderProcessResult&)>& report);
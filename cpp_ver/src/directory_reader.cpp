@@ -0,0 +1,254 @@
+#include "directory_reader.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifdef __linux__
+// Record layout getdents64 fills the buffer with
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+
+DirectoryReader::DirectoryReader()
+    : owned(new uint64_t[DIRECTORY_BUFFER_SIZE / sizeof(uint64_t)]),
+      buffer(reinterpret_cast<unsigned char*>(owned.get())),
+      size(DIRECTORY_BUFFER_SIZE) {
+#ifdef _WIN32
+    handle = INVALID_HANDLE_VALUE;
+#endif
+}
+
+DirectoryReader::DirectoryReader(void* buffer, size_t size)
+    : buffer(static_cast<unsigned char*>(buffer)), size(size) {
+#ifdef _WIN32
+    handle = INVALID_HANDLE_VALUE;
+#endif
+}
+
+void* ThreadDirectoryBuffer() {
+    thread_local std::unique_ptr<uint64_t[]> buffer(new uint64_t[DIRECTORY_BUFFER_SIZE / sizeof(uint64_t)]);
+    return buffer.get();
+}
+
+DirectoryReader::~DirectoryReader() {
+    Close();
+}
+
+static bool IsDotOrDotDot(NameView name) {
+    return (name.size() == 1 && name[0] == '.') || (name.size() == 2 && name[0] == '.' && name[1] == '.');
+}
+
+#ifdef _WIN32
+bool DirectoryReader::Open(const fs::path& folder, std::error_code& ec) {
+    Close();
+    ec.clear();
+    handle = CreateFileW(folder.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                         NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        ec = std::error_code(static_cast<int>(GetLastError()), std::system_category());
+        return false;
+    }
+    restart = true;
+    return true;
+}
+
+void DirectoryReader::Close() {
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+    }
+    used = offset = 0;
+}
+
+bool DirectoryReader::Fill(std::error_code& ec) {
+    FILE_INFO_BY_HANDLE_CLASS query = restart ? FileIdBothDirectoryRestartInfo : FileIdBothDirectoryInfo;
+    restart = false;
+    used = offset = 0;
+    if (!GetFileInformationByHandleEx(handle, query, buffer, static_cast<DWORD>(size))) {
+        DWORD err = GetLastError();
+        if (err != ERROR_NO_MORE_FILES) {
+            ec = std::error_code(static_cast<int>(err), std::system_category());
+        }
+        return false;
+    }
+    used = size;
+    return true;
+}
+
+bool DirectoryReader::Next(DirectoryEntry& entry, std::error_code& ec) {
+    ec.clear();
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    for (;;) {
+        if (offset >= used && !Fill(ec)) {
+            return false;
+        }
+        const FILE_ID_BOTH_DIR_INFO* info = reinterpret_cast<const FILE_ID_BOTH_DIR_INFO*>(buffer + offset);
+        // A zero link ends the records of this fill
+        offset = info->NextEntryOffset != 0 ? offset + info->NextEntryOffset : used;
+
+        entry.name = NameView(info->FileName, info->FileNameLength / sizeof(wchar_t));
+        if (IsDotOrDotDot(entry.name)) {
+            continue;
+        }
+        if (info->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+            entry.type = EntryType::Symlink;
+        } else if (info->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            entry.type = EntryType::Directory;
+        } else {
+            entry.type = EntryType::File;
+        }
+        return true;
+    }
+}
+
+EntryType DirectoryReader::Resolve(const DirectoryEntry& entry) {
+    return entry.type;
+}
+#else
+static EntryType TypeOfMode(mode_t mode) {
+    if (S_ISREG(mode)) {
+        return EntryType::File;
+    }
+    if (S_ISDIR(mode)) {
+        return EntryType::Directory;
+    }
+    return S_ISLNK(mode) ? EntryType::Symlink : EntryType::Other;
+}
+
+static EntryType TypeOfDirent(unsigned char type) {
+    switch (type) {
+    case DT_REG:
+        return EntryType::File;
+    case DT_DIR:
+        return EntryType::Directory;
+    case DT_LNK:
+        return EntryType::Symlink;
+    case DT_UNKNOWN:
+        return EntryType::Unknown;
+    default:
+        return EntryType::Other;
+    }
+}
+
+bool DirectoryReader::Open(const fs::path& folder, std::error_code& ec) {
+    Close();
+    ec.clear();
+#ifdef __linux__
+    fd = open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#else
+    DIR* stream = opendir(folder.c_str());
+    dir = stream;
+    fd = stream != nullptr ? dirfd(stream) : -1;
+#endif
+    if (fd < 0) {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+    return true;
+}
+
+void DirectoryReader::Close() {
+#ifndef __linux__
+    if (dir != nullptr) {
+        closedir(static_cast<DIR*>(dir));
+        dir = nullptr;
+        fd = -1;
+    }
+#endif
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    used = offset = 0;
+}
+
+#ifdef __linux__
+bool DirectoryReader::Fill(std::error_code& ec) {
+    used = offset = 0;
+    long n = syscall(SYS_getdents64, fd, buffer, size);
+    if (n < 0) {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+    used = static_cast<size_t>(n);
+    return n > 0;
+}
+
+bool DirectoryReader::Next(DirectoryEntry& entry, std::error_code& ec) {
+    ec.clear();
+    if (fd < 0) {
+        return false;
+    }
+    for (;;) {
+        if (offset >= used && !Fill(ec)) {
+            return false;
+        }
+        const LinuxDirent64* record = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+        offset += record->d_reclen;
+
+        entry.name = NameView(record->d_name);
+        if (IsDotOrDotDot(entry.name)) {
+            continue;
+        }
+        entry.type = TypeOfDirent(record->d_type);
+        return true;
+    }
+}
+#else
+// No raw interface to call: readdir batches inside libc, and names point into
+// its buffer instead of ours
+bool DirectoryReader::Fill(std::error_code&) {
+    return false;
+}
+
+bool DirectoryReader::Next(DirectoryEntry& entry, std::error_code& ec) {
+    ec.clear();
+    if (dir == nullptr) {
+        return false;
+    }
+    for (;;) {
+        errno = 0;
+        struct dirent* record = readdir(static_cast<DIR*>(dir));
+        if (record == nullptr) {
+            if (errno != 0) {
+                ec = std::error_code(errno, std::generic_category());
+            }
+            return false;
+        }
+        entry.name = NameView(record->d_name);
+        if (!IsDotOrDotDot(entry.name)) {
+            entry.type = TypeOfDirent(record->d_type);
+            return true;
+        }
+    }
+}
+#endif
+
+EntryType DirectoryReader::Resolve(const DirectoryEntry& entry) {
+    if (entry.type != EntryType::Unknown) {
+        return entry.type;
+    }
+    struct stat st;
+    if (fstatat(fd, entry.name.data(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return EntryType::Unknown;
+    }
+    return TypeOfMode(st.st_mode);
+}
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+// Bytes of raw directory entries fetched per call by default
+#define DIRECTORY_BUFFER_SIZE (256 << 10)
+
+// Name of an entry as a view into the reader's buffer
+typedef std::basic_string_view<fs::path::value_type> NameView;
+
+enum class EntryType {
+    Unknown,    // the filesystem did not say; see DirectoryReader::Resolve
+    File,
+    Directory,
+    Symlink,    // reparse points on Windows
+    Other
+};
+
+struct DirectoryEntry {
+    NameView name;
+    EntryType type = EntryType::Unknown;
+};
+
+// Reads a folder's entries in bulk: getdents64 on Linux, and on Windows
+// GetFileInformationByHandleEx(FileIdBothDirectoryInfo), the documented face of
+// NtQueryDirectoryFile. Each call fills the whole buffer, types come with the
+// names, and nothing is allocated per entry. "." and ".." are skipped.
+class DirectoryReader {
+public:
+    // Reads through a buffer of its own
+    DirectoryReader();
+
+    // Reads through a caller's buffer, which must be 8-byte aligned and outlive the reader
+    DirectoryReader(void* buffer, size_t size);
+
+    ~DirectoryReader();
+
+    DirectoryReader(const DirectoryReader&) = delete;
+    DirectoryReader& operator=(const DirectoryReader&) = delete;
+
+    bool Open(const fs::path& folder, std::error_code& ec);
+    void Close();
+
+    // Next entry; false at the end or on error (ec). The name stays valid until
+    // the next call and, on POSIX, is NUL-terminated.
+    bool Next(DirectoryEntry& entry, std::error_code& ec);
+
+    // Type of an entry, looked up with lstat only when the filesystem left it Unknown
+    EntryType Resolve(const DirectoryEntry& entry);
+
+private:
+    bool Fill(std::error_code& ec);
+
+    std::unique_ptr<uint64_t[]> owned;
+    unsigned char* buffer;
+    size_t size;
+    size_t used = 0;      // bytes the last fill returned
+    size_t offset = 0;    // next record within them
+#ifdef _WIN32
+    void* handle;
+    bool restart = true;
+#else
+    int fd = -1;
+#ifndef __linux__
+    void* dir = nullptr;   // DIR* that owns fd
+#endif
+#endif
+};
+
+// DIRECTORY_BUFFER_SIZE bytes owned by the calling thread, for a reader that is
+// never nested inside another one using it
+void* ThreadDirectoryBuffer();
@@ -0,0 +1,262 @@
+#include "io_ring.h"
+
+#ifdef __linux__
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <memory>
+
+#ifdef __linux__
+static int SetupRing(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int EnterRing(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0));
+}
+
+static int RegisterRing(int fd, unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+static unsigned* RingField(void* ring, unsigned offset) {
+    return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+
+static int64_t Nanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Every opcode the engine submits, so a kernel that knows io_uring but not
+// these (before 5.15) falls back as a whole instead of op by op
+static bool SupportsOps(int fd) {
+    const unsigned needed[] = { IORING_OP_RENAMEAT, IORING_OP_UNLINKAT };
+    size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::unique_ptr<char[]> buffer(new char[size]());
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.get());
+    if (RegisterRing(fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        return false;
+    }
+    for (unsigned op : needed) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IoRing::Open(unsigned requested) {
+    Close();
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = SetupRing(requested, &params);
+    if (fd < 0) {
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        sqRingSize = cqRingSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+    }
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        Close();
+        return false;
+    }
+    cqRing = single ? sqRing
+                    : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        cqRing = cqRing == MAP_FAILED ? nullptr : cqRing;
+        sqes = sqes == MAP_FAILED ? nullptr : sqes;
+        Close();
+        return false;
+    }
+
+    sqHead = RingField(sqRing, params.sq_off.head);
+    sqTail = RingField(sqRing, params.sq_off.tail);
+    sqMask = *RingField(sqRing, params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqArray = RingField(sqRing, params.sq_off.array);
+    cqHead = RingField(cqRing, params.cq_off.head);
+    cqTail = RingField(cqRing, params.cq_off.tail);
+    cqMask = *RingField(cqRing, params.cq_off.ring_mask);
+    cqEntries = params.cq_entries;
+    cqes = static_cast<char*>(cqRing) + params.cq_off.cqes;
+
+    if (!SupportsOps(fd)) {
+        Close();
+        return false;
+    }
+    depth = requested;
+    return true;
+}
+
+void IoRing::Close() {
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != nullptr && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != nullptr) {
+        munmap(sqRing, sqRingSize);
+    }
+    sqRing = cqRing = sqes = nullptr;
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    depth = 0;
+}
+
+// Describe op in a submission entry; user_data carries its index
+static void PrepareEntry(io_uring_sqe& sqe, const RingOp& op, size_t index) {
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.fd = AT_FDCWD;
+    sqe.addr = reinterpret_cast<uint64_t>(op.path);
+    sqe.user_data = index;
+    sqe.flags = op.linked ? IOSQE_IO_LINK : 0;
+    switch (op.kind) {
+    case RingOp::Rename:
+        sqe.opcode = IORING_OP_RENAMEAT;
+        sqe.len = static_cast<uint32_t>(AT_FDCWD);
+        sqe.addr2 = reinterpret_cast<uint64_t>(op.target);
+        sqe.rename_flags = op.flags;
+        break;
+    case RingOp::Unlink:
+        sqe.opcode = IORING_OP_UNLINKAT;
+        sqe.unlink_flags = op.flags;
+        break;
+    }
+}
+
+bool IoRing::Run(std::vector<RingOp>& ops) {
+    // Completions overwrite this as they arrive
+    for (auto& op : ops) {
+        op.result = -ECANCELED;
+        op.nanos = 0;
+    }
+    if (fd < 0) {
+        return false;
+    }
+
+    // Completions are bounded by the CQ ring, which the kernel sizes from the SQ ring
+    size_t limit = sqEntries < cqEntries ? sqEntries : cqEntries;
+    size_t chain = 0;
+    for (const auto& op : ops) {
+        if (++chain > limit) {
+            return false;
+        }
+        chain = op.linked ? chain : 0;
+    }
+
+    size_t next = 0;       // first op not yet queued
+    size_t inFlight = 0;   // consumed by the kernel, not yet completed
+    std::vector<int64_t> submitted(ops.size());
+    io_uring_sqe* entries = static_cast<io_uring_sqe*>(sqes);
+    io_uring_cqe* completions = static_cast<io_uring_cqe*>(cqes);
+    unsigned tail = *sqTail;
+
+    while (next < ops.size() || inFlight > 0 || tail != __atomic_load_n(sqHead, __ATOMIC_ACQUIRE)) {
+        // Queue whole linked chains while they fit; links do not span submissions
+        unsigned pending = tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        int64_t now = Nanos();
+        while (next < ops.size()) {
+            size_t chainEnd = next;
+            while (chainEnd + 1 < ops.size() && ops[chainEnd].linked) {
+                chainEnd++;
+            }
+            size_t chainLength = chainEnd - next + 1;
+            if (inFlight + pending + chainLength > limit) {
+                break;
+            }
+            for (; next <= chainEnd; next++) {
+                unsigned slot = tail & sqMask;
+                PrepareEntry(entries[slot], ops[next], next);
+                if (next == chainEnd) {
+                    entries[slot].flags &= ~IOSQE_IO_LINK;
+                }
+                sqArray[slot] = slot;
+                submitted[next] = now;
+                tail++;
+                pending++;
+            }
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        // Submit what is queued and wait until at least one op completes
+        int entered = EnterRing(fd, pending, 1, IORING_ENTER_GETEVENTS);
+        if (entered < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                Close();
+                return false;
+            }
+            entered = 0;
+        }
+        inFlight += static_cast<size_t>(entered);
+
+        unsigned head = *cqHead;
+        unsigned ready = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        now = Nanos();
+        for (; head != ready; head++) {
+            const io_uring_cqe& cqe = completions[head & cqMask];
+            size_t index = static_cast<size_t>(cqe.user_data);
+            ops[index].result = cqe.res;
+            ops[index].nanos = now - submitted[index];
+            submitted[index] = 0;
+            inFlight--;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+#else
+bool IoRing::Open(unsigned) {
+    return false;
+}
+
+void IoRing::Close() {
+}
+
+bool IoRing::Run(std::vector<RingOp>& ops) {
+    for (auto& op : ops) {
+        op.result = -ECANCELED;
+        op.nanos = 0;
+    }
+    return false;
+}
+#endif
+
+IoRing::~IoRing() {
+    Close();
+}
+
+IoRing* ThreadRing(unsigned depth) {
+    // A failed open is remembered, so a kernel without io_uring is probed once per thread
+    thread_local IoRing ring;
+    thread_local unsigned failedDepth = 0;
+    if (depth == 0 || depth == failedDepth) {
+        return nullptr;
+    }
+    if (ring.IsOpen() && ring.Depth() == depth) {
+        return &ring;
+    }
+    if (!ring.Open(depth)) {
+        failedDepth = depth;
+        return nullptr;
+    }
+    return &ring;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Largest queue depth accepted from config.ini
+#define IO_RING_MAX_DEPTH 4096
+
+// One filesystem call to run through an IoRing. Paths are NUL-terminated and
+// must stay valid until Run returns.
+struct RingOp {
+    enum Kind { Rename, Unlink };
+
+    Kind kind = Rename;
+    const char* path = nullptr;
+    const char* target = nullptr;   // Rename: new path
+    unsigned flags = 0;             // renameat2 or unlinkat flags
+    bool linked = false;            // the next op starts only if this one succeeds
+
+    int result = 0;                 // 0 or -errno once run, -ECANCELED if it never completed
+    int64_t nanos = 0;              // from submission to completion
+};
+
+// Batched renameat2 and unlinkat through io_uring, driven by raw syscalls. Up to the queue depth is kept in flight and each completion is
+// matched back to its op. Linux only; elsewhere Open always fails.
+class IoRing {
+public:
+    IoRing() = default;
+    ~IoRing();
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    // False when the kernel lacks io_uring or one of the two operations
+    bool Open(unsigned depth);
+    void Close();
+
+    bool IsOpen() const { return fd >= 0; }
+    unsigned Depth() const { return depth; }
+
+    // Run every op and store its result. Returns false when the ring is not
+    // open or a linked chain is longer than it (nothing runs then), or when the
+    // ring fails midway. Every op that did not complete, whatever the reason,
+    // is left with -ECANCELED.
+    bool Run(std::vector<RingOp>& ops);
+
+private:
+    int fd = -1;
+    unsigned depth = 0;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    void* sqes = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    unsigned cqEntries = 0;
+    void* cqes = nullptr;
+};
+
+// The calling thread's ring at depth, opened on first use and reopened when
+// the depth changes. nullptr when depth is 0 or io_uring is unavailable.
+IoRing* ThreadRing(unsigned depth);
@@ -0,0 +1,360 @@
+#include "job.h"
+#include "path_ring.h"
+#include "timing.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <thread>
+
+// How long the first instance keeps admitting folders once its job is idle
+#define ADMIT_POLL 20
+#define ADMIT_QUIET 100
+// Planned entries a strand may run ahead of its mover
+#define MOVE_QUEUE_ENTRIES (4 * PLAN_CHUNK_ENTRIES)
+
+static int JobWorkers(const UnfoldOptions& options) {
+    return options.workers > 0 ? options.workers : static_cast<int>(std::thread::hardware_concurrency());
+}
+
+UnfoldJob::UnfoldJob(const UnfoldOptions& options, ThreadPool* sharedPool, NameIndexCache* cache)
+    : options(options),
+      ownPool(sharedPool == nullptr ? new ThreadPool(JobWorkers(options)) : nullptr),
+      pool(sharedPool == nullptr ? *ownPool : *sharedPool),
+      cache(cache),
+      started(std::chrono::steady_clock::now()),
+      deleteQueue(SIZE_MAX) {
+    if (!options.traceDirectory.empty()) {
+        StartTrace();
+    }
+    // Every planned move is journaled before it runs, so an interrupted job can be recovered
+    if (!options.journalDirectory.empty()) {
+        journal.Open(options.journalDirectory);
+    }
+
+    int moverCount = JobWorkers(options);
+    if (moverCount < 1) {
+        moverCount = 1;
+    }
+    for (int i = 0; i < moverCount; i++) {
+        moveQueues.emplace_back(new StageQueue<MoveChunk>(MOVE_QUEUE_ENTRIES));
+    }
+    for (auto& chunks : moveQueues) {
+        StageQueue<MoveChunk>* queue = chunks.get();
+        movers.emplace_back([this, queue] { MoveChunks(*queue); });
+    }
+    cleaner = std::thread([this] { DeleteFolders(); });
+}
+
+UnfoldJob::~UnfoldJob() {
+    pool.Wait();
+    StopStages();
+}
+
+void UnfoldJob::Add(const std::vector<std::wstring>& folderPaths) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& path : folderPaths) {
+        size_t index = folders.size();
+        folders.emplace_back();
+        runs.emplace_back();
+        folders.back().folder = SelectedFolder(path);
+        active++;
+
+        fs::path parent = folders.back().folder.lexically_normal().parent_path();
+        auto inserted = parents.try_emplace(parent);
+        ParentQueue& queue = inserted.first->second;
+        if (inserted.second) {
+            queue.mover = (parents.size() - 1) % moveQueues.size();
+        }
+        queue.pending.push_back(index);
+        if (!queue.running) {
+            queue.parent = parent;
+            queue.running = true;
+            pool.Submit([this, &queue] { Drain(queue); });
+        }
+    }
+}
+
+// Selections sharing a parent are planned in order on one strand and renamed in
+// order by one mover; different parents run concurrently
+void UnfoldJob::Drain(ParentQueue& queue) {
+    StageQueue<MoveChunk>& chunks = *moveQueues[queue.mover];
+    for (;;) {
+        std::vector<std::pair<FolderPlan*, FolderRun*>> batch;
+        std::vector<fs::path> freed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.pending.empty()) {
+                queue.running = false;
+                return;
+            }
+            for (size_t index : queue.pending) {
+                batch.push_back({ &folders[index], &runs[index] });
+            }
+            queue.pending.clear();
+            freed.swap(queue.freed);
+        }
+
+        // One scan of the parent for the whole job, so every conflict is a hash lookup
+        if (!queue.loaded) {
+            fs::path parent = queue.parent.empty() ? fs::path(".") : queue.parent;
+            PhaseTimer timer(Phase::Scan);
+            std::error_code ec;
+            if (cache == nullptr || !cache->Take(parent, queue.names)) {
+                queue.names.Load(parent, ec);
+            }
+            queue.loaded = true;
+        }
+        // Folders the cleaner deleted since the last batch no longer take their names
+        for (const auto& name : freed) {
+            queue.names.Erase(name);
+        }
+
+        // Chunks are journaled as they are planned and wait for one sync per
+        // PLAN_CHUNK_ENTRIES entries, rather than one per folder or per entry
+        std::vector<MoveChunk> unsynced;
+        size_t unsyncedEntries = 0;
+        std::chrono::steady_clock::duration handing{};
+        auto flush = [&]() {
+            auto start = std::chrono::steady_clock::now();
+            bool synced;
+            {
+                PhaseTimer timer(Phase::Journal);
+                TraceSpan span("journal", "sync");
+                synced = journal.Sync();
+            }
+            // Blocks while the mover is MOVE_QUEUE_ENTRIES behind
+            for (auto& chunk : unsynced) {
+                // Moves that recovery could not find are not run; the last chunk
+                // still goes, so the mover finishes the folder
+                if (!synced) {
+                    chunk.plan.items.clear();
+                    chunk.plan.actions.clear();
+                    FailFolder(*chunk.folder, FolderFailure::JournalFailed);
+                }
+                size_t weight = chunk.plan.items.size();
+                chunks.Push(std::move(chunk), weight);
+            }
+            unsynced.clear();
+            unsyncedEntries = 0;
+            handing += std::chrono::steady_clock::now() - start;
+        };
+        auto hand = [&](FolderPlan& plan, FolderRun& run, bool last) {
+            MoveChunk chunk;
+            chunk.folder = &plan;
+            chunk.run = &run;
+            chunk.queue = &queue;
+            chunk.last = last;
+            chunk.plan.crossDevice = plan.crossDevice;
+            chunk.plan.items.swap(plan.items);
+            chunk.plan.actions.swap(plan.actions);
+            if (!chunk.plan.items.empty()) {
+                chunk.progress.firstId = journal.Plan(chunk.plan.items, chunk.plan.actions, plan.chain);
+            }
+            unsyncedEntries += chunk.plan.items.size();
+            unsynced.push_back(std::move(chunk));
+            if (unsyncedEntries >= PLAN_CHUNK_ENTRIES) {
+                flush();
+            }
+        };
+
+        for (auto& folder : batch) {
+            FolderPlan& plan = *folder.first;
+            FolderRun& run = *folder.second;
+            auto start = std::chrono::steady_clock::now();
+            handing = {};
+            {
+                TraceSpan span("job", "plan folder", plan.folder);
+                PlanFolder(plan, options, queue.names, metadata, false,
+                           [&](FolderPlan& chunk) { hand(chunk, run, false); });
+            }
+            // Every folder ends with a last chunk, empty if it failed, so its mover can finish it
+            hand(plan, run, true);
+            AddPhaseTime(Phase::Plan, std::chrono::steady_clock::now() - start - handing);
+        }
+        if (!unsynced.empty()) {
+            flush();
+        }
+    }
+}
+
+// Rename chunks as they arrive; a folder whose last chunk left nothing for the
+// slow path goes straight to the cleaner
+void UnfoldJob::MoveChunks(StageQueue<MoveChunk>& chunks) {
+    MoveChunk chunk;
+    while (chunks.Pop(chunk)) {
+        FolderPlan& plan = *chunk.folder;
+        FolderRun& run = *chunk.run;
+        if (!chunk.plan.items.empty()) {
+            PhaseTimer timer(Phase::Move);
+            TraceSpan span("job", "move chunk", plan.folder);
+            MoveFolder(chunk.plan, chunk.progress, journal, options);
+            run.remaining += chunk.progress.remaining;
+            run.slowItems.insert(run.slowItems.end(), std::make_move_iterator(chunk.progress.slowItems.begin()),
+                                 std::make_move_iterator(chunk.progress.slowItems.end()));
+            run.slowIds.insert(run.slowIds.end(), chunk.progress.slowIds.begin(), chunk.progress.slowIds.end());
+        }
+        if (!chunk.last) {
+            continue;
+        }
+        if (plan.failure.empty() && !plan.chain.empty() && run.slowItems.empty()) {
+            deleteQueue.Push({ &plan, &run, chunk.queue }, 1);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        active--;
+    }
+}
+
+// Delete drained folders in batches of whatever has arrived since the last one
+void UnfoldJob::DeleteFolders() {
+    std::vector<DrainedFolder> drained;
+    while (deleteQueue.PopAll(drained)) {
+        std::vector<std::pair<FolderPlan*, FolderRun*>> batch;
+        for (const auto& folder : drained) {
+            batch.push_back({ folder.folder, folder.run });
+        }
+        {
+            PhaseTimer timer(Phase::Delete);
+            FinishFolders(batch, journal, options.ioRingDepth);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& folder : drained) {
+            // A lifted entry took the folder's name
+            if (folder.run->succeeded && folder.folder->selfNamed.empty()) {
+                folder.queue->freed.push_back(folder.folder->folder.filename());
+            }
+        }
+        drained.clear();
+    }
+}
+
+// Let the movers and the cleaner finish what is queued, then stop them
+void UnfoldJob::StopStages() {
+    for (auto& chunks : moveQueues) {
+        chunks->Close();
+    }
+    for (auto& mover : movers) {
+        if (mover.joinable()) {
+            mover.join();
+        }
+    }
+    deleteQueue.Close();
+    if (cleaner.joinable()) {
+        cleaner.join();
+    }
+}
+
+bool UnfoldJob::Idle() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return active == 0;
+}
+
+FolderProcessResult UnfoldJob::Finish() {
+    pool.Wait();
+    StopStages();
+    for (auto& entry : parents) {
+        for (const auto& name : entry.second.freed) {
+            entry.second.names.Erase(name);
+        }
+        entry.second.freed.clear();
+    }
+    FolderProcessResult result = {0, 0, L""};
+
+    // Do the remaining moves all at once so conflicts are resolved in a single dialog
+    std::vector<MoveItem> slowItems;
+    std::vector<size_t> slowOwner;
+    std::vector<uint64_t> slowIds;
+    for (size_t i = 0; i < runs.size(); i++) {
+        for (auto& item : runs[i].slowItems) {
+            slowItems.push_back(std::move(item));
+            slowOwner.push_back(i);
+        }
+        slowIds.insert(slowIds.end(), runs[i].slowIds.begin(), runs[i].slowIds.end());
+    }
+
+    if (!slowItems.empty()) {
+        MoveReport report;
+        {
+            PhaseTimer timer(Phase::SlowPath);
+            TraceSpan span("job", "slow path");
+            MoveSlowPath(slowItems, report);
+        }
+        std::vector<bool> slowFailed(slowItems.size(), false);
+        for (size_t index : report.failed) {
+            FailFolder(folders[slowOwner[index]], FolderFailure::MoveFailed);
+            slowFailed[index] = true;
+        }
+        for (size_t i = 0; i < slowIds.size(); i++) {
+            if (!slowFailed[i]) {
+                journal.Completed(slowIds[i]);
+                runs[slowOwner[i]].remaining--;
+            }
+        }
+        result.bytesCopied = report.bytesCopied;
+        result.copySeconds = report.copySeconds;
+
+        // Delete the folders the slow path drained
+        std::map<fs::path, std::vector<size_t>> drained;
+        for (size_t i = 0; i < folders.size(); i++) {
+            if (!runs[i].slowItems.empty() && folders[i].failure.empty()) {
+                drained[folders[i].folder.lexically_normal().parent_path()].push_back(i);
+            }
+        }
+        for (const auto& group : drained) {
+            const std::vector<size_t>* members = &group.second;
+            ParentQueue* queue = &parents[group.first];
+            pool.Submit([this, members, queue] {
+                PhaseTimer timer(Phase::Delete);
+                std::vector<std::pair<FolderPlan*, FolderRun*>> finished;
+                for (size_t index : *members) {
+                    finished.push_back({ &folders[index], &runs[index] });
+                }
+                FinishFolders(finished, journal, options.ioRingDepth);
+                for (size_t index : *members) {
+                    if (runs[index].succeeded && folders[index].selfNamed.empty()) {
+                        queue->names.Erase(folders[index].folder.filename());
+                    }
+                }
+            });
+        }
+        pool.Wait();
+    }
+    journal.Close();
+
+    if (cache != nullptr) {
+        for (auto& entry : parents) {
+            cache->Put(entry.first.empty() ? fs::path(".") : entry.first, std::move(entry.second.names));
+        }
+    }
+
+    for (size_t i = 0; i < folders.size(); i++) {
+        AppendFolderResult(result, folders[i], runs[i]);
+    }
+    AddPhaseTime(Phase::Job, std::chrono::steady_clock::now() - started);
+    if (!options.traceDirectory.empty()) {
+        RecordSpan("job", "unfold job",
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(started.time_since_epoch()).count());
+        FlushTrace(options.traceDirectory);
+    }
+    return result;
+}
+
+void AdmitPaths(PathSource& source, UnfoldJob& job) {
+    PhaseTimer timer(Phase::Collect);
+    auto lastPath = std::chrono::steady_clock::now();
+    for (;;) {
+        std::vector<std::wstring> paths;
+        size_t received;
+        {
+            TraceSpan span("ipc", "receive");
+            received = source.Receive(paths, ADMIT_POLL);
+        }
+        if (received > 0) {
+            job.Add(paths);
+            lastPath = std::chrono::steady_clock::now();
+        } else if (job.Idle() && std::chrono::steady_clock::now() - lastPath > std::chrono::milliseconds(ADMIT_QUIET)) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "conflict.h"
+#include "journal.h"
+#include "metadata.h"
+#include "plan.h"
+#include "stage_queue.h"
+#include "thread_pool.h"
+#include "unfold.h"
+
+namespace fs = std::filesystem;
+
+class PathSource;
+
+// An unfold job that starts moving as soon as its first folder arrives and
+// admits more folders while it runs. Folders sharing a parent are planned and
+// moved in arrival order against one index of the parent's names, so conflicts
+// between selections are found however late a selection joins.
+//
+// Planning, renaming and deleting run as a pipeline: strands on the pool plan
+// folders in chunks, mover threads rename each chunk as soon as it is journaled,
+// and a cleaner thread deletes each folder once its last chunk has moved. The
+// queues between the stages are bounded, so a huge folder is never held in
+// memory whole.
+class UnfoldJob {
+public:
+    // A daemon passes its long-lived pool and name cache; otherwise the job
+    // starts its own pool and scans every parent
+    explicit UnfoldJob(const UnfoldOptions& options, ThreadPool* sharedPool = nullptr, NameIndexCache* cache = nullptr);
+    ~UnfoldJob();
+
+    UnfoldJob(const UnfoldJob&) = delete;
+    UnfoldJob& operator=(const UnfoldJob&) = delete;
+
+    // Plan and move these folders in the background
+    void Add(const std::vector<std::wstring>& folderPaths);
+
+    // True when every added folder has been planned and renamed
+    bool Idle();
+
+    // No more folders: run the slow path once for everything left, delete the
+    // remaining folders and return the results in the order folders were added
+    FolderProcessResult Finish();
+
+    size_t FolderCount() const { return folders.size(); }
+
+private:
+    // Folders waiting for their parent's strand, and the parent's names
+    struct ParentQueue {
+        fs::path parent;
+        NameIndex names;
+        bool loaded = false;
+        bool running = false;
+        std::deque<size_t> pending;
+        std::vector<fs::path> freed;   // deleted folders not yet erased from names
+        size_t mover = 0;              // every chunk of this parent goes to one mover, in order
+    };
+
+    // Planned entries of one folder, journaled and ready to rename
+    struct MoveChunk {
+        FolderPlan* folder = nullptr;
+        FolderRun* run = nullptr;
+        ParentQueue* queue = nullptr;
+        FolderPlan plan;               // items, actions and crossDevice only
+        FolderRun progress;
+        bool last = false;
+    };
+
+    // A folder whose entries have all been renamed
+    struct DrainedFolder {
+        FolderPlan* folder;
+        FolderRun* run;
+        ParentQueue* queue;
+    };
+
+    void Drain(ParentQueue& queue);
+    void MoveChunks(StageQueue<MoveChunk>& chunks);
+    void DeleteFolders();
+    void StopStages();
+
+    UnfoldOptions options;
+    Journal journal;
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool& pool;
+    NameIndexCache* cache;
+    MetadataSnapshot metadata;
+    std::chrono::steady_clock::time_point started;
+
+    std::mutex mutex;
+    std::deque<FolderPlan> folders;   // deque: references stay valid while folders are added
+    std::deque<FolderRun> runs;
+    std::map<fs::path, ParentQueue> parents;
+    size_t active = 0;                // folders added but not yet renamed
+
+    std::vector<std::unique_ptr<StageQueue<MoveChunk>>> moveQueues;
+    StageQueue<DrainedFolder> deleteQueue;
+    std::vector<std::thread> movers;
+    std::thread cleaner;
+};
+
+// Admit folders sent by other instances (or daemon clients) into job until it
+// is idle and no new folder has arrived for a short while
+void AdmitPaths(PathSource& source, UnfoldJob& job);
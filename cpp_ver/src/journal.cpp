@@ -0,0 +1,620 @@
+#include "journal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+
+#include "compare.h"
+#include "metadata.h"
+
+// Completion records buffered before they are written out
+#define JOURNAL_FLUSH_SIZE (64 * 1024)
+
+// Record types
+#define RECORD_PLAN 'P'      // moves without resolutions, read back as plain moves
+#define RECORD_RESOLVED 'R'  // moves, each followed by its resolution byte
+#define RECORD_LIFT 'L'      // an entry about to take its folder's place
+#define RECORD_DONE 'D'
+#define RECORD_END 'E'
+
+static void PutU32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void PutU64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void PutPath(std::string& out, const fs::path& path) {
+    const auto& native = path.native();
+    uint32_t bytes = static_cast<uint32_t>(native.size() * sizeof(fs::path::value_type));
+    PutU32(out, bytes);
+    out.append(reinterpret_cast<const char*>(native.data()), bytes);
+}
+
+// FNV-1a, enough to spot a torn tail after a crash
+static uint32_t Checksum(const char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+Journal::~Journal() {
+    Close();
+}
+
+bool Journal::Open(const fs::path& directory) {
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+
+    auto stamp = std::chrono::system_clock::now().time_since_epoch().count();
+#ifdef _WIN32
+    path = directory / ("job-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(stamp) + ".journal");
+    // Readers are allowed but not writers, so recovery can tell the job is still running
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    handle = file;
+#else
+    path = directory / ("job-" + std::to_string(getpid()) + "-" + std::to_string(stamp) + ".journal");
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    // Held until Close, so recovery can tell the job is still running
+    flock(fd, LOCK_EX);
+    // The file's name must survive a crash as well as its records
+    int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+#endif
+    return true;
+}
+
+bool Journal::IsOpen() const {
+#ifdef _WIN32
+    return handle != nullptr;
+#else
+    return fd >= 0;
+#endif
+}
+
+void Journal::Append(char type, const std::string& payload) {
+    size_t start = buffer.size();
+    PutU32(buffer, static_cast<uint32_t>(payload.size() + 1));
+    buffer += type;
+    buffer += payload;
+    PutU32(buffer, Checksum(buffer.data() + start + 4, payload.size() + 1));
+}
+
+bool Journal::Flush(bool sync) {
+    if (failed) {
+        return false; // whatever follows a torn record cannot be read back
+    }
+    if (buffer.empty() && !sync) {
+        return true;
+    }
+#ifdef _WIN32
+    for (size_t done = 0; done < buffer.size();) {
+        DWORD written = 0;
+        if (!WriteFile(static_cast<HANDLE>(handle), buffer.data() + done, static_cast<DWORD>(buffer.size() - done),
+                       &written, NULL) || written == 0) {
+            failed = true;
+            break;
+        }
+        done += written;
+    }
+    if (sync && !failed && !FlushFileBuffers(static_cast<HANDLE>(handle))) {
+        failed = true;
+    }
+#else
+    for (size_t done = 0; done < buffer.size();) {
+        ssize_t n = write(fd, buffer.data() + done, buffer.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            failed = true;
+            break;
+        }
+        done += n;
+    }
+    if (sync && !failed && fdatasync(fd) != 0) {
+        failed = true;
+    }
+#endif
+    buffer.clear();
+    return !failed;
+}
+
+uint64_t Journal::Plan(const std::vector<MoveItem>& items, const std::vector<Resolution>& actions,
+                       const std::vector<fs::path>& folders) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t firstId = nextId;
+    nextId += items.size();
+    if (!IsOpen()) {
+        return firstId;
+    }
+
+    std::string payload;
+    PutU64(payload, firstId);
+    PutU32(payload, static_cast<uint32_t>(folders.size()));
+    for (const auto& folder : folders) {
+        PutPath(payload, folder);
+    }
+    PutU32(payload, static_cast<uint32_t>(items.size()));
+    for (size_t i = 0; i < items.size(); i++) {
+        PutPath(payload, items[i].from);
+        PutPath(payload, items[i].to);
+        payload += static_cast<char>(actions[i]);
+    }
+    Append(RECORD_RESOLVED, payload);
+    return firstId;
+}
+
+void Journal::Lift(const fs::path& entry, const fs::path& temp, const std::vector<fs::path>& chain, uint64_t identity) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!IsOpen()) {
+        return;
+    }
+
+    std::string payload;
+    PutU64(payload, identity);
+    PutPath(payload, entry);
+    PutPath(payload, temp);
+    PutU32(payload, static_cast<uint32_t>(chain.size()));
+    for (const auto& folder : chain) {
+        PutPath(payload, folder);
+    }
+    Append(RECORD_LIFT, payload);
+}
+
+bool Journal::Sync() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !IsOpen() || Flush(true);
+}
+
+void Journal::Completed(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!IsOpen()) {
+        return;
+    }
+
+    std::string payload;
+    PutU64(payload, id);
+    Append(RECORD_DONE, payload);
+    if (buffer.size() >= JOURNAL_FLUSH_SIZE) {
+        Flush(false);
+    }
+}
+
+void Journal::Close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!IsOpen()) {
+        return;
+    }
+
+    Append(RECORD_END, std::string());
+    Flush(true);
+#ifdef _WIN32
+    CloseHandle(static_cast<HANDLE>(handle));
+    handle = nullptr;
+#else
+    close(fd);
+    fd = -1;
+#endif
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+// Reads records back, stopping at the first torn or corrupt one
+class JournalReader {
+public:
+    explicit JournalReader(std::string data) : data(std::move(data)) {}
+
+    bool Next(char& type, size_t& payloadStart, size_t& payloadEnd) {
+        uint32_t length, checksum;
+        if (!Read(position, length) || length == 0 || data.size() - position - 4 < length + 4) {
+            return false;
+        }
+        size_t body = position + 4;
+        std::memcpy(&checksum, data.data() + body + length, 4);
+        if (checksum != Checksum(data.data() + body, length)) {
+            return false;
+        }
+        type = data[body];
+        payloadStart = body + 1;
+        payloadEnd = body + length;
+        position = body + length + 4;
+        return true;
+    }
+
+    template <typename T>
+    bool Read(size_t at, T& value) const {
+        if (at + sizeof(T) > data.size()) {
+            return false;
+        }
+        std::memcpy(&value, data.data() + at, sizeof(T));
+        return true;
+    }
+
+    bool ReadPath(size_t& at, size_t end, fs::path& path) const {
+        uint32_t bytes;
+        if (!Read(at, bytes) || at + 4 + bytes > end) {
+            return false;
+        }
+        fs::path::string_type native(bytes / sizeof(fs::path::value_type), 0);
+        std::memcpy(&native[0], data.data() + at + 4, bytes);
+        path = native;
+        at += 4 + bytes;
+        return true;
+    }
+
+private:
+    std::string data;
+    size_t position = 0;
+};
+
+// Open an unfinished journal unless a running job still holds it
+static bool ReadUnlockedJournal(const fs::path& path, std::string& data) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false; // sharing violation: the job is alive
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    data.resize(static_cast<size_t>(size.QuadPart));
+    DWORD read = 0;
+    BOOL ok = ReadFile(file, data.empty() ? NULL : &data[0], static_cast<DWORD>(data.size()), &read, NULL);
+    CloseHandle(file);
+    data.resize(read);
+    return ok != FALSE;
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return false; // the job is alive
+    }
+    data.clear();
+    char chunk[65536];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        data.append(chunk, n);
+    }
+    close(fd);
+    return n == 0;
+#endif
+}
+
+static bool Present(const fs::path& path) {
+    std::error_code ec;
+    return fs::exists(fs::symlink_status(path, ec));
+}
+
+// Move one entry during recovery, across devices if needed
+static bool RecoverMove(const fs::path& from, const fs::path& to) {
+    std::error_code ec;
+    MoveStatus status = RenameNoReplace(from, to, ec);
+    if (status == MoveStatus::Moved) {
+        return true;
+    }
+    if (status != MoveStatus::CrossDevice) {
+        return false;
+    }
+    MoveReport report;
+    MoveSlowPath({ { from, to } }, report);
+    return report.failed.empty();
+}
+
+// A planned move and how it resolved its conflict
+struct PlannedMove {
+    MoveItem item;
+    Resolution action = Resolution::Move;
+};
+
+// An entry being lifted into the place of its chain's top folder
+struct PlannedLift {
+    fs::path entry;
+    fs::path temp;
+    std::vector<fs::path> chain;
+    uint64_t identity = 0;
+};
+
+// True when path names the entry with that identity
+static bool IsEntry(const fs::path& path, uint64_t identity) {
+    PathInfo info;
+    std::error_code ec;
+    return identity != 0 && StatPath(path, false, info, ec) && info.identity == identity;
+}
+
+// Finish a lift from whichever step it reached: the entry still in place,
+// parked at temp, or already in the folder's place with the drained folder
+// left at temp
+static void ReplayLift(const PlannedLift& lift, RecoveryResult& result) {
+    const fs::path& folder = lift.chain.front();
+    bool ok;
+    if (IsEntry(lift.entry, lift.identity)) {
+        ok = LiftIntoPlace(lift.entry, lift.chain, lift.temp);
+    } else if (IsEntry(lift.temp, lift.identity)) {
+        ok = FinishLift(lift.entry, lift.chain, lift.temp);
+    } else if (IsEntry(folder, lift.identity)) {
+        if (!Present(lift.temp)) {
+            return; // finished
+        }
+        ok = RemoveEmptyFolder(lift.temp);
+    } else {
+        ok = false;
+    }
+    if (ok) {
+        result.restored++;
+    } else {
+        result.failed++;
+    }
+}
+
+// Put a lifted entry back at the bottom of its chain, recreating the wrappers
+static void RollBackLift(const PlannedLift& lift, RecoveryResult& result) {
+    const fs::path& folder = lift.chain.front();
+    std::error_code ec;
+    if (IsEntry(lift.entry, lift.identity)) {
+        return; // never started
+    }
+    if (IsEntry(folder, lift.identity)) {
+        // Swap back with the drained folder if it is still at temp, else just free the name
+        MoveStatus status = Present(lift.temp) ? RenameExchange(lift.temp, folder, ec)
+                                               : RenameNoReplace(folder, lift.temp, ec);
+        if (status != MoveStatus::Moved) {
+            result.failed++;
+            return;
+        }
+    }
+    if (!IsEntry(lift.temp, lift.identity)) {
+        result.failed++;
+        return;
+    }
+    fs::create_directories(lift.entry.parent_path(), ec);
+    if (RecoverMove(lift.temp, lift.entry)) {
+        result.restored++;
+    } else {
+        result.failed++;
+    }
+}
+
+// Finish the moves of one journal whose sources are still in place
+static void ReplayMoves(const std::map<uint64_t, PlannedMove>& planned, const std::set<uint64_t>& done,
+                        RecoveryResult& result) {
+    for (const auto& op : planned) {
+        const MoveItem& item = op.second.item;
+        if (done.count(op.first) || !Present(item.from)) {
+            continue;
+        }
+        std::error_code ec;
+        bool moved = false;
+        switch (op.second.action) {
+        case Resolution::Move:
+        case Resolution::Ask:
+            moved = !Present(item.to) && RecoverMove(item.from, item.to);
+            break;
+        case Resolution::Replace:
+            moved = Present(item.to) ? RenameReplace(item.from, item.to, ec) == MoveStatus::Moved
+                                     : RecoverMove(item.from, item.to);
+            break;
+        case Resolution::Merge: {
+            // Picks up where an interrupted merge stopped
+            std::vector<bool> merged;
+            MergeFolders({ &item }, merged);
+            moved = merged[0];
+            break;
+        }
+        case Resolution::Drop: {
+            // Deleted only if it still matches the parent's copy byte for byte
+            std::vector<bool> identical;
+            CompareFiles({ &item }, identical);
+            moved = identical[0] && fs::remove(item.from, ec);
+            break;
+        }
+        default:
+            break;
+        }
+        if (moved) {
+            result.restored++;
+        } else {
+            result.failed++;
+        }
+    }
+}
+
+// Put entries that were moved into a free name, or over a replaced entry, back
+// in their folders, newest first. Nothing else is moved: a merge or a drop
+// leaves behind entries that were in the parent before the job, and an asked
+// conflict may have been resolved either way.
+static void RollBackMoves(const std::map<uint64_t, PlannedMove>& planned, const std::set<uint64_t>& done,
+                          RecoveryResult& result) {
+    for (auto op = planned.rbegin(); op != planned.rend(); ++op) {
+        const MoveItem& item = op->second.item;
+        if (Present(item.from)) {
+            continue; // never moved
+        }
+        bool movable = op->second.action == Resolution::Move || op->second.action == Resolution::Replace;
+        if (!movable || !Present(item.to)) {
+            // Completions are synced lazily: without one and with nothing at
+            // either end, the move may never have started
+            if (done.count(op->first) || Present(item.to)) {
+                result.failed++;
+            }
+            continue;
+        }
+        std::error_code ec;
+        fs::create_directories(item.from.parent_path(), ec);
+        if (RecoverMove(item.to, item.from)) {
+            result.restored++;
+        } else {
+            result.failed++;
+        }
+    }
+}
+
+RecoveryResult RecoverJournals(const fs::path& directory, RecoveryMode mode) {
+    RecoveryResult result;
+    std::error_code ec;
+    for (fs::directory_iterator it(directory, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        if (it->path().extension() != ".journal") {
+            continue;
+        }
+
+        std::string data;
+        if (!ReadUnlockedJournal(it->path(), data)) {
+            continue;
+        }
+
+        // Rebuild the job: planned moves by id, completions and wrapper folders
+        JournalReader reader(std::move(data));
+        std::map<uint64_t, PlannedMove> planned;
+        std::set<uint64_t> done;
+        std::vector<std::vector<fs::path>> folders;
+        std::vector<PlannedLift> lifts;
+        bool finished = false;
+        char type;
+        size_t at, end;
+        while (reader.Next(type, at, end)) {
+            if (type == RECORD_END) {
+                finished = true;
+            } else if (type == RECORD_DONE) {
+                uint64_t id;
+                if (reader.Read(at, id)) {
+                    done.insert(id);
+                }
+            } else if (type == RECORD_LIFT) {
+                PlannedLift lift;
+                uint32_t count;
+                if (!reader.Read(at, lift.identity)) {
+                    continue;
+                }
+                at += 8;
+                if (!reader.ReadPath(at, end, lift.entry) || !reader.ReadPath(at, end, lift.temp) ||
+                    !reader.Read(at, count)) {
+                    continue;
+                }
+                at += 4;
+                lift.chain.resize(count);
+                bool complete = count > 0;
+                for (auto& folder : lift.chain) {
+                    complete = complete && reader.ReadPath(at, end, folder);
+                }
+                if (complete) {
+                    lifts.push_back(std::move(lift));
+                }
+            } else if (type == RECORD_PLAN || type == RECORD_RESOLVED) {
+                uint64_t id;
+                uint32_t count;
+                if (!reader.Read(at, id) || !reader.Read(at + 8, count)) {
+                    continue;
+                }
+                at += 12;
+                std::vector<fs::path> chain(count);
+                for (auto& folder : chain) {
+                    reader.ReadPath(at, end, folder);
+                }
+                folders.push_back(std::move(chain));
+                if (!reader.Read(at, count)) {
+                    continue;
+                }
+                at += 4;
+                for (uint32_t i = 0; i < count; i++) {
+                    PlannedMove op;
+                    if (!reader.ReadPath(at, end, op.item.from) || !reader.ReadPath(at, end, op.item.to)) {
+                        break;
+                    }
+                    if (type == RECORD_RESOLVED) {
+                        uint8_t action;
+                        if (at >= end || !reader.Read(at, action)) {
+                            break;
+                        }
+                        op.action = static_cast<Resolution>(action);
+                        at++;
+                    }
+                    planned[id + i] = std::move(op);
+                }
+            }
+        }
+
+        int failedBefore = result.failed;
+        if (!finished) {
+            result.jobs++;
+            if (mode == RecoveryMode::Replay) {
+                ReplayMoves(planned, done, result);
+                // A lifted chain is removed by its lift; its top folder may be the entry by now
+                std::set<fs::path> lifted;
+                for (const auto& lift : lifts) {
+                    ReplayLift(lift, result);
+                    lifted.insert(lift.chain.begin(), lift.chain.end());
+                }
+                for (const auto& chain : folders) {
+                    if (!chain.empty() && lifted.count(chain.front())) {
+                        continue;
+                    }
+                    for (auto folder = chain.rbegin(); folder != chain.rend(); ++folder) {
+                        if (!Present(*folder) || !fs::is_empty(*folder, ec) || !RemoveEmptyFolder(*folder)) {
+                            break;
+                        }
+                    }
+                }
+            } else {
+                // Lifts ran after every move of their folder, so they are undone first
+                for (auto lift = lifts.rbegin(); lift != lifts.rend(); ++lift) {
+                    RollBackLift(*lift, result);
+                }
+                RollBackMoves(planned, done, result);
+            }
+        }
+
+        // A journal that could not be fully recovered is kept for the user,
+        // under a name recovery does not pick up again
+        if (result.failed > failedBefore) {
+            fs::path kept = it->path();
+            fs::rename(it->path(), kept.replace_extension(".failed"), ec);
+        } else {
+            fs::remove(it->path(), ec);
+        }
+        ec.clear();
+    }
+    return result;
+}
+
+fs::path DefaultJournalDirectory() {
+#ifdef _WIN32
+    const wchar_t* localAppData = _wgetenv(L"LOCALAPPDATA");
+    if (localAppData != nullptr && *localAppData != L'\0') {
+        return fs::path(localAppData) / "unfolder" / "journal";
+    }
+#else
+    const char* stateHome = std::getenv("XDG_STATE_HOME");
+    if (stateHome != nullptr && *stateHome != '\0') {
+        return fs::path(stateHome) / "unfolder" / "journal";
+    }
+    const char* home = std::getenv("HOME");
+    if (home != nullptr && *home != '\0') {
+        return fs::path(home) / ".local" / "state" / "unfolder" / "journal";
+    }
+#endif
+    std::error_code ec;
+    return fs::temp_directory_path(ec) / "unfolder" / "journal";
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "conflict.h"
+#include "move_engine.h"
+
+namespace fs = std::filesystem;
+
+// Append-only write-ahead log of one unfold job. Planned moves are made durable
+// in batches before they run; completions are buffered and synced lazily,
+// since recovery checks the filesystem for each planned move anyway.
+class Journal {
+public:
+    Journal() = default;
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Start a journal file in directory; the job runs unjournaled if this fails
+    bool Open(const fs::path& directory);
+    bool IsOpen() const;
+
+    // Record the moves of one folder, how each one resolves its conflict, and the
+    // wrapper folders removed once it is drained. Returns the id of the first
+    // item; the rest follow in order.
+    uint64_t Plan(const std::vector<MoveItem>& items, const std::vector<Resolution>& actions,
+                  const std::vector<fs::path>& folders);
+
+    // Record that entry, the last thing left in chain, is about to be lifted into
+    // the place of chain's top folder through temp (see LiftIntoPlace).
+    // identity is the entry's PathInfo::identity, by which recovery finds it
+    // wherever the lift stopped.
+    void Lift(const fs::path& entry, const fs::path& temp, const std::vector<fs::path>& chain, uint64_t identity);
+
+    // Make the plans durable; none of their moves may start before this. False
+    // when a write or sync failed, now or earlier in the job: the plans since
+    // the last successful sync may not survive a crash, so their moves must not run.
+    bool Sync();
+
+    void Completed(uint64_t id);
+
+    // Mark the job finished and delete the journal
+    void Close();
+
+private:
+    void Append(char type, const std::string& payload);
+    bool Flush(bool sync);
+
+    std::mutex mutex;
+    std::string buffer;
+    fs::path path;
+    uint64_t nextId = 0;
+    bool failed = false;  // a write or sync failed; later records would follow a torn one
+#ifdef _WIN32
+    void* handle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// What to do with journals left behind by a job that did not finish
+enum class RecoveryMode {
+    Replay,   // finish the planned moves
+    Rollback  // move completed entries back to their folders
+};
+
+struct RecoveryResult {
+    int jobs = 0;      // unfinished journals found
+    int restored = 0;  // moves replayed or rolled back
+    int failed = 0;    // moves that could not be resolved, left where they are
+};
+
+// Recover every unfinished journal in directory that no running job holds open.
+// Rollback only moves back entries that were moved into a free name or over a
+// replaced one; merged, dropped and user-resolved entries are left in place and
+// counted as failed. Replay deletes a dropped copy only if it still matches the
+// parent's. Lifts are finished or undone from whichever step they reached. A
+// journal with failures is kept as job-*.failed.
+RecoveryResult RecoverJournals(const fs::path& directory, RecoveryMode mode);
+
+// Per-user directory for journals (%LOCALAPPDATA%\unfolder\journal, $XDG_STATE_HOME/unfolder/journal)
+fs::path DefaultJournalDirectory();
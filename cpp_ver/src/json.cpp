@@ -0,0 +1,264 @@
+#include "json.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+const JsonValue* JsonValue::Find(const std::string& key) const {
+    for (const auto& member : object) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+void AppendJsonString(std::string& out, const std::string& s) {
+    out += '"';
+    for (unsigned char ch : s) {
+        switch (ch) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (ch < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                out += escaped;
+            } else {
+                out += static_cast<char>(ch);
+            }
+        }
+    }
+    out += '"';
+}
+
+// Recursive-descent parser over the whole text
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : text(text) {}
+
+    bool ParseDocument(JsonValue& value) {
+        if (!ParseValue(value, 0)) {
+            return false;
+        }
+        SkipSpace();
+        return pos == text.size();
+    }
+
+private:
+    static constexpr int MaxDepth = 256;
+
+    void SkipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    bool Consume(const char* literal) {
+        size_t start = pos;
+        for (; *literal != '\0'; literal++, pos++) {
+            if (pos >= text.size() || text[pos] != *literal) {
+                pos = start;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void AppendUtf8(std::string& out, uint32_t codepoint) {
+        if (codepoint < 0x80) {
+            out += static_cast<char>(codepoint);
+        } else if (codepoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codepoint >> 6));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else if (codepoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codepoint >> 12));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (codepoint >> 18));
+            out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+    }
+
+    bool ParseHex4(uint32_t& value) {
+        if (pos + 4 > text.size()) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            char ch = text[pos++];
+            value <<= 4;
+            if (ch >= '0' && ch <= '9') value |= ch - '0';
+            else if (ch >= 'a' && ch <= 'f') value |= ch - 'a' + 10;
+            else if (ch >= 'A' && ch <= 'F') value |= ch - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool ParseString(std::string& out) {
+        if (pos >= text.size() || text[pos] != '"') {
+            return false;
+        }
+        pos++;
+        while (pos < text.size()) {
+            char ch = text[pos++];
+            if (ch == '"') {
+                return true;
+            }
+            if (ch != '\\') {
+                out += ch;
+                continue;
+            }
+            if (pos >= text.size()) {
+                return false;
+            }
+            switch (text[pos++]) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t codepoint;
+                if (!ParseHex4(codepoint)) {
+                    return false;
+                }
+                // Surrogate pair
+                if (codepoint >= 0xD800 && codepoint < 0xDC00 && Consume("\\u")) {
+                    uint32_t low;
+                    if (!ParseHex4(low) || low < 0xDC00 || low >= 0xE000) {
+                        return false;
+                    }
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(out, codepoint);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool ParseNumber(JsonValue& value) {
+        size_t start = pos;
+        bool integral = true;
+        if (pos < text.size() && text[pos] == '-') pos++;
+        while (pos < text.size()) {
+            char ch = text[pos];
+            if (ch >= '0' && ch <= '9') {
+                pos++;
+            } else if (ch == '.' || ch == 'e' || ch == 'E' || ch == '+' || ch == '-') {
+                integral = false;
+                pos++;
+            } else {
+                break;
+            }
+        }
+        std::string number = text.substr(start, pos - start);
+        char* end = nullptr;
+        value.type = JsonValue::Type::Number;
+        value.number = std::strtod(number.c_str(), &end);
+        if (end == number.c_str() || *end != '\0') {
+            return false;
+        }
+        value.integer = integral ? std::strtoll(number.c_str(), nullptr, 10) : static_cast<int64_t>(value.number);
+        return true;
+    }
+
+    bool ParseValue(JsonValue& value, int depth) {
+        if (depth > MaxDepth) {
+            return false;
+        }
+        SkipSpace();
+        if (pos >= text.size()) {
+            return false;
+        }
+
+        char ch = text[pos];
+        if (ch == '{') {
+            pos++;
+            value.type = JsonValue::Type::Object;
+            SkipSpace();
+            if (Consume("}")) {
+                return true;
+            }
+            while (true) {
+                SkipSpace();
+                std::pair<std::string, JsonValue> member;
+                if (!ParseString(member.first)) {
+                    return false;
+                }
+                SkipSpace();
+                if (!Consume(":") || !ParseValue(member.second, depth + 1)) {
+                    return false;
+                }
+                value.object.push_back(std::move(member));
+                SkipSpace();
+                if (Consume("}")) {
+                    return true;
+                }
+                if (!Consume(",")) {
+                    return false;
+                }
+            }
+        }
+        if (ch == '[') {
+            pos++;
+            value.type = JsonValue::Type::Array;
+            SkipSpace();
+            if (Consume("]")) {
+                return true;
+            }
+            while (true) {
+                value.array.emplace_back();
+                if (!ParseValue(value.array.back(), depth + 1)) {
+                    return false;
+                }
+                SkipSpace();
+                if (Consume("]")) {
+                    return true;
+                }
+                if (!Consume(",")) {
+                    return false;
+                }
+            }
+        }
+        if (ch == '"') {
+            value.type = JsonValue::Type::String;
+            return ParseString(value.string);
+        }
+        if (Consume("true")) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = true;
+            return true;
+        }
+        if (Consume("false")) {
+            value.type = JsonValue::Type::Bool;
+            return true;
+        }
+        if (Consume("null")) {
+            value.type = JsonValue::Type::Null;
+            return true;
+        }
+        return ParseNumber(value);
+    }
+
+    const std::string& text;
+    size_t pos = 0;
+};
+
+bool ParseJson(const std::string& text, JsonValue& value) {
+    value = JsonValue();
+    return JsonParser(text).ParseDocument(value);
+}
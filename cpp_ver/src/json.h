@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON document model for the files unfolder writes and reads back
+// (plans, benchmark reports). Strings are kept as UTF-8 bytes.
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    int64_t integer = 0;  // exact value when the number was written without fraction or exponent
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    // Member lookup; nullptr when missing or not an object
+    const JsonValue* Find(const std::string& key) const;
+};
+
+bool ParseJson(const std::string& text, JsonValue& value);
+
+// Append s to out as a quoted JSON string
+void AppendJsonString(std::string& out, const std::string& s);
@@ -1,322 +1,232 @@
 #include <windows.h>
 #include <shlobj.h>
 #include <shellscalingapi.h>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <sstream>
 #include <thread>
-#include <chrono>
 
-namespace fs = std::filesystem;
+#include "archive.h"
+#include "config.h"
+#include "daemon.h"
+#include "job.h"
+#include "metrics.h"
+#include "path_ring.h"
+#include "plan.h"
+#include "timing.h"
+#include "unfold.h"
+#include "watch.h"
 
 // Constants for IPC (using Local\ instead of Global\ to avoid admin requirement)
 #define MUTEX_NAME L"Local\\UnfolderMutex"
-#define EVENT_NAME L"Local\\UnfolderEvent"
-#define MAPPING_NAME L"Local\\UnfolderMapping"
-#define MAPPING_SIZE 65536
 #define WAIT_TIMEOUT 5000
 
-// 将路径转换为 Windows API 兼容的 `std::vector<wchar_t>`（双零结尾）
-std::vector<wchar_t> to_windows_path(const fs::path& path) {
-    std::wstring pathStr = path.wstring();
-    pathStr += L'\0'; // 添加结尾的第一个 '\0'
-    pathStr += L'\0'; // 确保是双 '\0' 结尾
-    return std::vector<wchar_t>(pathStr.begin(), pathStr.end());
+// 设置高 DPI 适配，防止模糊
+void EnableDPIAwareness() {
+    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
 }
 
-// 使用 `SHFileOperationW` 移动文件，确保冲突处理正确
-bool MoveFilesToParent(const std::vector<fs::path>& files, const fs::path& parent) {
-    std::wstring fromPaths;
-    std::wstring toPaths;
-
-    for (const auto& file : files) {
-        fromPaths += file.wstring() + L'\0';
-        toPaths += (parent / file.filename()).wstring() + L'\0';
-    }
-    fromPaths += L'\0';
-    toPaths += L'\0';
-
-    SHFILEOPSTRUCTW fileOp = { 0 };
-    fileOp.wFunc = FO_MOVE;
-    fileOp.pFrom = fromPaths.c_str();
-    fileOp.pTo = toPaths.c_str();
-    fileOp.fFlags = FOF_ALLOWUNDO | FOF_MULTIDESTFILES; // 保留原生的文件冲突提示框
-
-    int result = SHFileOperationW(&fileOp);
-
-    if (result == 0) {
-        return true; // 移动成功
-    } else {
-        std::wcout << L"file not moved: " << fromPaths << L"\n"; // 记录未移动的文件
-        return false; // 失败（用户可能选择了跳过）
+// Hand our folders to the running instance. Returns the ones it did not take
+// (it is finishing up or stuck), which this instance then unfolds itself.
+std::vector<std::wstring> SendToExistingInstance(const std::vector<std::wstring>& folderPaths) {
+    PathRing ring;
+    if (!ring.Open(false)) {
+        return folderPaths;
     }
+    std::vector<std::wstring> undelivered;
+    ring.Send(folderPaths, WAIT_TIMEOUT, undelivered);
+    return undelivered;
 }
 
-// 处理整个文件夹
-bool MoveFolderContents(const fs::path& folder) {
-    fs::path parent = folder.parent_path();
-    std::vector<fs::path> files;
-
-    for (const auto& entry : fs::directory_iterator(folder)) {
-        files.push_back(entry.path());
+// Append this run's phase timings and metrics where config.ini asks for them
+void RecordRun(const char* mode, size_t folders, const FolderProcessResult& result) {
+    fs::path configPath = ConfigPath();
+    fs::path log = ReadTimingLog(configPath);
+    if (!log.empty()) {
+        AddPhaseTime(Phase::Total, ProcessAge());
+        WriteTimingRecord(log, mode, folders, result);
     }
-
-    if (MoveFilesToParent(files, parent) && fs::is_empty(folder)) {
-        std::wstring folderStr = folder.wstring() + L'\0' + L'\0';
-        SHFILEOPSTRUCTW delOp = { 0 };
-        delOp.wFunc = FO_DELETE;
-        delOp.pFrom = folderStr.c_str();
-        delOp.fFlags = FOF_ALLOWUNDO | FOF_NOCONFIRMATION;
-
-        return (SHFileOperationW(&delOp) == 0);
+    fs::path metricsFile = ReadMetricsFile(configPath);
+    if (!metricsFile.empty()) {
+        WriteMetricsFile(metricsFile);
     }
-
-    return false; // 移动失败或文件夹非空
 }
 
-// 设置高 DPI 适配，防止模糊
-void EnableDPIAwareness() {
-    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+// Display results
+void ShowResult(const FolderProcessResult& result, bool successPopup) {
+    if (result.failureCount == 0 && successPopup) {
+        std::wstringstream msgStream;
+        msgStream << L"Successfully processed " << result.successCount << L" folder(s).";
+        MessageBoxW(NULL, msgStream.str().c_str(), L"Completed", MB_OK | MB_ICONINFORMATION);
+    } else if (result.failureCount > 0 || !result.errorMessages.empty()) {
+        std::wstring message = L"Success: " + std::to_wstring(result.successCount) + L"\n";
+        message += L"Failed: " + std::to_wstring(result.failureCount) + L"\n\n";
+        if (!result.errorMessages.empty()) {
+            message += L"Failed folders:\n";
+            message += result.errorMessages;
+        }
+        MessageBoxW(NULL, message.c_str(), L"Partial Success", MB_OK | MB_ICONWARNING);
+    }
 }
 
-// Process multiple folders at once
-struct FolderProcessResult {
-    int successCount;
-    int failureCount;
-    std::wstring errorMessages;
-};
+// Write a plan for the folders without moving anything (dryRun), or execute a saved plan
+int RunPlanCommand(const std::vector<std::wstring>& folders, bool dryRun, fs::path planFile) {
+    fs::path configPath = ConfigPath();
+    UnfoldOptions options = ReadUnfoldOptions(configPath);
 
-FolderProcessResult ProcessMultipleFolders(const std::vector<std::wstring>& folderPaths) {
-    FolderProcessResult result = {0, 0, L""};
-    
-    // Collect all files from all folders
-    std::wstring fromPaths;
-    std::wstring toPaths;
-    std::vector<fs::path> foldersToDelete;
-    
-    for (const auto& pathStr : folderPaths) {
-        fs::path folderPath = pathStr;
-        
-        if (!fs::exists(folderPath) || !fs::is_directory(folderPath)) {
-            result.errorMessages += folderPath.wstring() + L"\n";
-            result.errorMessages += L"  Reason: Not a valid folder\n\n";
-            result.failureCount++;
-            continue;
+    if (dryRun) {
+        if (planFile.empty()) {
+            planFile = configPath.parent_path() / "unfolder-plan.json";
         }
-        
-        fs::path parent = folderPath.parent_path();
-        bool hasFiles = false;
-        
-        try {
-            for (const auto& entry : fs::directory_iterator(folderPath)) {
-                hasFiles = true;
-                fromPaths += entry.path().wstring() + L'\0';
-                toPaths += (parent / entry.path().filename()).wstring() + L'\0';
-            }
-            
-            if (hasFiles) {
-                foldersToDelete.push_back(folderPath);
-            }
-        } catch (const std::exception&) {
-            result.errorMessages += folderPath.wstring() + L"\n";
-            result.errorMessages += L"  Reason: Failed to read folder\n\n";
-            result.failureCount++;
-        }
-    }
-    
-    // If we have files to move, do it all at once
-    if (!fromPaths.empty()) {
-        fromPaths += L'\0';
-        toPaths += L'\0';
-        
-        SHFILEOPSTRUCTW fileOp = { 0 };
-        fileOp.wFunc = FO_MOVE;
-        fileOp.pFrom = fromPaths.c_str();
-        fileOp.pTo = toPaths.c_str();
-        fileOp.fFlags = FOF_ALLOWUNDO | FOF_MULTIDESTFILES;
-        
-        int moveResult = SHFileOperationW(&fileOp);
-        
-        if (moveResult == 0 && !fileOp.fAnyOperationsAborted) {
-            // Delete empty folders
-            for (const auto& folder : foldersToDelete) {
-                try {
-                    if (fs::is_empty(folder)) {
-                        std::wstring folderStr = folder.wstring() + L'\0' + L'\0';
-                        SHFILEOPSTRUCTW delOp = { 0 };
-                        delOp.wFunc = FO_DELETE;
-                        delOp.pFrom = folderStr.c_str();
-                        delOp.fFlags = FOF_ALLOWUNDO | FOF_NOCONFIRMATION;
-                        
-                        if (SHFileOperationW(&delOp) == 0) {
-                            result.successCount++;
-                        } else {
-                            result.errorMessages += folder.wstring() + L"\n";
-                            result.errorMessages += L"  Reason: Failed to delete folder\n\n";
-                            result.failureCount++;
-                        }
-                    } else {
-                        result.errorMessages += folder.wstring() + L"\n";
-                        result.errorMessages += L"  Reason: Folder not empty after move\n\n";
-                        result.failureCount++;
-                    }
-                } catch (const std::exception&) {
-                    result.errorMessages += folder.wstring() + L"\n";
-                    result.errorMessages += L"  Reason: Error checking folder\n\n";
-                    result.failureCount++;
-                }
-            }
-        } else {
-            // Move operation failed or was aborted
-            for (const auto& folder : foldersToDelete) {
-                result.errorMessages += folder.wstring() + L"\n";
-                result.errorMessages += L"  Reason: Move operation failed or cancelled\n\n";
-                result.failureCount++;
-            }
+        UnfoldPlan plan = PlanUnfold(folders, options, true);
+        std::wstring message = DescribePlan(SummarizePlan(plan));
+        if (!WritePlanFile(planFile, plan)) {
+            MessageBoxW(NULL, (L"Failed to write plan: " + planFile.wstring()).c_str(), L"Error", MB_OK | MB_ICONERROR);
+            return 1;
         }
+        message += L"\n\nPlan written to " + planFile.wstring();
+        MessageBoxW(NULL, message.c_str(), L"Dry Run", MB_OK | MB_ICONINFORMATION);
+        return 0;
     }
-    
-    return result;
-}
 
-// Read config file
-bool ReadConfig(const std::wstring& configPath, const std::wstring& key) {
-    std::wifstream configFile(configPath);
-    std::wstring line;
-    while (std::getline(configFile, line)) {
-        std::wistringstream lineStream(line);
-        std::wstring currentKey;
-        if (std::getline(lineStream, currentKey, L'=') && currentKey == key) {
-            int value;
-            if (lineStream >> value) {
-                return value != 0;
-            }
-        }
+    UnfoldPlan plan;
+    if (!ReadPlanFile(planFile, plan)) {
+        MessageBoxW(NULL, (L"Not a valid plan file: " + planFile.wstring()).c_str(), L"Error", MB_OK | MB_ICONERROR);
+        return 1;
     }
-    return false;
+    FolderProcessResult result = ExecutePlan(plan, options);
+    RecordRun("plan", plan.folders.size(), result);
+    ShowResult(result, ReadConfig(configPath, L"SuccessPopup"));
+    return 0;
 }
 
-// Send folder path to existing instance
-bool SendToExistingInstance(const std::wstring& folderPath) {
-    HANDLE hMapFile = OpenFileMappingW(FILE_MAP_WRITE, FALSE, MAPPING_NAME);
-    if (hMapFile == NULL) return false;
+// Extract each archive next to itself with its top-level folder stripped
+int RunExtractCommand(const std::vector<std::wstring>& archives) {
+    fs::path configPath = ConfigPath();
+    FolderProcessResult result = ExtractArchives(archives, ReadUnfoldOptions(configPath));
+    RecordRun("extract", archives.size(), result);
+    ShowResult(result, ReadConfig(configPath, L"SuccessPopup"));
+    return result.failureCount == 0 ? 0 : 1;
+}
 
-    LPVOID pBuf = MapViewOfFile(hMapFile, FILE_MAP_WRITE, 0, 0, MAPPING_SIZE);
-    if (pBuf == NULL) {
-        CloseHandle(hMapFile);
-        return false;
+// Finish or undo jobs that were interrupted last time
+void RecoverInterruptedJobs(const fs::path& configPath, const UnfoldOptions& options) {
+    if (options.journalDirectory.empty()) {
+        return;
     }
-
-    // Write the folder path
-    wcscpy_s((wchar_t*)pBuf, MAPPING_SIZE / sizeof(wchar_t), folderPath.c_str());
-
-    // Signal the event
-    HANDLE hEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE, EVENT_NAME);
-    if (hEvent != NULL) {
-        SetEvent(hEvent);
-        CloseHandle(hEvent);
+    RecoveryResult recovery;
+    {
+        PhaseTimer timer(Phase::Recovery);
+        recovery = RecoverJournals(options.journalDirectory, ReadRecoveryMode(configPath));
+    }
+    if (recovery.jobs > 0) {
+        std::wstringstream msgStream;
+        msgStream << L"Recovered " << recovery.jobs << L" interrupted job(s).\n"
+                  << recovery.restored << L" entries restored, " << recovery.failed << L" left in place.";
+        MessageBoxW(NULL, msgStream.str().c_str(), L"Recovered", MB_OK | MB_ICONINFORMATION);
     }
+}
 
-    UnmapViewOfFile(pBuf);
-    CloseHandle(hMapFile);
-    return true;
+// Stay resident and unfold whatever later launches submit
+int RunDaemonCommand() {
+    fs::path configPath = ConfigPath();
+    RecoverInterruptedJobs(configPath, ReadUnfoldOptions(configPath));
+
+    // Results pop up on their own thread so the next job does not wait for a click
+    int status = RunDaemon(configPath, [configPath](const FolderProcessResult& result) {
+        bool successPopup = ReadConfig(configPath, L"SuccessPopup");
+        std::thread([result, successPopup] { ShowResult(result, successPopup); }).detach();
+    });
+    MessageBoxW(NULL, L"Another unfolder daemon is already running.", L"Error", MB_OK | MB_ICONERROR);
+    return status;
 }
 
-// Collect paths with timeout
-std::vector<std::wstring> CollectPaths(HANDLE hEvent, HANDLE hMapFile, LPVOID pBuf) {
-    std::vector<std::wstring> paths;
-    auto startTime = std::chrono::steady_clock::now();
-    
-    while (true) {
-        DWORD waitResult = WaitForSingleObject(hEvent, 500); // Wait 500ms
-        
-        if (waitResult == WAIT_OBJECT_0) {
-            // Received a path
-            wchar_t* pathData = (wchar_t*)pBuf;
-            if (wcslen(pathData) > 0) {
-                paths.push_back(pathData);
-                // Clear the buffer
-                memset(pBuf, 0, MAPPING_SIZE);
-            }
-            ResetEvent(hEvent);
-            startTime = std::chrono::steady_clock::now(); // Reset timeout
-        } else {
-            // Check if timeout exceeded
-            auto elapsed = std::chrono::steady_clock::now() - startTime;
-            if (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() > 1000) {
-                // No more paths for 1 second, we're done
-                break;
-            }
-        }
-    }
-    
-    return paths;
+// Stay resident and unfold the wrapper folders that appear in folders
+int RunWatchCommand(const std::vector<std::wstring>& folders) {
+    fs::path configPath = ConfigPath();
+    RecoverInterruptedJobs(configPath, ReadUnfoldOptions(configPath));
+
+    std::wstring error;
+    int status = RunWatch(folders, configPath, [configPath](const FolderProcessResult& result) {
+        bool successPopup = ReadConfig(configPath, L"SuccessPopup");
+        std::thread([result, successPopup] { ShowResult(result, successPopup); }).detach();
+    }, error);
+    MessageBoxW(NULL, error.c_str(), L"Error", MB_OK | MB_ICONERROR);
+    return status;
 }
 
 // Windows GUI application entry point
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow) {
-    EnableDPIAwareness();
+    AddPhaseTime(Phase::Startup, ProcessAge());
 
     // Parse command line arguments
+    auto phaseStart = std::chrono::steady_clock::now();
     int argc;
     LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
-    
-    if (argc < 2) {
-        MessageBoxW(NULL, L"Please drag a folder to this program or call it from the right-click menu!", L"Error", MB_OK | MB_ICONERROR);
-        LocalFree(argv);
-        return 1;
-    }
 
-    // Try to create or open mutex
-    HANDLE hMutex = CreateMutexW(NULL, FALSE, MUTEX_NAME);
-    DWORD mutexError = GetLastError();
-    
-    if (mutexError == ERROR_ALREADY_EXISTS) {
-        // Another instance is running, send our path to it
-        for (int i = 1; i < argc; i++) {
-            SendToExistingInstance(argv[i]);
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // --dry-run writes a plan instead of moving anything; --plan=FILE alone executes
+    // a saved plan. Both run on their own, without joining another instance.
+    // --daemon stays resident and takes the folders of every later launch.
+    // --extract takes archives instead of folders and unfolds them as they extract.
+    // --watch stays resident and unfolds the wrapper folders appearing in the folders.
+    std::vector<std::wstring> folders;
+    bool dryRun = false;
+    bool daemon = false;
+    bool extract = false;
+    bool watch = false;
+    fs::path planFile;
+    for (int i = 1; i < argc; i++) {
+        std::wstring arg = argv[i];
+        if (arg == L"--dry-run") {
+            dryRun = true;
+        } else if (arg == L"--daemon") {
+            daemon = true;
+        } else if (arg == L"--extract") {
+            extract = true;
+        } else if (arg == L"--watch") {
+            watch = true;
+        } else if (arg.rfind(L"--plan=", 0) == 0) {
+            planFile = arg.substr(7);
+        } else {
+            folders.push_back(arg);
         }
+    }
+    AddPhaseTime(Phase::Arguments, std::chrono::steady_clock::now() - phaseStart);
+
+    // With a daemon running this launch is only a messenger: no window, config or mutex
+    phaseStart = std::chrono::steady_clock::now();
+    if (!dryRun && planFile.empty() && !daemon && !extract && !watch && !folders.empty() && SubmitToDaemon(folders)) {
+        AddPhaseTime(Phase::Handoff, std::chrono::steady_clock::now() - phaseStart);
         LocalFree(argv);
-        CloseHandle(hMutex);
+        RecordRun("daemon-client", 0, FolderProcessResult{0, 0, L""});
         return 0;
     }
 
-    // We are the first instance, create shared memory and event
-    HANDLE hEvent = CreateEventW(NULL, TRUE, FALSE, EVENT_NAME);
-    if (hEvent == NULL) {
-        std::wstringstream errMsg;
-        errMsg << L"Failed to create event! Error code: " << GetLastError();
-        MessageBoxW(NULL, errMsg.str().c_str(), L"Error", MB_OK | MB_ICONERROR);
+    EnableDPIAwareness();
+    if (daemon) {
         LocalFree(argv);
-        CloseHandle(hMutex);
-        return 1;
+        return RunDaemonCommand();
     }
 
-    HANDLE hMapFile = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, MAPPING_SIZE, MAPPING_NAME);
-    if (hMapFile == NULL) {
-        std::wstringstream errMsg;
-        errMsg << L"Failed to create file mapping! Error code: " << GetLastError();
-        MessageBoxW(NULL, errMsg.str().c_str(), L"Error", MB_OK | MB_ICONERROR);
+    if (argc < 2) {
+        MessageBoxW(NULL, L"Please drag a folder to this program or call it from the right-click menu!", L"Error", MB_OK | MB_ICONERROR);
         LocalFree(argv);
-        CloseHandle(hEvent);
-        CloseHandle(hMutex);
         return 1;
     }
-
-    LPVOID pBuf = MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, MAPPING_SIZE);
-
-    if (pBuf == NULL) {
-        std::wstringstream errMsg;
-        errMsg << L"Failed to map view of file! Error code: " << GetLastError();
-        MessageBoxW(NULL, errMsg.str().c_str(), L"Error", MB_OK | MB_ICONERROR);
+    if (dryRun || !planFile.empty()) {
         LocalFree(argv);
-        CloseHandle(hEvent);
-        CloseHandle(hMapFile);
-        CloseHandle(hMutex);
-        return 1;
+        return RunPlanCommand(folders, dryRun, planFile);
+    }
+    if (extract) {
+        LocalFree(argv);
+        return RunExtractCommand(folders);
+    }
+    if (watch) {
+        LocalFree(argv);
+        return RunWatchCommand(folders);
     }
 
     // Collect all paths from command line
@@ -326,39 +236,55 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
     }
     LocalFree(argv);
 
-    // Wait for additional paths from other instances
-    auto additionalPaths = CollectPaths(hEvent, hMapFile, pBuf);
-    allPaths.insert(allPaths.end(), additionalPaths.begin(), additionalPaths.end());
+    // Try to create or open mutex
+    HANDLE hMutex = CreateMutexW(NULL, FALSE, MUTEX_NAME);
+    DWORD mutexError = GetLastError();
+
+    // The first instance reopens the ring at once so other instances can queue
+    // their folders while it reads the config and recovers journals
+    PathRing ring;
+    bool receiving = false;
+    if (mutexError == ERROR_ALREADY_EXISTS) {
+        // Another instance is running, send our paths to it in one record
+        allPaths = SendToExistingInstance(allPaths);
+        if (allPaths.empty()) {
+            AddPhaseTime(Phase::Handoff, std::chrono::steady_clock::now() - phaseStart);
+            CloseHandle(hMutex);
+            RecordRun("join", 0, FolderProcessResult{0, 0, L""});
+            return 0;
+        }
+    } else if (ring.Open(true)) {
+        receiving = true;
+    }
+    AddPhaseTime(Phase::Handoff, std::chrono::steady_clock::now() - phaseStart);
 
     // Get config
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileNameW(NULL, exePath, MAX_PATH);
-    fs::path configPath = fs::path(exePath).remove_filename() / "config.ini";
+    phaseStart = std::chrono::steady_clock::now();
+    fs::path configPath = ConfigPath();
     bool successPopup = ReadConfig(configPath, L"SuccessPopup");
-
-    // Process all folders at once
-    auto result = ProcessMultipleFolders(allPaths);
+    UnfoldOptions options = ReadUnfoldOptions(configPath);
+    AddPhaseTime(Phase::Config, std::chrono::steady_clock::now() - phaseStart);
+
+    RecoverInterruptedJobs(configPath, options);
+
+    // Start on our own folders right away and admit the ones other instances send
+    // while the job runs. Closing the ring makes latecomers unfold their own.
+    UnfoldJob job(options);
+    job.Add(allPaths);
+    if (receiving) {
+        AdmitPaths(ring, job);
+        std::vector<std::wstring> latePaths;
+        ring.Close(latePaths);
+        job.Add(latePaths);
+    }
+    auto result = job.Finish();
+    RecordRun("first", job.FolderCount(), result);
 
     // Display results
-    if (result.failureCount == 0 && successPopup) {
-        std::wstringstream msgStream;
-        msgStream << L"Successfully processed " << result.successCount << L" folder(s).";
-        MessageBoxW(NULL, msgStream.str().c_str(), L"Completed", MB_OK | MB_ICONINFORMATION);
-    } else if (result.failureCount > 0 || !result.errorMessages.empty()) {
-        std::wstring message = L"Success: " + std::to_wstring(result.successCount) + L"\n";
-        message += L"Failed: " + std::to_wstring(result.failureCount) + L"\n\n";
-        if (!result.errorMessages.empty()) {
-            message += L"Failed folders:\n";
-            message += result.errorMessages;
-        }
-        MessageBoxW(NULL, message.c_str(), L"Partial Success", MB_OK | MB_ICONWARNING);
-    }
+    ShowResult(result, successPopup);
 
     // Cleanup
-    UnmapViewOfFile(pBuf);
-    CloseHandle(hMapFile);
-    CloseHandle(hEvent);
     CloseHandle(hMutex);
 
     return 0;
-}
\ No newline at end of file
+}
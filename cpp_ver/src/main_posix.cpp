@@ -0,0 +1,232 @@
+#include <fcntl.h>
+#include <sys/file.h>
+
+#include <clocale>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "archive.h"
+#include "config.h"
+#include "daemon.h"
+#include "job.h"
+#include "metrics.h"
+#include "path_ring.h"
+#include "plan.h"
+#include "timing.h"
+#include "unfold.h"
+#include "watch.h"
+
+#define SEND_TIMEOUT 5000
+
+// Single-instance lock for --join, held until exit like the Windows mutex
+static bool LockFirstInstance() {
+    int fd = open(RuntimeFile(".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    return fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) == 0;
+}
+
+// Append this run's phase timings and metrics where config.ini asks for them
+static void RecordRun(const char* mode, size_t folders, const FolderProcessResult& result) {
+    fs::path configPath = ConfigPath();
+    fs::path log = ReadTimingLog(configPath);
+    if (!log.empty()) {
+        AddPhaseTime(Phase::Total, ProcessAge());
+        WriteTimingRecord(log, mode, folders, result);
+    }
+    fs::path metricsFile = ReadMetricsFile(configPath);
+    if (!metricsFile.empty()) {
+        WriteMetricsFile(metricsFile);
+    }
+}
+
+static void PrintResult(const FolderProcessResult& result) {
+    std::wcout << L"Success: " << result.successCount << L"\n";
+    std::wcout << L"Failed: " << result.failureCount << L"\n";
+    if (result.bytesCopied > 0) {
+        double megabytes = result.bytesCopied / (1024.0 * 1024.0);
+        std::wcout << L"Copied across devices: " << megabytes << L" MB";
+        if (result.copySeconds > 0) {
+            std::wcout << L" (" << megabytes / result.copySeconds << L" MB/s)";
+        }
+        std::wcout << L"\n";
+    }
+    if (!result.errorMessages.empty()) {
+        std::wcout << L"\nFailed folders:\n" << result.errorMessages;
+    }
+}
+
+// Console entry point for non-Windows builds
+int main(int argc, char* argv[]) {
+    AddPhaseTime(Phase::Startup, ProcessAge());
+    std::setlocale(LC_ALL, "");
+
+    // --dry-run writes a plan (to --plan=FILE or stdout) instead of moving anything;
+    // --plan=FILE alone executes a saved plan. --join hands the folders to an
+    // instance that is already collecting (file managers start one per folder),
+    // or to a resident --daemon when one is running. --extract takes archives and
+    // unfolds them as they extract. --watch stays resident and unfolds the
+    // wrapper folders that appear in the given folders.
+    std::vector<std::wstring> allPaths;
+    bool dryRun = false;
+    bool extract = false;
+    bool join = false;
+    bool daemon = false;
+    bool watch = false;
+    bool metrics = false;
+    fs::path planFile;
+    {
+        PhaseTimer timer(Phase::Arguments);
+        for (int i = 1; i < argc; i++) {
+            if (std::strcmp(argv[i], "--dry-run") == 0) {
+                dryRun = true;
+            } else if (std::strcmp(argv[i], "--join") == 0) {
+                join = true;
+            } else if (std::strcmp(argv[i], "--daemon") == 0) {
+                daemon = true;
+            } else if (std::strcmp(argv[i], "--metrics") == 0) {
+                metrics = true;
+            } else if (std::strcmp(argv[i], "--extract") == 0) {
+                extract = true;
+            } else if (std::strcmp(argv[i], "--watch") == 0) {
+                watch = true;
+            } else if (std::strncmp(argv[i], "--plan=", 7) == 0) {
+                planFile = argv[i] + 7;
+            } else {
+                allPaths.push_back(fs::path(argv[i]).wstring());
+            }
+        }
+    }
+
+    // --metrics prints the running daemon's counters and histograms
+    if (metrics) {
+        std::string text;
+        if (!QueryDaemonMetrics(text)) {
+            std::wcerr << L"No unfolder daemon is running\n";
+            return 1;
+        }
+        std::cout << text;
+        return 0;
+    }
+
+    if (allPaths.empty() && !daemon && (dryRun || planFile.empty())) {
+        std::wcerr << L"Usage: unfolder [--dry-run] [--plan=FILE] [--join] <folder>...\n"
+                   << L"       unfolder --plan=FILE\n"
+                   << L"       unfolder --extract <archive>...\n"
+                   << L"       unfolder --watch <folder>...\n"
+                   << L"       unfolder --daemon\n"
+                   << L"       unfolder --metrics\n";
+        return 1;
+    }
+
+    PathRing ring;
+    bool receiving = false;
+    const char* handedOff = nullptr;
+    if (join && !dryRun && !extract && !watch && planFile.empty()) {
+        PhaseTimer timer(Phase::Handoff);
+        if (SubmitToDaemon(allPaths)) {
+            handedOff = "daemon-client";
+        } else if (!LockFirstInstance()) {
+            // Whatever the first instance does not take, we unfold ourselves
+            std::vector<std::wstring> undelivered = allPaths;
+            if (ring.Open(false)) {
+                undelivered.clear();
+                ring.Send(allPaths, SEND_TIMEOUT, undelivered);
+            }
+            if (undelivered.empty()) {
+                handedOff = "join";
+            }
+            allPaths = undelivered;
+        } else {
+            receiving = ring.Open(true);
+        }
+    }
+    if (handedOff != nullptr) {
+        RecordRun(handedOff, 0, FolderProcessResult{0, 0, L""});
+        return 0;
+    }
+
+    fs::path configPath;
+    UnfoldOptions options;
+    {
+        PhaseTimer timer(Phase::Config);
+        configPath = ConfigPath();
+        options = ReadUnfoldOptions(configPath);
+    }
+
+    if (extract) {
+        FolderProcessResult result = ExtractArchives(allPaths, options);
+        RecordRun("extract", allPaths.size(), result);
+        PrintResult(result);
+        return result.failureCount == 0 ? 0 : 1;
+    }
+
+    if (dryRun) {
+        UnfoldPlan plan = PlanUnfold(allPaths, options, true);
+        std::wcerr << DescribePlan(SummarizePlan(plan)) << L"\n";
+        if (planFile.empty()) {
+            std::cout << PlanToJson(plan);
+        } else if (!WritePlanFile(planFile, plan)) {
+            std::wcerr << L"Failed to write plan: " << planFile.wstring() << L"\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    // Finish or undo jobs that were interrupted last time
+    if (!options.journalDirectory.empty()) {
+        PhaseTimer timer(Phase::Recovery);
+        RecoveryResult recovery = RecoverJournals(options.journalDirectory, ReadRecoveryMode(configPath));
+        if (recovery.jobs > 0) {
+            std::wcout << L"Recovered " << recovery.jobs << L" interrupted job(s): " << recovery.restored
+                       << L" entries restored, " << recovery.failed << L" left in place\n";
+        }
+    }
+
+    if (daemon) {
+        int status = RunDaemon(configPath, [](const FolderProcessResult& result) {
+            PrintResult(result);
+            std::wcout.flush();
+        });
+        std::wcerr << L"Another unfolder daemon is already running\n";
+        return status;
+    }
+
+    if (watch) {
+        std::wstring error;
+        int status = RunWatch(allPaths, configPath, [](const FolderProcessResult& result) {
+            PrintResult(result);
+            std::wcout.flush();
+        }, error);
+        std::wcerr << error << L"\n";
+        return status;
+    }
+
+    FolderProcessResult result;
+    if (!planFile.empty()) {
+        UnfoldPlan plan;
+        if (!ReadPlanFile(planFile, plan)) {
+            std::wcerr << L"Not a valid plan file: " << planFile.wstring() << L"\n";
+            return 1;
+        }
+        result = ExecutePlan(plan, options);
+        RecordRun("plan", plan.folders.size(), result);
+    } else {
+        // Start on our own folders right away and admit the ones other instances
+        // send while the job runs
+        UnfoldJob job(options);
+        job.Add(allPaths);
+        if (receiving) {
+            AdmitPaths(ring, job);
+            std::vector<std::wstring> latePaths;
+            ring.Close(latePaths);
+            job.Add(latePaths);
+        }
+        result = job.Finish();
+        RecordRun("first", job.FolderCount(), result);
+    }
+
+    PrintResult(result);
+    return result.failureCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include "metadata.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/stat.h>
+#endif
+
+// 100 ns intervals between 1601-01-01 and 1970-01-01
+#define FILETIME_UNIX_EPOCH 116444736000000000LL
+
+#ifdef _WIN32
+bool StatPath(const fs::path& path, bool follow, PathInfo& info, std::error_code& ec) {
+    info = PathInfo();
+    ec.clear();
+    DWORD flags = FILE_FLAG_BACKUP_SEMANTICS | (follow ? 0 : FILE_FLAG_OPEN_REPARSE_POINT);
+    HANDLE handle = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL, OPEN_EXISTING, flags, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        ec = std::error_code(static_cast<int>(GetLastError()), std::system_category());
+        return false;
+    }
+    BY_HANDLE_FILE_INFORMATION file;
+    BOOL ok = GetFileInformationByHandle(handle, &file);
+    if (!ok) {
+        ec = std::error_code(static_cast<int>(GetLastError()), std::system_category());
+    }
+    CloseHandle(handle);
+    if (!ok) {
+        return false;
+    }
+
+    if (!follow && (file.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+        info.type = EntryType::Symlink;
+    } else if (file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        info.type = EntryType::Directory;
+    } else {
+        info.type = EntryType::File;
+    }
+    info.device = file.dwVolumeSerialNumber;
+    info.identity = (static_cast<uint64_t>(file.nFileIndexHigh) << 32) | file.nFileIndexLow;
+    info.size = (static_cast<uint64_t>(file.nFileSizeHigh) << 32) | file.nFileSizeLow;
+    int64_t ticks = (static_cast<int64_t>(file.ftLastWriteTime.dwHighDateTime) << 32) | file.ftLastWriteTime.dwLowDateTime;
+    info.modified = (ticks - FILETIME_UNIX_EPOCH) * 100;
+    return true;
+}
+#else
+bool StatPath(const fs::path& path, bool follow, PathInfo& info, std::error_code& ec) {
+    info = PathInfo();
+    ec.clear();
+    struct stat st;
+    if ((follow ? stat(path.c_str(), &st) : lstat(path.c_str(), &st)) != 0) {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+        info.type = EntryType::File;
+    } else if (S_ISDIR(st.st_mode)) {
+        info.type = EntryType::Directory;
+    } else if (S_ISLNK(st.st_mode)) {
+        info.type = EntryType::Symlink;
+    } else {
+        info.type = EntryType::Other;
+    }
+    info.device = static_cast<uint64_t>(st.st_dev);
+    info.identity = static_cast<uint64_t>(st.st_ino);
+    info.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+    info.modified = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    info.modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+#endif
+
+PathInfo MetadataSnapshot::Stat(const fs::path& path, std::error_code& ec) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path.native());
+        if (it != entries.end()) {
+            ec = it->second.ec;
+            return it->second.info;
+        }
+    }
+
+    // Stat outside the lock; two workers racing on one path both get the same answer
+    Entry entry;
+    StatPath(path, true, entry.info, entry.ec);
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.emplace(path.native(), entry);
+    ec = entry.ec;
+    return entry.info;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+#include "directory_reader.h"
+
+namespace fs = std::filesystem;
+
+// What one stat of a path says
+struct PathInfo {
+    EntryType type = EntryType::Unknown;   // Unknown when the path could not be read
+    uint64_t device = 0;                   // st_dev, or the volume serial number on Windows
+    uint64_t size = 0;
+    int64_t modified = 0;                  // nanoseconds since the Unix epoch
+    uint64_t identity = 0;                 // st_ino, or the file index on Windows
+
+    bool Exists() const { return type != EntryType::Unknown; }
+    bool IsDirectory() const { return type == EntryType::Directory; }
+};
+
+// One stat of path, following a final symlink only when follow is set. Never throws.
+bool StatPath(const fs::path& path, bool follow, PathInfo& info, std::error_code& ec);
+
+// Metadata a job has read, so each path is stat'd once however many folders
+// ask about it: selections sharing a parent, wrappers and the parent's device.
+// Entries are never refreshed, so only what a job does not change itself
+// (types and devices of folders it has not moved yet) should be read through it.
+// Safe to share between workers.
+class MetadataSnapshot {
+public:
+    // Follows symlinks, like fs::status
+    PathInfo Stat(const fs::path& path, std::error_code& ec);
+
+private:
+    struct Entry {
+        PathInfo info;
+        std::error_code ec;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<fs::path::string_type, Entry> entries;
+};
@@ -0,0 +1,299 @@
+#include "metrics.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Exported histogram buckets: 1 µs up to about a minute
+#define EXPORT_FIRST_NANOS 1000ULL
+#define EXPORT_LAST_NANOS (1ULL << 36)
+
+static const char* const RESOLUTION_LABELS[] = { "ask", "skip", "replace", "rename", "merge", "drop" };
+static const char* const FAILURE_LABELS[] = {
+    "invalid", "unreadable", "changed", "move_failed", "skipped", "not_empty", "delete_failed", "check_failed",
+    "journal_failed",
+};
+static const char* const OPERATION_LABELS[] = { "rename", "copy", "delete", "enumerate", "scan" };
+static_assert(sizeof(FAILURE_LABELS) / sizeof(FAILURE_LABELS[0]) == static_cast<size_t>(FolderFailure::Count),
+              "every failure needs a label");
+static_assert(sizeof(OPERATION_LABELS) / sizeof(OPERATION_LABELS[0]) == static_cast<size_t>(Operation::Count),
+              "every operation needs a label");
+
+// Shard of the calling thread, handed out round-robin as threads first touch a metric
+static size_t ThreadShard() {
+    static std::atomic<size_t> nextShard{0};
+    thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+    return shard;
+}
+
+static int HighestBit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanReverse64(&bit, value);
+    return static_cast<int>(bit);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+void Counter::Add(uint64_t n) {
+    shards[ThreadShard()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Counter::Value() const {
+    uint64_t total = 0;
+    for (const auto& shard : shards) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t Histogram::BucketOf(uint64_t nanos) {
+    if (nanos < HISTOGRAM_SUB_BUCKETS) {
+        return static_cast<size_t>(nanos);
+    }
+    int exponent = HighestBit(nanos);
+    size_t sub = static_cast<size_t>(nanos >> (exponent - 2)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::BucketEnd(size_t bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket + 1;
+    }
+    int exponent = static_cast<int>(bucket / HISTOGRAM_SUB_BUCKETS) + 1;
+    uint64_t next = HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS + 1;
+    if (exponent - 2 > 60) {
+        return UINT64_MAX; // the top bucket runs to the end of the range
+    }
+    return next << (exponent - 2);
+}
+
+void Histogram::Record(std::chrono::steady_clock::duration elapsed) {
+    int64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    uint64_t value = nanos > 0 ? static_cast<uint64_t>(nanos) : 0;
+    Shard& shard = shards[ThreadShard()];
+    shard.buckets[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.sumNanos.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Histogram::Read(uint64_t buckets[HISTOGRAM_BUCKETS], uint64_t& count, uint64_t& sumNanos) const {
+    count = 0;
+    sumNanos = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        buckets[i] = 0;
+    }
+    for (const auto& shard : shards) {
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            uint64_t n = shard.buckets[i].load(std::memory_order_relaxed);
+            buckets[i] += n;
+            count += n;
+        }
+        sumNanos += shard.sumNanos.load(std::memory_order_relaxed);
+    }
+}
+
+UnfoldMetrics& Metrics() {
+    static UnfoldMetrics metrics;
+    return metrics;
+}
+
+// One metric family and its samples, keyed by name and labels
+struct MetricFamily {
+    const char* name;
+    const char* type;
+    const char* help;
+    std::vector<std::pair<std::string, double>> samples;
+};
+
+static std::string Labeled(const char* name, const std::string& labels) {
+    return std::string(name) + "{" + labels + "}";
+}
+
+static std::string FormatValue(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.15g", value);
+    return text;
+}
+
+static std::vector<MetricFamily> CollectMetrics() {
+    UnfoldMetrics& metrics = Metrics();
+    std::vector<MetricFamily> families;
+
+    families.push_back({ "unfolder_entries_moved_total", "counter", "Entries moved, by how they were moved.", {} });
+    families.back().samples.push_back({ Labeled("unfolder_entries_moved_total", "method=\"rename\""),
+                                        static_cast<double>(metrics.entriesRenamed.Value()) });
+    families.back().samples.push_back({ Labeled("unfolder_entries_moved_total", "method=\"copy\""),
+                                        static_cast<double>(metrics.entriesCopied.Value()) });
+
+    families.push_back({ "unfolder_bytes_copied_total", "counter", "File data copied across devices.", {} });
+    families.back().samples.push_back({ "unfolder_bytes_copied_total", static_cast<double>(metrics.bytesCopied.Value()) });
+
+    families.push_back({ "unfolder_folders_unfolded_total", "counter", "Selected folders unfolded and deleted.", {} });
+    families.back().samples.push_back({ "unfolder_folders_unfolded_total",
+                                        static_cast<double>(metrics.foldersUnfolded.Value()) });
+
+    families.push_back({ "unfolder_entries_dropped_total", "counter", "Conflicting files deleted as byte-identical copies.", {} });
+    families.back().samples.push_back({ "unfolder_entries_dropped_total", static_cast<double>(metrics.entriesDropped.Value()) });
+
+    families.push_back({ "unfolder_conflicts_total", "counter", "Name conflicts, by how they were resolved.", {} });
+    for (size_t i = 0; i < sizeof(RESOLUTION_LABELS) / sizeof(RESOLUTION_LABELS[0]); i++) {
+        families.back().samples.push_back({ Labeled("unfolder_conflicts_total", std::string("resolution=\"") + RESOLUTION_LABELS[i] + "\""),
+                                            static_cast<double>(metrics.conflicts[i].Value()) });
+    }
+
+    families.push_back({ "unfolder_folder_failures_total", "counter", "Selected folders not unfolded, by reason.", {} });
+    for (size_t i = 0; i < static_cast<size_t>(FolderFailure::Count); i++) {
+        families.back().samples.push_back({ Labeled("unfolder_folder_failures_total", std::string("reason=\"") + FAILURE_LABELS[i] + "\""),
+                                            static_cast<double>(metrics.failures[i].Value()) });
+    }
+
+    families.push_back({ "unfolder_operation_duration_seconds", "histogram", "Latency of filesystem operations.", {} });
+    size_t first = Histogram::BucketOf(EXPORT_FIRST_NANOS);
+    size_t last = Histogram::BucketOf(EXPORT_LAST_NANOS);
+    for (size_t op = 0; op < static_cast<size_t>(Operation::Count); op++) {
+        uint64_t buckets[HISTOGRAM_BUCKETS];
+        uint64_t count, sumNanos;
+        metrics.latency[op].Read(buckets, count, sumNanos);
+
+        std::string label = std::string("op=\"") + OPERATION_LABELS[op] + "\"";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i <= last; i++) {
+            cumulative += buckets[i];
+            if (i >= first) {
+                std::string le = FormatValue(Histogram::BucketEnd(i) / 1e9);
+                families.back().samples.push_back({ Labeled("unfolder_operation_duration_seconds_bucket", label + ",le=\"" + le + "\""),
+                                                    static_cast<double>(cumulative) });
+            }
+        }
+        families.back().samples.push_back({ Labeled("unfolder_operation_duration_seconds_bucket", label + ",le=\"+Inf\""),
+                                            static_cast<double>(count) });
+        families.back().samples.push_back({ Labeled("unfolder_operation_duration_seconds_sum", label), sumNanos / 1e9 });
+        families.back().samples.push_back({ Labeled("unfolder_operation_duration_seconds_count", label),
+                                            static_cast<double>(count) });
+    }
+    return families;
+}
+
+static std::string RenderMetrics(const std::vector<MetricFamily>& families) {
+    std::string text;
+    for (const auto& family : families) {
+        text += std::string("# HELP ") + family.name + " " + family.help + "\n";
+        text += std::string("# TYPE ") + family.name + " " + family.type + "\n";
+        for (const auto& sample : family.samples) {
+            text += sample.first + " " + FormatValue(sample.second) + "\n";
+        }
+    }
+    return text;
+}
+
+std::string MetricsToPrometheus() {
+    return RenderMetrics(CollectMetrics());
+}
+
+// Sample values in a file written by RenderMetrics
+static std::map<std::string, double> ReadSamples(const fs::path& file) {
+    std::map<std::string, double> samples;
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t space = line.rfind(' ');
+        if (line.empty() || line[0] == '#' || space == std::string::npos) {
+            continue;
+        }
+        samples[line.substr(0, space)] = std::strtod(line.c_str() + space + 1, nullptr);
+    }
+    return samples;
+}
+
+// Exclusive lock on a companion file, held while the metrics file is merged
+class MetricsFileLock {
+public:
+    explicit MetricsFileLock(const fs::path& file) {
+        fs::path lockFile = file;
+        lockFile += ".lock";
+#ifdef _WIN32
+        handle = CreateFileW(lockFile.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                             NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        OVERLAPPED whole = {};
+        locked = handle != INVALID_HANDLE_VALUE && LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &whole);
+#else
+        fd = open(lockFile.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        locked = fd >= 0 && flock(fd, LOCK_EX) == 0;
+#endif
+    }
+
+    ~MetricsFileLock() {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+        }
+#else
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    bool locked = false;
+
+private:
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+};
+
+bool WriteMetricsFile(const fs::path& file) {
+    // What this process has already added to the file
+    static std::mutex exportMutex;
+    static std::map<std::string, double> exported;
+    std::lock_guard<std::mutex> guard(exportMutex);
+
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    MetricsFileLock lock(file);
+    if (!lock.locked) {
+        return false;
+    }
+
+    std::map<std::string, double> previous = ReadSamples(file);
+    std::map<std::string, double> current;
+    std::vector<MetricFamily> families = CollectMetrics();
+    for (auto& family : families) {
+        for (auto& sample : family.samples) {
+            current[sample.first] = sample.second;
+            sample.second += previous[sample.first] - exported[sample.first];
+        }
+    }
+
+    fs::path temp = file;
+    temp += ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out << RenderMetrics(families);
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    fs::rename(temp, file, ec);
+    if (ec) {
+        return false;
+    }
+    exported = std::move(current);
+    return true;
+}
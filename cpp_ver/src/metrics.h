@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "conflict.h"
+
+namespace fs = std::filesystem;
+
+// Shards per metric. Each thread sticks to one shard, so workers rarely share
+// a cache line and an update is one uncontended atomic add.
+#define METRIC_SHARDS 16
+
+// Log-linear histogram layout: every power of two of nanoseconds is split into
+// four linear sub-buckets, so a bucket is at most 25% wide at any scale
+#define HISTOGRAM_SUB_BUCKETS 4
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+class Counter {
+public:
+    void Add(uint64_t n = 1);
+    uint64_t Value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    Shard shards[METRIC_SHARDS];
+};
+
+// Latency distribution in nanoseconds
+class Histogram {
+public:
+    void Record(std::chrono::steady_clock::duration elapsed);
+
+    // Sum the shards: per-bucket counts, total count and total nanoseconds
+    void Read(uint64_t buckets[HISTOGRAM_BUCKETS], uint64_t& count, uint64_t& sumNanos) const;
+
+    // Bucket holding a value, and the first value past a bucket
+    static size_t BucketOf(uint64_t nanos);
+    static uint64_t BucketEnd(size_t bucket);
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS] = {};
+        std::atomic<uint64_t> sumNanos{0};
+    };
+    Shard shards[METRIC_SHARDS];
+};
+
+// Filesystem operations with a latency histogram
+enum class Operation {
+    Rename,     // one native rename
+    Copy,       // one cross-device entry (one shell call per batch on Windows)
+    Delete,     // one emptied folder
+    Enumerate,  // listing a selection and its wrappers
+    Scan,       // indexing a parent's names
+    Count
+};
+
+// Why a selected folder was not unfolded
+enum class FolderFailure {
+    Invalid,       // not a folder
+    Unreadable,
+    Changed,       // planned earlier and changed since
+    MoveFailed,    // the slow path failed or was cancelled
+    Skipped,       // the conflict policy left entries behind
+    NotEmpty,
+    DeleteFailed,
+    CheckFailed,
+    JournalFailed, // its moves could not be made durable first
+    Count
+};
+
+// Everything the engine counts, for the life of the process
+struct UnfoldMetrics {
+    Counter entriesRenamed;
+    Counter entriesCopied;
+    Counter bytesCopied;
+    Counter foldersUnfolded;
+    Counter entriesDropped;   // identical copies deleted instead of moved
+    Counter conflicts[6];   // by Resolution
+    Counter failures[static_cast<size_t>(FolderFailure::Count)];
+    Histogram latency[static_cast<size_t>(Operation::Count)];
+
+    void Conflict(Resolution resolution) { conflicts[static_cast<size_t>(resolution)].Add(); }
+    void Failure(FolderFailure reason) { failures[static_cast<size_t>(reason)].Add(); }
+    void Latency(Operation operation, std::chrono::steady_clock::duration elapsed) {
+        latency[static_cast<size_t>(operation)].Record(elapsed);
+    }
+};
+
+UnfoldMetrics& Metrics();
+
+// Every metric in the Prometheus text exposition format
+std::string MetricsToPrometheus();
+
+// Add what changed since this process last wrote file into file, so one-shot
+// instances and a daemon can share it and its counters keep growing. The file
+// is replaced atomically for a node exporter's textfile collector.
+bool WriteMetricsFile(const fs::path& file);
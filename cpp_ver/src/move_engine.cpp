@@ -0,0 +1,940 @@
+#include "move_engine.h"
+#include "directory_reader.h"
+#include "io_ring.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "path_list.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <shellapi.h>
+#include <cwctype>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Bytes handed to the kernel per copy call on the cross-device path
+#define COPY_CHUNK_SIZE (64 << 20)
+// Buffer for the last-resort read/write copy
+#define COPY_BUFFER_SIZE (1 << 20)
+// "name (n).ext" candidates tried for a file that collides inside a merge
+#define MERGE_NAME_ATTEMPTS 10000
+// Temporary sibling names tried when lifting an entry into its folder's place
+#define LIFT_NAME_ATTEMPTS 100
+
+static MoveStatus ReplaceAside(const fs::path& from, const fs::path& to, std::error_code& ec);
+
+#ifdef _WIN32
+// Volume root of a path, e.g. "C:\" or "\\server\share\"
+static std::wstring VolumeOf(const fs::path& path) {
+    wchar_t volume[MAX_PATH];
+    if (!GetVolumePathNameW(path.c_str(), volume, MAX_PATH)) {
+        return L"";
+    }
+    std::wstring result = volume;
+    for (auto& ch : result) {
+        ch = static_cast<wchar_t>(std::towlower(ch));
+    }
+    return result;
+}
+
+bool SameDevice(const fs::path& a, const fs::path& b) {
+    std::wstring volumeA = VolumeOf(a);
+    return !volumeA.empty() && volumeA == VolumeOf(b);
+}
+
+static MoveStatus NativeRenameNoReplace(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    ec.clear();
+    // No MOVEFILE_COPY_ALLOWED: a cross-volume move must fail instead of copying
+    if (MoveFileExW(from.c_str(), to.c_str(), 0)) {
+        return MoveStatus::Moved;
+    }
+
+    DWORD err = GetLastError();
+    ec = std::error_code(static_cast<int>(err), std::system_category());
+    switch (err) {
+    case ERROR_ALREADY_EXISTS:
+    case ERROR_FILE_EXISTS:
+        return MoveStatus::Exists;
+    case ERROR_NOT_SAME_DEVICE:
+        return MoveStatus::CrossDevice;
+    default:
+        return MoveStatus::Failed;
+    }
+}
+
+// MoveFileExW has no exchange; callers fall back to ReplaceAside
+static MoveStatus NativeRenameExchange(const fs::path&, const fs::path&, std::error_code& ec) {
+    ec = std::make_error_code(std::errc::not_supported);
+    return MoveStatus::Failed;
+}
+
+static MoveStatus NativeRenameReplace(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    // Only file over file can be replaced in one step
+    if (fs::is_directory(fs::symlink_status(from, ec)) || fs::is_directory(fs::symlink_status(to, ec))) {
+        return ReplaceAside(from, to, ec);
+    }
+
+    ec.clear();
+    if (MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        return MoveStatus::Moved;
+    }
+
+    DWORD err = GetLastError();
+    ec = std::error_code(static_cast<int>(err), std::system_category());
+    return err == ERROR_NOT_SAME_DEVICE ? MoveStatus::CrossDevice : MoveStatus::Failed;
+}
+
+// 使用 `SHFileOperationW` 移动文件，确保冲突处理正确
+void MoveSlowPath(const std::vector<MoveItem>& items, MoveReport& report) {
+    if (items.empty()) {
+        return;
+    }
+
+    // Double-null lists for the shell, sized up front
+    PathList fromPaths;
+    PathList toPaths;
+    for (const auto& item : items) {
+        fromPaths.Measure(item.from);
+        toPaths.Measure(item.to);
+    }
+    fromPaths.Reserve();
+    toPaths.Reserve();
+    for (const auto& item : items) {
+        fromPaths.Append(item.from);
+        toPaths.Append(item.to);
+    }
+
+    TraceSpan span("fs", "copy batch");
+    auto start = std::chrono::steady_clock::now();
+    SHFILEOPSTRUCTW fileOp = { 0 };
+    fileOp.wFunc = FO_MOVE;
+    fileOp.pFrom = fromPaths.DoubleNull();
+    fileOp.pTo = toPaths.DoubleNull();
+    fileOp.fFlags = FOF_ALLOWUNDO | FOF_MULTIDESTFILES; // 保留原生的文件冲突提示框
+
+    int result = SHFileOperationW(&fileOp);
+    if (result != 0 || fileOp.fAnyOperationsAborted) {
+        for (size_t i = 0; i < fromPaths.Size(); i++) {
+            std::wcout << L"file not moved: " << fromPaths[i] << L"\n"; // 记录未移动的文件
+        }
+        report.aborted = fileOp.fAnyOperationsAborted != FALSE;
+    }
+
+    // The shell does not say which entries it skipped, so look at what is left behind
+    for (size_t i = 0; i < items.size(); i++) {
+        std::error_code ec;
+        if (fs::exists(items[i].from, ec)) {
+            report.failed.push_back(i);
+        } else {
+            report.slowMoved++;
+        }
+    }
+
+    // The shell moves the batch in one call, so the batch is one copy sample
+    Metrics().Latency(Operation::Copy, std::chrono::steady_clock::now() - start);
+    Metrics().entriesCopied.Add(report.slowMoved);
+}
+
+// Copy from into a new entry at to; links are copied as links. Never replaces
+// an existing destination.
+static bool CopyTree(const fs::path& from, const fs::path& to, uint64_t& bytes, std::error_code& ec) {
+    fs::copy(from, to, fs::copy_options::recursive | fs::copy_options::copy_symlinks, ec);
+    if (ec) {
+        return false;
+    }
+    std::error_code sizeEc;
+    if (fs::is_regular_file(fs::symlink_status(to, sizeEc))) {
+        bytes += fs::file_size(to, sizeEc);
+    }
+    for (fs::recursive_directory_iterator it(to, sizeEc), end; !sizeEc && it != end; it.increment(sizeEc)) {
+        if (it->is_regular_file(sizeEc) && !it->is_symlink(sizeEc)) {
+            bytes += it->file_size(sizeEc);
+        }
+    }
+    return true;
+}
+
+static bool NativeRemoveEmptyFolder(const fs::path& folder) {
+    // The shell deletes whole trees, so an entry that appeared since planning
+    // must stop it here; one short read, not a second directory scan
+    uint64_t probe[512];
+    DirectoryReader reader(probe, sizeof(probe));
+    DirectoryEntry entry;
+    std::error_code ec;
+    if (!reader.Open(folder, ec) || reader.Next(entry, ec) || ec) {
+        return false;
+    }
+    reader.Close();
+
+    PathList folderList;
+    folderList.Measure(folder);
+    folderList.Reserve();
+    folderList.Append(folder);
+    SHFILEOPSTRUCTW delOp = { 0 };
+    delOp.wFunc = FO_DELETE;
+    delOp.pFrom = folderList.DoubleNull();
+    delOp.fFlags = FOF_ALLOWUNDO | FOF_NOCONFIRMATION;
+
+    return (SHFileOperationW(&delOp) == 0);
+}
+#else
+bool SameDevice(const fs::path& a, const fs::path& b) {
+    struct stat statA, statB;
+    if (stat(a.c_str(), &statA) != 0 || stat(b.c_str(), &statB) != 0) {
+        return false;
+    }
+    return statA.st_dev == statB.st_dev;
+}
+
+// Check-then-rename for filesystems without RENAME_NOREPLACE; not atomic
+static MoveStatus RenameIfAbsent(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    struct stat st;
+    if (lstat(to.c_str(), &st) == 0) {
+        ec = std::make_error_code(std::errc::file_exists);
+        return MoveStatus::Exists;
+    }
+    if (rename(from.c_str(), to.c_str()) == 0) {
+        return MoveStatus::Moved;
+    }
+    ec = std::error_code(errno, std::generic_category());
+    return errno == EXDEV ? MoveStatus::CrossDevice : MoveStatus::Failed;
+}
+
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+// Outcome of a renameat2(RENAME_NOREPLACE) that failed with err, however it was issued
+static MoveStatus RenameNoReplaceFailed(int err, const fs::path& from, const fs::path& to, std::error_code& ec) {
+    ec = std::error_code(err, std::generic_category());
+    switch (err) {
+    case EEXIST:
+    case ENOTEMPTY:
+        return MoveStatus::Exists;
+    case EXDEV:
+        return MoveStatus::CrossDevice;
+    case EINVAL:
+    case ENOSYS:
+        // The filesystem does not support the flag (older NFS, some FUSE mounts)
+        ec.clear();
+        return RenameIfAbsent(from, to, ec);
+    default:
+        return MoveStatus::Failed;
+    }
+}
+#endif
+
+static MoveStatus NativeRenameNoReplace(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    ec.clear();
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+    if (renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0) {
+        return MoveStatus::Moved;
+    }
+    return RenameNoReplaceFailed(errno, from, to, ec);
+#else
+    return RenameIfAbsent(from, to, ec);
+#endif
+}
+
+static MoveStatus NativeRenameExchange(const fs::path& a, const fs::path& b, std::error_code& ec) {
+    ec.clear();
+#if defined(__linux__) && defined(RENAME_EXCHANGE)
+    if (renameat2(AT_FDCWD, a.c_str(), AT_FDCWD, b.c_str(), RENAME_EXCHANGE) == 0) {
+        return MoveStatus::Moved;
+    }
+    int err = errno;
+    ec = std::error_code(err == EINVAL || err == ENOSYS ? ENOTSUP : err, std::generic_category());
+    return err == EXDEV ? MoveStatus::CrossDevice : MoveStatus::Failed;
+#else
+    ec = std::make_error_code(std::errc::not_supported);
+    return MoveStatus::Failed;
+#endif
+}
+
+static MoveStatus NativeRenameReplace(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    // Only file over file can be replaced in one step
+    struct stat fromStat, toStat;
+    bool fromIsDir = lstat(from.c_str(), &fromStat) == 0 && S_ISDIR(fromStat.st_mode);
+    bool toExists = lstat(to.c_str(), &toStat) == 0;
+    bool toIsDir = toExists && S_ISDIR(toStat.st_mode);
+    if (!toExists) {
+        return NativeRenameNoReplace(from, to, ec);
+    }
+    if (fromIsDir || toIsDir) {
+        // Swap first and delete the old destination from the source's place,
+        // so a rename that fails never costs the destination
+        if (NativeRenameExchange(from, to, ec) == MoveStatus::Moved) {
+            fs::remove_all(from, ec);
+            ec.clear();
+            return MoveStatus::Moved;
+        }
+        if (ec != std::errc::not_supported) {
+            return ec.value() == EXDEV ? MoveStatus::CrossDevice : MoveStatus::Failed;
+        }
+        return ReplaceAside(from, to, ec);
+    }
+
+    ec.clear();
+    if (rename(from.c_str(), to.c_str()) == 0) {
+        return MoveStatus::Moved;
+    }
+    ec = std::error_code(errno, std::generic_category());
+    return errno == EXDEV ? MoveStatus::CrossDevice : MoveStatus::Failed;
+}
+
+// Copy file contents without a userspace buffer where the kernel allows it:
+// copy_file_range, then sendfile, then plain read/write
+static bool CopyFileData(int in, int out, off_t size, uint64_t& bytes) {
+    off_t done = 0;
+#ifdef __linux__
+    bool useCopyRange = true;
+    bool useSendfile = true;
+    while (done < size && useCopyRange) {
+        ssize_t n = copy_file_range(in, nullptr, out, nullptr, COPY_CHUNK_SIZE, 0);
+        if (n > 0) {
+            done += n;
+        } else if (n == 0) {
+            break; // file shrank underneath us
+        } else if (done == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+            useCopyRange = false; // unsupported for this pair of filesystems
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+    if (useCopyRange) {
+        bytes += done;
+        return true;
+    }
+
+    while (done < size && useSendfile) {
+        ssize_t n = sendfile(out, in, nullptr, COPY_CHUNK_SIZE);
+        if (n > 0) {
+            done += n;
+        } else if (n == 0) {
+            break;
+        } else if (done == 0 && (errno == EINVAL || errno == ENOSYS)) {
+            useSendfile = false;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+    if (useSendfile) {
+        bytes += done;
+        return true;
+    }
+#endif
+
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    std::vector<char> buffer(COPY_BUFFER_SIZE);
+    while (true) {
+        ssize_t n = read(in, buffer.data(), buffer.size());
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        for (ssize_t written = 0; written < n;) {
+            ssize_t w = write(out, buffer.data() + written, n - written);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            written += w;
+        }
+        done += n;
+    }
+    bytes += done;
+    return true;
+}
+
+// Recursively copy from into a new entry at to, keeping modes and timestamps.
+// Never replaces an existing destination.
+static bool CopyTree(const fs::path& from, const fs::path& to, uint64_t& bytes, std::error_code& ec) {
+    struct stat st;
+    if (lstat(from.c_str(), &st) != 0) {
+        ec = std::error_code(errno, std::generic_category());
+        return false;
+    }
+    const struct timespec times[2] = { st.st_atim, st.st_mtim };
+
+    if (S_ISREG(st.st_mode)) {
+        int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            ec = std::error_code(errno, std::generic_category());
+            return false;
+        }
+        int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+        if (out < 0) {
+            ec = std::error_code(errno, std::generic_category());
+            close(in);
+            return false;
+        }
+
+        bool ok = CopyFileData(in, out, st.st_size, bytes)
+               && fchmod(out, st.st_mode & 07777) == 0
+               && futimens(out, times) == 0;
+        if (!ok) {
+            ec = std::error_code(errno, std::generic_category());
+        }
+        close(in);
+        if (close(out) != 0 && ok) {
+            ec = std::error_code(errno, std::generic_category());
+            ok = false;
+        }
+        if (!ok) {
+            unlink(to.c_str());
+        }
+        return ok;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        std::error_code linkEc;
+        fs::path target = fs::read_symlink(from, linkEc);
+        if (linkEc || symlink(target.c_str(), to.c_str()) != 0) {
+            ec = linkEc ? linkEc : std::error_code(errno, std::generic_category());
+            return false;
+        }
+        utimensat(AT_FDCWD, to.c_str(), times, AT_SYMLINK_NOFOLLOW);
+        return true;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (mkdir(to.c_str(), 0700) != 0) {
+            ec = std::error_code(errno, std::generic_category());
+            return false;
+        }
+        for (const auto& entry : fs::directory_iterator(from, ec)) {
+            if (!CopyTree(entry.path(), ChildPath(to, entry.path()), bytes, ec)) {
+                return false;
+            }
+        }
+        if (ec) {
+            return false;
+        }
+        // Directory times last, after the children have stopped touching them
+        chmod(to.c_str(), st.st_mode & 07777);
+        utimensat(AT_FDCWD, to.c_str(), times, 0);
+        return true;
+    }
+
+    ec = std::make_error_code(std::errc::not_supported); // devices, fifos, sockets
+    return false;
+}
+
+// Copy across devices and delete the source once the copy is complete.
+// There is no conflict dialog here, so a taken destination is reported as a failure.
+void MoveSlowPath(const std::vector<MoveItem>& items, MoveReport& report) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < items.size(); i++) {
+        const auto& item = items[i];
+        std::error_code ec;
+        if (fs::exists(fs::symlink_status(item.to, ec))) {
+            report.failed.push_back(i);
+            continue;
+        }
+
+        TraceSpan span("fs", "copy", item.from);
+        auto itemStart = std::chrono::steady_clock::now();
+        uint64_t bytes = 0;
+        if (CopyTree(item.from, item.to, bytes, ec)) {
+            fs::remove_all(item.from, ec); // only once the whole copy has succeeded
+        } else {
+            std::error_code cleanupEc;
+            fs::remove_all(item.to, cleanupEc);
+        }
+        report.bytesCopied += bytes;
+        Metrics().Latency(Operation::Copy, std::chrono::steady_clock::now() - itemStart);
+        Metrics().bytesCopied.Add(bytes);
+
+        if (ec) {
+            std::cerr << "file not moved: " << item.from.string() << ": " << ec.message() << "\n";
+            report.failed.push_back(i);
+        } else {
+            report.slowMoved++;
+            Metrics().entriesCopied.Add();
+        }
+    }
+    report.copySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool NativeRemoveEmptyFolder(const fs::path& folder) {
+    return rmdir(folder.c_str()) == 0;
+}
+#endif
+
+// Every rename and folder delete is timed and counted here, whoever asked for it
+MoveStatus RenameNoReplace(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    TraceSpan span("fs", "rename");
+    auto start = std::chrono::steady_clock::now();
+    MoveStatus status = NativeRenameNoReplace(from, to, ec);
+    Metrics().Latency(Operation::Rename, std::chrono::steady_clock::now() - start);
+    if (status == MoveStatus::Moved) {
+        Metrics().entriesRenamed.Add();
+    }
+    return status;
+}
+
+MoveStatus RenameReplace(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    TraceSpan span("fs", "rename replace");
+    auto start = std::chrono::steady_clock::now();
+    MoveStatus status = NativeRenameReplace(from, to, ec);
+    Metrics().Latency(Operation::Rename, std::chrono::steady_clock::now() - start);
+    if (status == MoveStatus::Moved) {
+        Metrics().entriesRenamed.Add();
+    }
+    return status;
+}
+
+MoveStatus CopyReplace(const fs::path& from, const fs::path& to, uint64_t& bytes, std::error_code& ec) {
+    TraceSpan span("fs", "copy replace", from);
+    auto start = std::chrono::steady_clock::now();
+    fs::path temp = LiftTempPath(to);
+    if (temp.empty()) {
+        ec = std::make_error_code(std::errc::file_exists);
+        return MoveStatus::Failed;
+    }
+    uint64_t copied = 0;
+    bool ok = CopyTree(from, temp, copied, ec) && RenameReplace(temp, to, ec) == MoveStatus::Moved;
+    bytes += copied;
+    Metrics().Latency(Operation::Copy, std::chrono::steady_clock::now() - start);
+    Metrics().bytesCopied.Add(copied);
+    if (!ok) {
+        std::error_code cleanupEc;
+        fs::remove_all(temp, cleanupEc); // to is untouched
+        return MoveStatus::Failed;
+    }
+    Metrics().entriesCopied.Add();
+    fs::remove_all(from, ec); // only once the copy has taken to's place
+    return ec ? MoveStatus::Failed : MoveStatus::Moved;
+}
+
+void RemoveEmptyFolderChains(const std::vector<const std::vector<fs::path>*>& chains, unsigned ringDepth,
+                             std::vector<bool>& removed) {
+    removed.assign(chains.size(), false);
+#ifdef __linux__
+    IoRing* ring = chains.size() > 1 ? ThreadRing(ringDepth) : nullptr;
+    if (ring != nullptr) {
+        // Each chain is linked bottom-up, so a wrapper goes only after its child
+        std::vector<RingOp> ops;
+        std::vector<size_t> owner;
+        for (size_t c = 0; c < chains.size(); c++) {
+            for (auto it = chains[c]->rbegin(); it != chains[c]->rend(); ++it) {
+                RingOp op;
+                op.kind = RingOp::Unlink;
+                op.path = it->c_str();
+                op.flags = AT_REMOVEDIR;
+                op.linked = it + 1 != chains[c]->rend();
+                ops.push_back(op);
+                owner.push_back(c);
+            }
+        }
+        if (ring->Run(ops)) {
+            std::vector<bool> failed(chains.size(), false);
+            for (size_t i = 0; i < ops.size(); i++) {
+                Metrics().Latency(Operation::Delete, std::chrono::nanoseconds(ops[i].nanos));
+                failed[owner[i]] = failed[owner[i]] || ops[i].result != 0;
+            }
+            for (size_t c = 0; c < chains.size(); c++) {
+                removed[c] = !failed[c];
+            }
+            return;
+        }
+        // Chains that did not fit the ring, or a failed ring: finish synchronously
+        for (size_t c = 0; c < chains.size(); c++) {
+            for (auto it = chains[c]->rbegin(); it != chains[c]->rend(); ++it) {
+                std::error_code ec;
+                if (fs::exists(fs::symlink_status(*it, ec)) && !RemoveEmptyFolder(*it)) {
+                    break;
+                }
+            }
+            std::error_code ec;
+            removed[c] = !fs::exists(fs::symlink_status(chains[c]->front(), ec));
+        }
+        return;
+    }
+#endif
+    for (size_t c = 0; c < chains.size(); c++) {
+        bool ok = true;
+        for (auto it = chains[c]->rbegin(); ok && it != chains[c]->rend(); ++it) {
+            ok = RemoveEmptyFolder(*it);
+        }
+        removed[c] = ok;
+    }
+}
+
+void RenameNoReplaceBatch(const std::vector<const MoveItem*>& items, unsigned ringDepth, std::vector<MoveStatus>& statuses) {
+    statuses.assign(items.size(), MoveStatus::Failed);
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+    IoRing* ring = items.size() > 1 ? ThreadRing(ringDepth) : nullptr;
+    if (ring != nullptr) {
+        TraceSpan span("fs", "rename batch");
+        std::vector<RingOp> ops(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            ops[i].kind = RingOp::Rename;
+            ops[i].path = items[i]->from.c_str();
+            ops[i].target = items[i]->to.c_str();
+            ops[i].flags = RENAME_NOREPLACE;
+        }
+        bool ran = ring->Run(ops);
+        for (size_t i = 0; i < items.size(); i++) {
+            std::error_code ec;
+            if (!ran && ops[i].result == -ECANCELED) {
+                statuses[i] = RenameNoReplace(items[i]->from, items[i]->to, ec);
+                continue;
+            }
+            Metrics().Latency(Operation::Rename, std::chrono::nanoseconds(ops[i].nanos));
+            statuses[i] = ops[i].result == 0 ? MoveStatus::Moved
+                                             : RenameNoReplaceFailed(-ops[i].result, items[i]->from, items[i]->to, ec);
+            if (statuses[i] == MoveStatus::Moved) {
+                Metrics().entriesRenamed.Add();
+            }
+        }
+        return;
+    }
+#endif
+    for (size_t i = 0; i < items.size(); i++) {
+        std::error_code ec;
+        statuses[i] = RenameNoReplace(items[i]->from, items[i]->to, ec);
+    }
+}
+
+MoveStatus RenameExchange(const fs::path& a, const fs::path& b, std::error_code& ec) {
+    TraceSpan span("fs", "rename exchange");
+    auto start = std::chrono::steady_clock::now();
+    MoveStatus status = NativeRenameExchange(a, b, ec);
+    Metrics().Latency(Operation::Rename, std::chrono::steady_clock::now() - start);
+    return status;
+}
+
+bool RemoveEmptyFolder(const fs::path& folder) {
+    auto start = std::chrono::steady_clock::now();
+    bool removed = NativeRemoveEmptyFolder(folder);
+    Metrics().Latency(Operation::Delete, std::chrono::steady_clock::now() - start);
+    return removed;
+}
+
+fs::path LiftTempPath(const fs::path& folder) {
+    for (int n = 0; n < LIFT_NAME_ATTEMPTS; n++) {
+        fs::path name = ".";
+        name += folder.filename();
+        name += ".unfold" + (n == 0 ? std::string() : "-" + std::to_string(n));
+        fs::path temp = folder.parent_path() / name;
+        std::error_code ec;
+        if (!fs::exists(fs::symlink_status(temp, ec))) {
+            return temp;
+        }
+    }
+    return fs::path();
+}
+
+// Replace to with from where the two cannot be exchanged: to moves aside to a
+// free hidden sibling, from takes its name, and only then is the old entry
+// deleted. If from cannot move, to is put back.
+static MoveStatus ReplaceAside(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    fs::path aside = LiftTempPath(to);
+    if (aside.empty()) {
+        ec = std::make_error_code(std::errc::file_exists);
+        return MoveStatus::Failed;
+    }
+    if (NativeRenameNoReplace(to, aside, ec) != MoveStatus::Moved) {
+        return MoveStatus::Failed;
+    }
+    MoveStatus status = NativeRenameNoReplace(from, to, ec);
+    std::error_code cleanupEc;
+    if (status != MoveStatus::Moved) {
+        NativeRenameNoReplace(aside, to, cleanupEc);
+        return status;
+    }
+    fs::remove_all(aside, cleanupEc);
+    return MoveStatus::Moved;
+}
+
+bool LiftIntoPlace(const fs::path& entry, const std::vector<fs::path>& chain, const fs::path& temp) {
+    TraceSpan span("fs", "lift into place", entry);
+    std::error_code ec;
+    if (temp.empty() || RenameNoReplace(entry, temp, ec) != MoveStatus::Moved) {
+        return false;
+    }
+    return FinishLift(entry, chain, temp);
+}
+
+bool FinishLift(const fs::path& entry, const std::vector<fs::path>& chain, const fs::path& temp) {
+    const fs::path& folder = chain.front();
+    std::error_code ec;
+
+    // Undo: the wrappers already removed are recreated and entry goes back where it was
+    auto putBack = [&]() {
+        fs::create_directories(entry.parent_path(), ec);
+        RenameNoReplace(temp, entry, ec);
+        return false;
+    };
+
+    // Wrappers below the folder, bottom-up
+    for (size_t i = chain.size(); i-- > 1;) {
+        if (!RemoveEmptyFolder(chain[i]) && fs::exists(fs::symlink_status(chain[i], ec))) {
+            return putBack();
+        }
+    }
+
+    if (RenameExchange(temp, folder, ec) == MoveStatus::Moved) {
+        // temp now names the drained folder
+        if (RemoveEmptyFolder(temp)) {
+            return true;
+        }
+        RenameExchange(temp, folder, ec);
+        return putBack();
+    }
+
+    // No exchange on this filesystem: the name is briefly free
+    if (!RemoveEmptyFolder(folder)) {
+        return putBack();
+    }
+    return RenameNoReplace(temp, folder, ec) == MoveStatus::Moved;
+}
+
+bool ExchangeSupported(const fs::path& folder) {
+#if defined(__linux__) && defined(RENAME_EXCHANGE)
+    struct stat info;
+    if (stat(folder.c_str(), &info) != 0) {
+        return false;
+    }
+    static std::mutex mutex;
+    static std::map<dev_t, bool> probed;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = probed.find(info.st_dev);
+    if (it != probed.end()) {
+        return it->second;
+    }
+
+    // Two empty folders are swapped and removed; a folder that cannot be
+    // written says nothing about the filesystem, so it is not remembered
+    std::string stem = ".unfold-probe-" + std::to_string(getpid());
+    fs::path a = folder / (stem + "-a");
+    fs::path b = folder / (stem + "-b");
+    if (mkdir(a.c_str(), 0700) != 0) {
+        return false;
+    }
+    bool created = mkdir(b.c_str(), 0700) == 0;
+    bool supported = created && renameat2(AT_FDCWD, a.c_str(), AT_FDCWD, b.c_str(), RENAME_EXCHANGE) == 0;
+    rmdir(a.c_str());
+    rmdir(b.c_str());
+    if (created) {
+        probed[info.st_dev] = supported;
+    }
+    return supported;
+#else
+    (void)folder;
+    return false;
+#endif
+}
+
+// A pair of folders with the same name being fused by MergeFolders
+struct MergeTask {
+    fs::path from;
+    fs::path to;
+    size_t root;    // the item it belongs to
+    size_t depth;
+};
+
+// State shared by the threads of one MergeFolders call
+struct MergeWork {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<MergeTask> pending;
+    std::vector<MergeTask> done;      // source folders to delete once every level has moved
+    std::vector<std::thread> helpers;
+    std::vector<bool> failed;         // by item
+    size_t busy = 0;
+    size_t maxThreads = 1;
+};
+
+// Move a colliding entry into folder under the first free "name (n).ext"
+static MoveStatus RenameToFreeName(const fs::path& from, const fs::path& folder, const fs::path& name, bool isFolder) {
+    fs::path stem = isFolder ? name : name.stem();
+    fs::path extension = isFolder ? fs::path() : name.extension();
+    for (int n = 2; n < MERGE_NAME_ATTEMPTS; n++) {
+        fs::path candidate = stem;
+        candidate += " (" + std::to_string(n) + ")";
+        candidate += extension;
+        std::error_code ec;
+        MoveStatus status = RenameNoReplace(from, folder / candidate, ec);
+        if (status != MoveStatus::Exists) {
+            return status;
+        }
+    }
+    return MoveStatus::Exists;
+}
+
+// Move every entry of one source folder into its destination; folders that
+// collide with a folder become new tasks. False if anything stays behind.
+static bool MergeLevel(const MergeTask& task, std::vector<MergeTask>& collisions) {
+    TraceSpan span("fs", "merge folder", task.from);
+    // Names are read up front rather than renamed out from under the reader
+    std::vector<fs::path> names;
+    std::vector<EntryType> types;
+    {
+        DirectoryReader reader(ThreadDirectoryBuffer(), DIRECTORY_BUFFER_SIZE);
+        DirectoryEntry entry;
+        std::error_code ec;
+        if (reader.Open(task.from, ec)) {
+            while (reader.Next(entry, ec)) {
+                names.emplace_back(fs::path::string_type(entry.name));
+                types.push_back(entry.type);
+            }
+        }
+        if (ec) {
+            return false;
+        }
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < names.size(); i++) {
+        fs::path from = task.from / names[i];
+        fs::path to = task.to / names[i];
+        std::error_code ec;
+        MoveStatus status = RenameNoReplace(from, to, ec);
+        if (status == MoveStatus::Exists) {
+            PathInfo source, target;
+            if (types[i] == EntryType::Unknown) {
+                StatPath(from, false, source, ec);
+                types[i] = source.type;
+            }
+            bool isFolder = types[i] == EntryType::Directory;
+            if (isFolder && StatPath(to, false, target, ec) && target.IsDirectory()) {
+                collisions.push_back({ from, to, task.root, task.depth + 1 });
+                continue;
+            }
+            status = RenameToFreeName(from, task.to, names[i], isFolder);
+        }
+        ok = ok && status == MoveStatus::Moved;
+    }
+    return ok;
+}
+
+// Take tasks until every level has been merged. Helpers start only once there
+// is more queued than the running threads can take.
+static void MergeWorker(MergeWork& work) {
+    std::unique_lock<std::mutex> lock(work.mutex);
+    for (;;) {
+        work.changed.wait(lock, [&work] { return !work.pending.empty() || work.busy == 0; });
+        if (work.pending.empty()) {
+            return;
+        }
+        MergeTask task = std::move(work.pending.front());
+        work.pending.pop_front();
+        work.busy++;
+        if (!work.pending.empty() && work.helpers.size() + 1 < work.maxThreads) {
+            work.helpers.emplace_back(MergeWorker, std::ref(work));
+        }
+        lock.unlock();
+
+        std::vector<MergeTask> collisions;
+        bool ok = MergeLevel(task, collisions);
+
+        lock.lock();
+        if (!ok) {
+            work.failed[task.root] = true;
+        }
+        for (auto& collision : collisions) {
+            work.pending.push_back(std::move(collision));
+        }
+        work.done.push_back(std::move(task));
+        work.busy--;
+        work.changed.notify_all();
+    }
+}
+
+void MergeFolders(const std::vector<const MoveItem*>& items, std::vector<bool>& merged, int workers) {
+    TraceSpan span("fs", "merge folders");
+    MergeWork work;
+    work.failed.assign(items.size(), false);
+    unsigned cores = std::thread::hardware_concurrency();
+    work.maxThreads = workers > 0 ? static_cast<size_t>(workers) : cores > 0 ? cores : 1;
+    for (size_t i = 0; i < items.size(); i++) {
+        // The folder planned as a merge target may have gone since
+        std::error_code ec;
+        MoveStatus status = RenameNoReplace(items[i]->from, items[i]->to, ec);
+        PathInfo target;
+        if (status == MoveStatus::Exists && StatPath(items[i]->to, false, target, ec) && target.IsDirectory()) {
+            work.pending.push_back({ items[i]->from, items[i]->to, i, 0 });
+        } else if (status != MoveStatus::Moved) {
+            work.failed[i] = true;
+        }
+    }
+
+    MergeWorker(work);
+    for (auto& helper : work.helpers) {
+        helper.join();
+    }
+
+    // Emptied source folders go bottom-up; one that is not empty keeps its item unmerged
+    std::stable_sort(work.done.begin(), work.done.end(),
+                     [](const MergeTask& a, const MergeTask& b) { return a.depth > b.depth; });
+    for (const auto& task : work.done) {
+        if (!RemoveEmptyFolder(task.from)) {
+            work.failed[task.root] = true;
+        }
+    }
+    merged.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        merged[i] = !work.failed[i];
+    }
+}
+
+MoveReport MoveEntries(const std::vector<MoveItem>& items, bool sameDevice, unsigned ringDepth) {
+    MoveReport report;
+    if (!sameDevice) {
+        MoveSlowPath(items, report);
+        return report;
+    }
+
+    std::vector<const MoveItem*> batch;
+    batch.reserve(items.size());
+    for (const auto& item : items) {
+        batch.push_back(&item);
+    }
+    std::vector<MoveStatus> statuses;
+    RenameNoReplaceBatch(batch, ringDepth, statuses);
+
+    std::vector<MoveItem> leftovers;
+    std::vector<size_t> leftoverIndex;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (statuses[i] == MoveStatus::Moved) {
+            report.renamed++;
+        } else {
+            leftovers.push_back(items[i]);
+            leftoverIndex.push_back(i);
+        }
+    }
+
+    MoveReport slow;
+    MoveSlowPath(leftovers, slow);
+    report.slowMoved = slow.slowMoved;
+    report.bytesCopied = slow.bytesCopied;
+    report.copySeconds = slow.copySeconds;
+    report.aborted = slow.aborted;
+    for (size_t index : slow.failed) {
+        report.failed.push_back(leftoverIndex[index]);
+    }
+    return report;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Outcome of a single native move attempt
+enum class MoveStatus {
+    Moved,        // renamed in place
+    Exists,       // destination name is already taken
+    CrossDevice,  // source and destination live on different volumes
+    Failed        // any other error, see the error_code
+};
+
+// One entry to move from its folder into the destination
+struct MoveItem {
+    fs::path from;
+    fs::path to;
+};
+
+// Result of moving a batch of entries
+struct MoveReport {
+    size_t renamed = 0;           // moved by a native rename
+    size_t slowMoved = 0;         // moved by the fallback path
+    std::vector<size_t> failed;   // indices of entries still at their source
+    bool aborted = false;         // user cancelled the fallback operation
+    uint64_t bytesCopied = 0;     // file data copied across devices
+    double copySeconds = 0;       // time spent in the cross-device path
+};
+
+// True when both paths are on the same volume, so a rename can move between them
+bool SameDevice(const fs::path& a, const fs::path& b);
+
+// Atomic rename that never replaces an existing destination
+// (renameat2 RENAME_NOREPLACE on Linux, MoveFileExW without REPLACE_EXISTING on Windows)
+MoveStatus RenameNoReplace(const fs::path& from, const fs::path& to, std::error_code& ec);
+
+// RenameNoReplace for many entries, statuses[i] receiving the outcome of
+// items[i]. With ringDepth > 0 they go through the calling thread's io_uring
+// in batches of that depth; without io_uring, one syscall each.
+void RenameNoReplaceBatch(const std::vector<const MoveItem*>& items, unsigned ringDepth, std::vector<MoveStatus>& statuses);
+
+// Rename over an existing destination. A file replaces a file atomically; when
+// either side is a folder the two are exchanged and the old destination deleted
+// afterwards. Where the filesystem cannot exchange (always on Windows), the old
+// destination is renamed aside first, put back if the move fails, and deleted
+// only once the move succeeds.
+MoveStatus RenameReplace(const fs::path& from, const fs::path& to, std::error_code& ec);
+
+// Replace to with a copy of from on another device: from is copied to a hidden
+// sibling of to (LiftTempPath), which is then renamed over to with RenameReplace,
+// and from is deleted last. A failed copy or rename leaves to as it was. bytes
+// grows by the bytes copied.
+MoveStatus CopyReplace(const fs::path& from, const fs::path& to, uint64_t& bytes, std::error_code& ec);
+
+// Swap two entries in one step (renameat2 RENAME_EXCHANGE). Fails with
+// not_supported where the platform or the filesystem cannot exchange.
+MoveStatus RenameExchange(const fs::path& a, const fs::path& b, std::error_code& ec);
+
+// A free hidden sibling of folder (".name.unfold", ".name.unfold-2", ...) to
+// hold an entry while it is lifted or copied, or empty if none is found
+fs::path LiftTempPath(const fs::path& folder);
+
+// Put entry, the last thing left in a drained chain, in the place of the chain's
+// top folder, whose name it shares: entry moves to temp (from LiftTempPath), the
+// wrappers are removed and temp is exchanged with the folder, so the name never
+// goes missing where the filesystem can exchange. A constant number of renames
+// however large entry is. Undone if a folder turns out not to be empty.
+bool LiftIntoPlace(const fs::path& entry, const std::vector<fs::path>& chain, const fs::path& temp);
+
+// The rest of LiftIntoPlace once entry is at temp. Wrappers already gone are
+// skipped, so an interrupted lift can be finished. On failure the wrappers are
+// recreated and entry goes back to its own path.
+bool FinishLift(const fs::path& entry, const std::vector<fs::path>& chain, const fs::path& temp);
+
+// Whether RenameExchange works on folder's filesystem. Probed once per device
+// by swapping two empty folders created in folder.
+bool ExchangeSupported(const fs::path& folder);
+
+// Move entries that could not be renamed: conflicts and cross-device entries.
+// On Windows this is SHFileOperationW, which keeps the native conflict dialog.
+// Elsewhere cross-device entries are copied in the kernel (copy_file_range,
+// sendfile) with modes and timestamps kept, and unlinked only after success.
+void MoveSlowPath(const std::vector<MoveItem>& items, MoveReport& report);
+
+// Fuse each folder items[i].from into the existing folder items[i].to. Entries
+// whose name is free in the destination move by one rename, whole subtrees at
+// a time; only folders whose names collide are descended into, and independent
+// collisions are merged in parallel. A colliding file moves as "name (2).ext".
+// merged[i] is true once items[i].from has been emptied and deleted. At most
+// workers threads merge at once; 0 picks one per hardware core.
+void MergeFolders(const std::vector<const MoveItem*>& items, std::vector<bool>& merged, int workers = 0);
+
+// Rename every entry natively and send only the leftovers through the slow path
+MoveReport MoveEntries(const std::vector<MoveItem>& items, bool sameDevice = true, unsigned ringDepth = 0);
+
+// Delete a folder that has been emptied by a move
+bool RemoveEmptyFolder(const fs::path& folder);
+
+// Delete chains of emptied folders, each from its last folder up and stopping at
+// its first failure; removed[i] says whether all of chains[i] is gone. With
+// ringDepth > 0 every chain goes through the calling thread's io_uring at once.
+void RemoveEmptyFolderChains(const std::vector<const std::vector<fs::path>*>& chains, unsigned ringDepth,
+                             std::vector<bool>& removed);
@@ -0,0 +1,108 @@
+#include "path_list.h"
+
+#include <utility>
+
+// Whether a name appended to directory needs a separator first
+static bool NeedsSeparator(const fs::path::string_type& directory) {
+    if (directory.empty()) {
+        return false;
+    }
+    fs::path::value_type last = directory.back();
+#ifdef _WIN32
+    return last != L'\\' && last != L'/' && last != L':';
+#else
+    return last != '/';
+#endif
+}
+
+size_t NameOffset(const fs::path& path) {
+    const fs::path::string_type& native = path.native();
+#ifdef _WIN32
+    size_t separator = native.find_last_of(L"\\/:");
+#else
+    size_t separator = native.find_last_of('/');
+#endif
+    return separator == fs::path::string_type::npos ? 0 : separator + 1;
+}
+
+// Last component of a path as a view into it
+static NameView NameOf(const fs::path& path) {
+    return NameView(path.native()).substr(NameOffset(path));
+}
+
+fs::path ChildPath(const fs::path& directory, const fs::path& child) {
+    return ChildPath(directory, NameOf(child));
+}
+
+fs::path ChildPath(const fs::path& directory, NameView name) {
+    const fs::path::string_type& dir = directory.native();
+    bool separator = NeedsSeparator(dir);
+
+    fs::path::string_type joined;
+    joined.reserve(dir.size() + separator + name.size());
+    joined += dir;
+    if (separator) {
+        joined += fs::path::preferred_separator;
+    }
+    joined += name;
+    return fs::path(std::move(joined));
+}
+
+void PathList::Measure(const fs::path& path) {
+    measuredChars += path.native().size() + 1;
+    measuredPaths++;
+}
+
+void PathList::Measure(const fs::path& directory, const fs::path& child) {
+    Measure(directory, NameOf(child));
+}
+
+void PathList::Measure(const fs::path& directory, NameView name) {
+    measuredChars += directory.native().size() + NeedsSeparator(directory.native()) + name.size() + 1;
+    measuredPaths++;
+}
+
+void PathList::Reserve() {
+    buffer.reserve(measuredChars);
+    offsets.reserve(measuredPaths);
+}
+
+void PathList::Append(const fs::path& path) {
+    const fs::path::string_type& native = path.native();
+    offsets.push_back(buffer.size());
+    buffer.insert(buffer.end(), native.begin(), native.end());
+    buffer.push_back(0);
+}
+
+void PathList::Append(const fs::path& directory, const fs::path& child) {
+    Append(directory, NameOf(child));
+}
+
+void PathList::Append(const fs::path& directory, NameView name) {
+    const fs::path::string_type& dir = directory.native();
+    offsets.push_back(buffer.size());
+    buffer.insert(buffer.end(), dir.begin(), dir.end());
+    if (NeedsSeparator(dir)) {
+        buffer.push_back(fs::path::preferred_separator);
+    }
+    buffer.insert(buffer.end(), name.begin(), name.end());
+    buffer.push_back(0);
+}
+
+const PathList::Char* PathList::DoubleNull() {
+    // The terminator was measured, so it fits without reallocating; it stays
+    // in place past the end of the list
+    buffer.push_back(0);
+    buffer.pop_back();
+    return buffer.data();
+}
+
+const PathList::Char* const* PathList::Array() {
+    pointers.clear();
+    pointers.reserve(offsets.size() + 1);
+    for (size_t offset : offsets) {
+        pointers.push_back(buffer.data() + offset);
+    }
+    pointers.push_back(nullptr);
+    return pointers.data();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "directory_reader.h"
+
+namespace fs = std::filesystem;
+
+// A list of paths packed into one buffer, built in two passes: Measure every
+// path, Reserve once, then Append the same paths. Appending never reallocates
+// and joins a directory and a name in place, so a list of any length costs a
+// fixed handful of allocations. Paths use the native character type.
+class PathList {
+public:
+    typedef fs::path::value_type Char;
+
+    void Measure(const fs::path& path);
+    void Measure(const fs::path& directory, const fs::path& child);
+    void Measure(const fs::path& directory, NameView name);
+
+    // Allocate exactly what was measured
+    void Reserve();
+
+    void Append(const fs::path& path);
+
+    // directory joined with the last component of child
+    void Append(const fs::path& directory, const fs::path& child);
+    void Append(const fs::path& directory, NameView name);
+
+    size_t Size() const { return offsets.size(); }
+
+    // One NUL-terminated path
+    const Char* operator[](size_t index) const { return buffer.data() + offsets[index]; }
+
+    // Every path NUL-terminated and one more NUL after the last, the form
+    // SHFileOperationW takes
+    const Char* DoubleNull();
+
+    // Pointers to every path followed by a null pointer, like argv
+    const Char* const* Array();
+
+private:
+    std::vector<Char> buffer;
+    std::vector<size_t> offsets;
+    std::vector<const Char*> pointers;
+    size_t measuredChars = 1;   // the list terminator
+    size_t measuredPaths = 0;
+};
+
+// Offset of the last component in path.native(), without the copy filename() makes
+size_t NameOffset(const fs::path& path);
+
+// directory / child.filename() without the temporaries that expression makes
+fs::path ChildPath(const fs::path& directory, const fs::path& child);
+fs::path ChildPath(const fs::path& directory, NameView name);
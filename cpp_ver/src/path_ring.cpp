@@ -0,0 +1,399 @@
+#include "path_ring.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+#define RING_CAPACITY (1 << 20)                 // record bytes, a multiple of RING_RECORD_ALIGN
+#define RING_HEADER_SIZE 64
+#define RING_MAPPING_SIZE (RING_HEADER_SIZE + RING_CAPACITY)
+#define RING_MAGIC 0x52464e55u                  // "UNFR"
+#define RING_INITIALIZING 1u
+#define RING_RECORD_ALIGN 32
+#define RING_MAX_RECORD (RING_CAPACITY / 4)     // argv larger than this is split into several records
+#define RING_CLOSED (1ull << 63)                // head bit: the receiver takes no new records
+#define RING_CLOSE_WAIT 1000                    // ms to wait for reserved records when closing
+#define RING_WAIT_SLICE 5                       // ms between rechecks on Windows
+
+#ifdef _WIN32
+#define RING_MAPPING_NAME L"Local\\UnfolderRing"
+#define RING_PUBLISHED_EVENT L"Local\\UnfolderRingPublished"
+#define RING_TAKEN_EVENT L"Local\\UnfolderRingTaken"
+#endif
+
+// Signal words senders and the receiver wait on
+#define SIGNAL_PUBLISHED 0   // bumped by a sender after committing a record
+#define SIGNAL_TAKEN 1       // bumped by the receiver after taking records
+
+// A record's state word is its ring position (a multiple of RING_RECORD_ALIGN)
+// with one of these codes in the low bits; 0 means not written yet
+#define RECORD_CODE_MASK (RING_RECORD_ALIGN - 1)
+#define RECORD_READY 1
+#define RECORD_PADDING 2    // fills the end of the ring so a record never wraps
+#define RECORD_WITHDRAWN 3  // sender gave up waiting and handles the paths itself
+#define RECORD_TAKEN 4
+
+struct RingHeader {
+    std::atomic<uint32_t> magic;
+    uint32_t capacity;
+    std::atomic<uint64_t> head;           // bytes reserved by senders, plus RING_CLOSED
+    std::atomic<uint64_t> tail;           // bytes taken by the receiver
+    std::atomic<uint32_t> signals[2];
+};
+
+struct RecordHeader {
+    std::atomic<uint64_t> state;
+    uint32_t size;                        // whole record, header included
+    uint32_t count;                       // NUL-terminated UTF-8 paths after the header
+    uint64_t reserved[2];
+};
+
+static_assert(sizeof(RingHeader) <= RING_HEADER_SIZE, "ring header too large");
+static_assert(sizeof(RecordHeader) == RING_RECORD_ALIGN, "record header must fill one alignment unit");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+static int RemainingMs(std::chrono::steady_clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+}
+
+std::wstring AbsolutePath(const std::wstring& path) {
+    std::error_code ec;
+    fs::path absolute = fs::absolute(path, ec);
+    return ec ? path : absolute.wstring();
+}
+
+PathRing::~PathRing() {
+#ifdef _WIN32
+    if (header != nullptr) {
+        UnmapViewOfFile(header);
+    }
+    for (void* event : events) {
+        if (event != nullptr) {
+            CloseHandle(event);
+        }
+    }
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+    }
+#else
+    if (header != nullptr) {
+        munmap(header, RING_MAPPING_SIZE);
+    }
+#endif
+}
+
+bool PathRing::Open(bool receiver) {
+#ifdef _WIN32
+    // Whoever comes first creates the objects; the others open them
+    mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, RING_MAPPING_SIZE, RING_MAPPING_NAME);
+    if (mapping == NULL) {
+        return false;
+    }
+    events[SIGNAL_PUBLISHED] = CreateEventW(NULL, TRUE, FALSE, RING_PUBLISHED_EVENT);
+    events[SIGNAL_TAKEN] = CreateEventW(NULL, TRUE, FALSE, RING_TAKEN_EVENT);
+    if (events[SIGNAL_PUBLISHED] == NULL || events[SIGNAL_TAKEN] == NULL) {
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, RING_MAPPING_SIZE);
+    if (view == NULL) {
+        return false;
+    }
+#else
+    std::string name = "/unfolder-paths-" + std::to_string(getuid());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (info.st_size < RING_MAPPING_SIZE && ftruncate(fd, RING_MAPPING_SIZE) != 0)) {
+        close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, RING_MAPPING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+#endif
+    header = static_cast<RingHeader*>(view);
+    data = static_cast<unsigned char*>(view) + RING_HEADER_SIZE;
+
+    // A fresh mapping is all zeros; the first process to see it initializes it
+    uint32_t magic = 0;
+    if (header->magic.compare_exchange_strong(magic, RING_INITIALIZING)) {
+        header->capacity = RING_CAPACITY;
+        header->magic.store(RING_MAGIC, std::memory_order_release);
+        magic = RING_MAGIC;
+    }
+    for (int spins = 0; magic == RING_INITIALIZING && spins < 100000; spins++) {
+        std::this_thread::yield();
+        magic = header->magic.load(std::memory_order_acquire);
+    }
+    if (magic != RING_MAGIC || header->capacity != RING_CAPACITY) {
+        return false; // another version of unfolder owns the ring
+    }
+
+    // Records left by a receiver that crashed are still valid and get taken.
+    // A closed ring is reopened past whatever it still held; positions keep
+    // growing, so stale state words never match a new record and the sequence
+    // numbers senders wait on are never reused.
+    if (receiver) {
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        if (head & RING_CLOSED) {
+            header->tail.store(head & ~RING_CLOSED, std::memory_order_release);
+            header->head.store(head & ~RING_CLOSED, std::memory_order_release);
+        }
+    }
+    return true;
+}
+
+void PathRing::Notify(int which) {
+    header->signals[which].fetch_add(1, std::memory_order_release);
+#ifdef _WIN32
+    SetEvent(events[which]);
+#else
+    syscall(SYS_futex, &header->signals[which], FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+bool PathRing::WaitForChange(int which, uint32_t seen, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        if (header->signals[which].load(std::memory_order_acquire) != seen) {
+            return true;
+        }
+        int remaining = RemainingMs(deadline);
+        if (remaining == 0) {
+            return false;
+        }
+#ifdef _WIN32
+        if (which == SIGNAL_PUBLISHED) {
+            // Only the receiver waits here, so it can re-arm both events safely
+            ResetEvent(events[SIGNAL_PUBLISHED]);
+            ResetEvent(events[SIGNAL_TAKEN]);
+            if (header->signals[which].load(std::memory_order_acquire) != seen) {
+                return true;
+            }
+            WaitForSingleObject(events[which], remaining);
+        } else {
+            // Several senders share this event; a missed reset costs one slice
+            WaitForSingleObject(events[which], remaining < RING_WAIT_SLICE ? remaining : RING_WAIT_SLICE);
+        }
+#else
+        struct timespec timeout = { remaining / 1000, (remaining % 1000) * 1000000L };
+        syscall(SYS_futex, &header->signals[which], FUTEX_WAIT, seen, &timeout, nullptr, 0);
+#endif
+    }
+}
+
+bool PathRing::Reserve(size_t size, uint64_t& position, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        uint32_t seen = header->signals[SIGNAL_TAKEN].load(std::memory_order_acquire);
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        if (head & RING_CLOSED) {
+            return false;
+        }
+
+        // A record never wraps: pad out the end of the ring first
+        size_t offset = head % RING_CAPACITY;
+        size_t padding = RING_CAPACITY - offset < size ? RING_CAPACITY - offset : 0;
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        if (head + padding + size - tail > RING_CAPACITY) {
+            if (!WaitForChange(SIGNAL_TAKEN, seen, RemainingMs(deadline))) {
+                return false; // full and nobody is taking records
+            }
+            continue;
+        }
+        if (!header->head.compare_exchange_weak(head, head + padding + size, std::memory_order_acq_rel)) {
+            continue;
+        }
+
+        if (padding > 0) {
+            auto* filler = reinterpret_cast<RecordHeader*>(data + offset);
+            filler->size = static_cast<uint32_t>(padding);
+            filler->state.store(head | RECORD_PADDING, std::memory_order_release);
+        }
+        position = head + padding;
+        return true;
+    }
+}
+
+bool PathRing::Send(const std::vector<std::wstring>& paths, int timeoutMs, std::vector<std::wstring>& undelivered) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    // Pack the paths into as few records as fit, reserving and committing each
+    struct Sent {
+        uint64_t position;
+        size_t first, count;
+    };
+    std::vector<Sent> sent;
+    std::vector<std::string> encoded;
+    encoded.reserve(paths.size());
+    // The receiver's working directory is not ours
+    for (const auto& path : paths) {
+        encoded.push_back(fs::path(AbsolutePath(path)).u8string());
+    }
+
+    size_t next = 0;
+    while (next < encoded.size()) {
+        size_t first = next;
+        size_t bytes = sizeof(RecordHeader);
+        while (next < encoded.size() && bytes + encoded[next].size() + 1 <= RING_MAX_RECORD) {
+            bytes += encoded[next++].size() + 1;
+        }
+        if (next == first) {
+            undelivered.push_back(paths[next++]); // a single path larger than a record
+            continue;
+        }
+        size_t size = (bytes + RING_RECORD_ALIGN - 1) & ~static_cast<size_t>(RING_RECORD_ALIGN - 1);
+
+        uint64_t position;
+        if (!Reserve(size, position, RemainingMs(deadline))) {
+            undelivered.insert(undelivered.end(), paths.begin() + first, paths.end());
+            break;
+        }
+        auto* record = reinterpret_cast<RecordHeader*>(data + position % RING_CAPACITY);
+        record->size = static_cast<uint32_t>(size);
+        record->count = static_cast<uint32_t>(next - first);
+        char* out = reinterpret_cast<char*>(record + 1);
+        for (size_t i = first; i < next; i++) {
+            std::memcpy(out, encoded[i].c_str(), encoded[i].size() + 1);
+            out += encoded[i].size() + 1;
+        }
+        record->state.store(position | RECORD_READY, std::memory_order_release);
+        Notify(SIGNAL_PUBLISHED);
+        sent.push_back({ position, first, next - first });
+    }
+
+    // Wait for the acknowledgements: the receiver's tail passing each record
+    // with the record marked taken. A receiver that closes without taking a
+    // record still moves its tail past it, and the record stays undelivered.
+    for (const auto& record : sent) {
+        auto* slot = reinterpret_cast<RecordHeader*>(data + record.position % RING_CAPACITY);
+        for (;;) {
+            uint32_t seen = header->signals[SIGNAL_TAKEN].load(std::memory_order_acquire);
+            if (header->tail.load(std::memory_order_acquire) > record.position) {
+                if (slot->state.load(std::memory_order_acquire) != (record.position | RECORD_TAKEN)) {
+                    undelivered.insert(undelivered.end(), paths.begin() + record.first,
+                                       paths.begin() + record.first + record.count);
+                }
+                break;
+            }
+            if (!WaitForChange(SIGNAL_TAKEN, seen, RemainingMs(deadline))) {
+                // Withdraw it unless the receiver takes it at this very moment
+                uint64_t expected = record.position | RECORD_READY;
+                if (slot->state.compare_exchange_strong(expected, record.position | RECORD_WITHDRAWN,
+                                                        std::memory_order_acq_rel)) {
+                    undelivered.insert(undelivered.end(), paths.begin() + record.first,
+                                       paths.begin() + record.first + record.count);
+                }
+                break;
+            }
+        }
+    }
+    return undelivered.empty();
+}
+
+bool PathRing::TakeOne(std::vector<std::wstring>& paths) {
+    for (;;) {
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        if (tail == (header->head.load(std::memory_order_acquire) & ~RING_CLOSED)) {
+            return false;
+        }
+
+        size_t offset = tail % RING_CAPACITY;
+        auto* record = reinterpret_cast<RecordHeader*>(data + offset);
+        uint64_t state = record->state.load(std::memory_order_acquire);
+        if ((state & ~static_cast<uint64_t>(RECORD_CODE_MASK)) != tail || state == 0) {
+            return false; // reserved but not committed yet
+        }
+        uint64_t code = state & RECORD_CODE_MASK;
+        if (code == RECORD_READY &&
+            !record->state.compare_exchange_strong(state, tail | RECORD_TAKEN, std::memory_order_acq_rel)) {
+            continue; // withdrawn just now
+        }
+
+        uint32_t size = record->size;
+        bool taken = code == RECORD_READY;
+        if (taken) {
+            const char* in = reinterpret_cast<const char*>(record + 1);
+            for (uint32_t i = 0; i < record->count; i++) {
+                size_t length = std::strlen(in);
+                paths.push_back(fs::u8path(in, in + length).wstring());
+                in += length + 1;
+            }
+        }
+
+        // Leave the slot zeroed for the next lap, then acknowledge. A taken
+        // record keeps its state word, which its sender checks once the tail
+        // has passed it.
+        if (!taken) {
+            record->state.store(0, std::memory_order_relaxed);
+        }
+        std::memset(data + offset + sizeof(record->state), 0, size - sizeof(record->state));
+        header->tail.store(tail + size, std::memory_order_release);
+        if (taken) {
+            return true;
+        }
+    }
+}
+
+size_t PathRing::Receive(std::vector<std::wstring>& paths, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    size_t taken = 0;
+    for (;;) {
+        uint32_t seen = header->signals[SIGNAL_PUBLISHED].load(std::memory_order_acquire);
+        while (TakeOne(paths)) {
+            taken++;
+        }
+        if (taken > 0) {
+            Notify(SIGNAL_TAKEN);
+            return taken;
+        }
+        int remaining = timeoutMs < 0 ? INT_MAX : RemainingMs(deadline);
+        if (remaining == 0) {
+            return 0;
+        }
+        WaitForChange(SIGNAL_PUBLISHED, seen, remaining);
+    }
+}
+
+void PathRing::Close(std::vector<std::wstring>& paths) {
+    uint64_t head = header->head.fetch_or(RING_CLOSED, std::memory_order_acq_rel) & ~RING_CLOSED;
+
+    // Senders that reserved before the close commit within microseconds; one
+    // that died in between is given up on after RING_CLOSE_WAIT. Skipping the
+    // records left behind does not lose them: they were never marked taken,
+    // so their senders, late or not, get them back as undelivered.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RING_CLOSE_WAIT);
+    for (;;) {
+        uint32_t seen = header->signals[SIGNAL_PUBLISHED].load(std::memory_order_acquire);
+        while (TakeOne(paths)) {
+        }
+        if (header->tail.load(std::memory_order_relaxed) == head ||
+            !WaitForChange(SIGNAL_PUBLISHED, seen, RemainingMs(deadline))) {
+            break;
+        }
+    }
+    header->tail.store(head, std::memory_order_release);
+    Notify(SIGNAL_TAKEN);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RingHeader;
+
+// Where folders come from while a job runs: other instances or daemon clients
+class PathSource {
+public:
+    virtual ~PathSource() = default;
+
+    // Append the folders that arrive within timeoutMs (negative waits forever).
+    // Returns the number of submissions taken.
+    virtual size_t Receive(std::vector<std::wstring>& paths, int timeoutMs) = 0;
+};
+
+// path resolved against this process's working directory, so another process
+// running elsewhere finds the same folder; path itself if that fails
+std::wstring AbsolutePath(const std::wstring& path);
+
+// Shared-memory ring that hands selected folders from later instances to the
+// first one. Any number of senders append variable-length records (one per argv,
+// split only if huge) without locks; the single receiver takes them in order.
+// A record's ring position is its sequence number, and the receiver marking it
+// taken and moving past it is the acknowledgement the sender waits for.
+// Linux: shm_open + futex. Windows: named file mapping + named events.
+class PathRing : public PathSource {
+public:
+    PathRing() = default;
+    ~PathRing();
+
+    PathRing(const PathRing&) = delete;
+    PathRing& operator=(const PathRing&) = delete;
+
+    // Create or open the shared ring. The receiver reopens a ring that a
+    // previous receiver closed.
+    bool Open(bool receiver);
+
+    // Publish paths, made absolute first, and wait until the receiver has taken
+    // them. Paths whose records were not taken in time (ring closed, full or
+    // nobody receiving) are withdrawn and returned in undelivered, so the caller
+    // can handle them itself.
+    bool Send(const std::vector<std::wstring>& paths, int timeoutMs, std::vector<std::wstring>& undelivered);
+
+    // Take every published record, waiting up to timeoutMs for the first one.
+    // Returns the number of records taken.
+    size_t Receive(std::vector<std::wstring>& paths, int timeoutMs) override;
+
+    // Refuse new records, then take the ones senders had already reserved.
+    // Records still uncommitted after RING_CLOSE_WAIT are returned to their
+    // senders as undelivered.
+    void Close(std::vector<std::wstring>& paths);
+
+private:
+    bool Reserve(size_t size, uint64_t& position, int timeoutMs);
+    bool TakeOne(std::vector<std::wstring>& paths);
+    bool WaitForChange(int which, uint32_t seen, int timeoutMs);
+    void Notify(int which);
+
+    RingHeader* header = nullptr;
+    unsigned char* data = nullptr;
+#ifdef _WIN32
+    void* mapping = nullptr;
+    void* events[2] = { nullptr, nullptr };
+#endif
+};
@@ -0,0 +1,1027 @@
+#include "plan.h"
+
+#include "compare.h"
+#include "directory_reader.h"
+#include "journal.h"
+#include "json.h"
+#include "path_list.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+
+// Rough costs behind the dry-run duration estimate
+#define ESTIMATE_SECONDS_PER_RENAME 0.00002
+#define ESTIMATE_SECONDS_PER_COPY 0.0005
+#define ESTIMATE_COPY_BYTES_PER_SECOND (150.0 * 1024 * 1024)
+// Enough raw entries to tell whether a folder holds exactly one
+#define PROBE_BUFFER_SIZE 4096
+// A parent with at most this many files besides the selection may swap with it
+#define SWAP_PARENT_ENTRIES 64
+// ...once the payload holds this many times more entries than the parent
+#define SWAP_RATIO 4
+
+// Message shown for each FolderFailure
+static const wchar_t* const FAILURE_MESSAGES[] = {
+    L"Not a valid folder",
+    L"Failed to read folder",
+    L"Folder changed since it was planned",
+    L"Move operation failed or cancelled",
+    L"Conflicting entries skipped",
+    L"Folder not empty after move",
+    L"Failed to delete folder",
+    L"Error checking folder",
+    L"Failed to write the job journal",
+};
+static_assert(sizeof(FAILURE_MESSAGES) / sizeof(FAILURE_MESSAGES[0]) == static_cast<size_t>(FolderFailure::Count),
+              "every failure needs a message");
+
+void FindPayloadFolder(const fs::path& folder, int depth, std::vector<fs::path>& chain) {
+    chain.assign(1, folder);
+    uint64_t probe[PROBE_BUFFER_SIZE / sizeof(uint64_t)];
+    DirectoryReader reader(probe, sizeof(probe));
+    while (depth <= 0 || static_cast<int>(chain.size()) < depth) {
+        std::error_code ec;
+        DirectoryEntry entry;
+        if (!reader.Open(chain.back(), ec) || !reader.Next(entry, ec)) {
+            break;
+        }
+
+        bool isFolder = reader.Resolve(entry) == EntryType::Directory;
+        fs::path child = ChildPath(chain.back(), entry.name);
+        if (!isFolder || reader.Next(entry, ec) || ec) {
+            break; // non-trivial level reached
+        }
+        chain.push_back(std::move(child));
+    }
+}
+
+bool RemoveFolderChain(const std::vector<fs::path>& chain) {
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        if (!RemoveEmptyFolder(*it)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Modification times of the destination and every folder in the chain
+static std::vector<int64_t> Fingerprint(const fs::path& parent, const std::vector<fs::path>& chain) {
+    std::vector<int64_t> stamps;
+    std::error_code ec;
+    stamps.push_back(fs::last_write_time(parent, ec).time_since_epoch().count());
+    for (const auto& folder : chain) {
+        stamps.push_back(fs::last_write_time(folder, ec).time_since_epoch().count());
+    }
+    return stamps;
+}
+
+// Bytes of file data under an entry, without following symlinks
+static uint64_t TreeBytes(const fs::path& path, EntryType type) {
+    std::error_code ec;
+    if (type == EntryType::File) {
+        PathInfo info;
+        return StatPath(path, false, info, ec) ? info.size : 0;
+    }
+    if (type != EntryType::Directory) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    for (fs::recursive_directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && !it->is_symlink(ec)) {
+            total += it->file_size(ec);
+        }
+    }
+    return total;
+}
+
+// Selections sharing a parent are handled in order by one task, so their
+// conflicts are seen consistently; different parents run concurrently
+static std::map<fs::path, std::vector<size_t>> GroupByParent(const UnfoldPlan& plan) {
+    std::map<fs::path, std::vector<size_t>> byParent;
+    for (size_t i = 0; i < plan.folders.size(); i++) {
+        byParent[plan.folders[i].folder.lexically_normal().parent_path()].push_back(i);
+    }
+    return byParent;
+}
+
+static int PoolSize(const UnfoldOptions& options, size_t groups) {
+    int workers = options.workers > 0 ? options.workers : static_cast<int>(std::thread::hardware_concurrency());
+    return std::max(1, std::min(workers, static_cast<int>(groups)));
+}
+
+void FailFolder(FolderPlan& plan, FolderFailure reason) {
+    plan.failure = FAILURE_MESSAGES[static_cast<size_t>(reason)];
+    plan.failureReason = reason;
+}
+
+fs::path SelectedFolder(const std::wstring& path) {
+    fs::path folder = path;
+    if (!folder.has_filename()) {
+        folder = folder.parent_path(); // trailing separator
+    }
+    return folder;
+}
+
+// The parent's entries besides the selection, when there are at most
+// SWAP_PARENT_ENTRIES, none is a folder (so none is another selection) and the
+// payload can take the parent's place: the grandparent is on the same device,
+// can exchange, and lets this user rename the parent and the payload there
+static bool SmallParent(const fs::path& parent, const fs::path& payload, const fs::path& folderName,
+                        const PathInfo& parentInfo, MetadataSnapshot& metadata, std::vector<fs::path>& files) {
+#ifdef _WIN32
+    // No rename-exchange, and Explorer keeps the folder it shows open
+    return false;
+#else
+    if (parent.empty() || !parent.has_relative_path()) {
+        return false;
+    }
+    fs::path grandparent = parent.parent_path();
+    std::error_code ec;
+    PathInfo grandparentInfo = metadata.Stat(grandparent, ec);
+    if (!grandparentInfo.IsDirectory() || grandparentInfo.device != parentInfo.device) {
+        return false;
+    }
+    // A moved folder's ".." is rewritten, so the payload must be writable too.
+    // In a sticky grandparent only the owner of an entry may rename it.
+    struct stat grandparentStat, parentStat;
+    if (faccessat(AT_FDCWD, grandparent.c_str(), W_OK | X_OK, AT_EACCESS) != 0
+        || faccessat(AT_FDCWD, payload.c_str(), W_OK, AT_EACCESS) != 0
+        || stat(grandparent.c_str(), &grandparentStat) != 0 || stat(parent.c_str(), &parentStat) != 0) {
+        return false;
+    }
+    uid_t user = geteuid();
+    if ((grandparentStat.st_mode & S_ISVTX) && user != 0 && user != grandparentStat.st_uid && user != parentStat.st_uid) {
+        return false;
+    }
+    if (!ExchangeSupported(grandparent)) {
+        return false;
+    }
+
+    char buffer[PROBE_BUFFER_SIZE];
+    DirectoryReader reader(buffer, sizeof(buffer));
+    DirectoryEntry entry;
+    if (!reader.Open(parent, ec)) {
+        return false;
+    }
+    while (reader.Next(entry, ec)) {
+        fs::path name(fs::path::string_type(entry.name));
+        if (SameName(name, folderName)) {
+            continue;
+        }
+        if (files.size() >= SWAP_PARENT_ENTRIES || reader.Resolve(entry) == EntryType::Directory) {
+            return false;
+        }
+        files.push_back(parent / name);
+    }
+    return !ec;
+#endif
+}
+
+void PlanFolder(FolderPlan& plan, const UnfoldOptions& options, NameIndex& index, MetadataSnapshot& metadata, bool dryRun,
+                const std::function<void(FolderPlan&)>& emit) {
+    const fs::path& folderPath = plan.folder;
+    std::error_code statEc;
+    PathInfo folderInfo;
+    if (!StatPath(folderPath, true, folderInfo, statEc) || !folderInfo.IsDirectory()) {
+        FailFolder(plan, FolderFailure::Invalid);
+        return;
+    }
+
+    // The destination is computed once, however many wrappers are lifted through
+    fs::path parent = folderPath.parent_path();
+    std::vector<fs::path> chain;
+    std::vector<MoveItem> items;
+    std::vector<EntryType> types;   // dry run only
+    FindPayloadFolder(folderPath, options.depth, chain);
+
+    // Known before the first entry is planned, since chunks may move right away.
+    // The parent is stat'd once per job; the payload folder is the selection
+    // itself unless wrappers were lifted through.
+    PathInfo parentInfo = metadata.Stat(parent.empty() ? fs::path(".") : parent, statEc);
+    PathInfo payloadInfo = folderInfo;
+    if (chain.size() > 1) {
+        StatPath(chain.back(), true, payloadInfo, statEc);
+    }
+    plan.crossDevice = !parentInfo.Exists() || !payloadInfo.Exists() || payloadInfo.device != parentInfo.device;
+    plan.chain = chain;
+
+    // Swap the smaller side: when the payload turns out much larger than the
+    // parent's few files, those move into the payload instead and the payload
+    // takes the parent's place. The names and contents come out the same, but
+    // the parent folder is a new one: its permissions, owner and group are
+    // copied over, its timestamps, ACLs and extended attributes are not.
+    std::vector<fs::path> parentFiles;
+    bool swapCandidate = options.swapParent && !plan.crossDevice
+        && SmallParent(parent, chain.back(), folderPath.filename(), parentInfo, metadata, parentFiles);
+    size_t swapThreshold = SWAP_RATIO * (parentFiles.size() + 1);
+    auto trySwap = [&]() {
+        swapCandidate = false;
+        // A payload entry named like one of the files is a conflict; leave it to the policy
+        for (const auto& file : parentFiles) {
+            PathInfo info;
+            if (StatPath(chain.back() / file.filename(), false, info, statEc)) {
+                return;
+            }
+        }
+        plan.swapParent = true;
+        for (const auto& item : items) {
+            index.Insert(item.to.filename());
+        }
+        items.clear();
+        types.clear();
+    };
+
+    // Classify entries against the parent's names; entries the policy skips are
+    // dropped from the plan. The index holds every name the parent had before
+    // the job and every name already planned, so a chunk can move as soon as
+    // it is classified.
+    auto classify = [&]() {
+        size_t kept = 0;
+        for (size_t i = 0; i < items.size(); i++) {
+            MoveItem& item = items[i];
+            // foo/foo only collides with the folder it is about to replace
+            if (!plan.crossDevice && SameName(item.to.filename(), folderPath.filename())) {
+                plan.selfNamed = std::move(item.from);
+                continue;
+            }
+            Resolution resolution = Resolution::Move;
+            if (index.Contains(item.to.filename())) {
+                plan.conflicts++;
+                TraceSpan span("plan", "resolve conflict");
+                resolution = ResolveConflict(options.conflictPolicy, item, folderPath.filename(), index);
+                if (!dryRun) {
+                    Metrics().Conflict(resolution);
+                }
+            }
+            if (resolution == Resolution::Skip) {
+                plan.skipped++;
+                continue;
+            }
+            if (resolution != Resolution::Ask) {
+                index.Insert(item.to.filename());
+            }
+            plan.actions.push_back(resolution);
+            if (dryRun) {
+                types[kept] = types[i];
+            }
+            items[kept++] = std::move(item);
+        }
+        items.resize(kept);
+        if (dryRun) {
+            types.resize(kept);
+        }
+        plan.items.insert(plan.items.end(), std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+        items.clear();
+    };
+
+    size_t listed = 0;
+    auto listStart = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration emitting{};
+    {
+        TraceSpan span("fs", "enumerate", folderPath);
+        DirectoryReader reader(ThreadDirectoryBuffer(), DIRECTORY_BUFFER_SIZE);
+        DirectoryEntry entry;
+        std::error_code ec;
+        if (reader.Open(chain.back(), ec)) {
+            while (reader.Next(entry, ec)) {
+                if (plan.swapParent) {
+                    // The entry stays where it is; later selections still see its name
+                    index.Insert(fs::path(fs::path::string_type(entry.name)));
+                    listed++;
+                    continue;
+                }
+                items.push_back({ ChildPath(chain.back(), entry.name), ChildPath(parent, entry.name) });
+                if (dryRun) {
+                    types.push_back(reader.Resolve(entry));
+                }
+                if (swapCandidate && items.size() > swapThreshold) {
+                    size_t seen = items.size();
+                    trySwap();
+                    if (plan.swapParent) {
+                        listed += seen;
+                    }
+                }
+                if (emit && !dryRun && items.size() >= PLAN_CHUNK_ENTRIES) {
+                    listed += items.size();
+                    classify();
+                    auto emitStart = std::chrono::steady_clock::now();
+                    emit(plan);
+                    emitting += std::chrono::steady_clock::now() - emitStart;
+                }
+            }
+        }
+        if (ec) {
+            if (listed == 0) {
+                plan.chain.clear();
+            }
+            FailFolder(plan, FolderFailure::Unreadable);
+            return;
+        }
+    }
+    Metrics().Latency(Operation::Enumerate, std::chrono::steady_clock::now() - listStart - emitting);
+
+    listed += items.size();
+    if (listed == 0) {
+        plan.chain.clear();
+        return;
+    }
+    if (plan.swapParent) {
+        for (const auto& file : parentFiles) {
+            plan.items.push_back({ file, chain.back() / file.filename() });
+            plan.actions.push_back(Resolution::Move);
+            types.push_back(EntryType::File);
+        }
+        plan.parentFiles = std::move(parentFiles);
+    } else {
+        classify();
+    }
+
+    if (dryRun) {
+        // Mount points inside the folder cross devices even when the folder does not
+        for (size_t i = 0; i < plan.items.size(); i++) {
+            PathInfo info;
+            bool copied = plan.crossDevice
+                || (types[i] == EntryType::Directory
+                    && (!StatPath(plan.items[i].from, true, info, statEc) || info.device != parentInfo.device));
+            plan.copied.push_back(copied);
+            plan.bytes.push_back(copied ? TreeBytes(plan.items[i].from, types[i]) : 0);
+        }
+        plan.fingerprint = Fingerprint(parent, chain);
+    }
+}
+
+UnfoldPlan PlanUnfold(const std::vector<std::wstring>& folderPaths, const UnfoldOptions& options, bool dryRun) {
+    UnfoldPlan plan;
+    plan.folders.resize(folderPaths.size());
+    for (size_t i = 0; i < folderPaths.size(); i++) {
+        plan.folders[i].folder = SelectedFolder(folderPaths[i]);
+    }
+
+    MetadataSnapshot metadata;
+    auto byParent = GroupByParent(plan);
+    ThreadPool pool(PoolSize(options, byParent.size()));
+    for (const auto& group : byParent) {
+        const std::vector<size_t>* members = &group.second;
+        const fs::path* parent = &group.first;
+        pool.Submit([&plan, &options, &metadata, members, parent, dryRun] {
+            // One scan of the parent, so every conflict is a hash lookup
+            NameIndex names;
+            std::error_code ec;
+            names.Load(parent->empty() ? fs::path(".") : *parent, ec);
+            for (size_t index : *members) {
+                PlanFolder(plan.folders[index], options, names, metadata, dryRun);
+            }
+        });
+    }
+    pool.Wait();
+    return plan;
+}
+
+void MoveFolder(FolderPlan& plan, FolderRun& run, Journal& journal, const UnfoldOptions& options) {
+    run.remaining = plan.items.size();
+
+    // Plain moves go out as one batch; replacements are checked one at a time
+    std::vector<MoveStatus> statuses(plan.items.size(), MoveStatus::Failed);
+    if (!plan.crossDevice) {
+        std::vector<const MoveItem*> batch;
+        std::vector<size_t> batchIndex;
+        for (size_t i = 0; i < plan.items.size(); i++) {
+            if (plan.actions[i] == Resolution::Move) {
+                batch.push_back(&plan.items[i]);
+                batchIndex.push_back(i);
+            }
+        }
+        std::vector<MoveStatus> moved;
+        RenameNoReplaceBatch(batch, options.ioRingDepth, moved);
+        for (size_t j = 0; j < batch.size(); j++) {
+            statuses[batchIndex[j]] = moved[j];
+        }
+
+        // Colliding folders are fused together; what cannot be is left for the slow path
+        std::vector<const MoveItem*> merges;
+        std::vector<size_t> mergeIndex;
+        for (size_t i = 0; i < plan.items.size(); i++) {
+            if (plan.actions[i] == Resolution::Merge) {
+                merges.push_back(&plan.items[i]);
+                mergeIndex.push_back(i);
+            }
+        }
+        if (!merges.empty()) {
+            std::vector<bool> merged;
+            MergeFolders(merges, merged, options.workers);
+            for (size_t j = 0; j < merges.size(); j++) {
+                statuses[mergeIndex[j]] = merged[j] ? MoveStatus::Moved : MoveStatus::Failed;
+            }
+        }
+    }
+
+    // Copies of files already in the parent are compared now, however long ago
+    // the plan was made, and deleted only if every byte still matches. A drop
+    // cannot be rolled back: the parent's copy stays where it is.
+    std::vector<const MoveItem*> drops;
+    std::vector<size_t> dropIndex;
+    for (size_t i = 0; i < plan.items.size(); i++) {
+        if (plan.actions[i] == Resolution::Drop) {
+            drops.push_back(&plan.items[i]);
+            dropIndex.push_back(i);
+        }
+    }
+    if (!drops.empty()) {
+        std::vector<bool> identical;
+        CompareFiles(drops, identical);
+        for (size_t j = 0; j < drops.size(); j++) {
+            std::error_code ec;
+            if (identical[j] && fs::remove(drops[j]->from, ec)) {
+                statuses[dropIndex[j]] = MoveStatus::Moved;
+                Metrics().entriesDropped.Add();
+            }
+        }
+    }
+
+    for (size_t i = 0; i < plan.items.size(); i++) {
+        MoveItem& item = plan.items[i];
+        std::error_code ec;
+        switch (plan.actions[i]) {
+        case Resolution::Replace:
+            if (!plan.crossDevice) {
+                if (RenameReplace(item.from, item.to, ec) == MoveStatus::Moved) {
+                    journal.Completed(run.firstId + i);
+                    run.remaining--;
+                    continue;
+                }
+                break; // the destination stays; the slow path will not replace it
+            }
+            {
+                // The copy takes the destination's place only once it is complete
+                uint64_t bytes = 0;
+                if (CopyReplace(item.from, item.to, bytes, ec) == MoveStatus::Moved) {
+                    journal.Completed(run.firstId + i);
+                    run.remaining--;
+                    continue;
+                }
+            }
+            break;
+        case Resolution::Move:
+        case Resolution::Merge:
+        case Resolution::Drop:
+            if (statuses[i] == MoveStatus::Moved) {
+                journal.Completed(run.firstId + i);
+                run.remaining--;
+                continue;
+            }
+            break;
+        default:
+            break;
+        }
+        run.slowItems.push_back(std::move(item));
+        run.slowIds.push_back(run.firstId + i);
+    }
+    plan.items.clear();
+    plan.actions.clear();
+}
+
+// Folders a swap removes, top-down: the parent, the selection and the
+// wrappers above the payload
+static std::vector<fs::path> SwapChain(const FolderPlan& plan) {
+    std::vector<fs::path> chain = { plan.folder.parent_path() };
+    chain.insert(chain.end(), plan.chain.begin(), plan.chain.end() - 1);
+    return chain;
+}
+
+// The parent's files are inside the payload by now; the payload takes the
+// parent's place and the parent, the selection and its wrappers go. On failure
+// the files go back, leaving the folder as planned.
+static bool SwapIntoParent(const FolderPlan& plan, const fs::path& temp) {
+    fs::path parent = plan.folder.parent_path();
+    const fs::path& payload = plan.chain.back();
+
+    // The parent's inode changes; its permissions, owner and group do not
+    std::error_code ec;
+    fs::perms payloadPerms = fs::status(payload, ec).permissions();
+#ifndef _WIN32
+    // Best effort: only root may give a folder to another user
+    struct stat parentStat, payloadStat;
+    bool owned = stat(parent.c_str(), &parentStat) == 0 && stat(payload.c_str(), &payloadStat) == 0;
+    if (owned) {
+        (void)!chown(payload.c_str(), parentStat.st_uid, parentStat.st_gid);
+    }
+#endif
+    fs::permissions(payload, fs::status(parent, ec).permissions(), ec);
+    if (LiftIntoPlace(payload, SwapChain(plan), temp)) {
+        return true;
+    }
+#ifndef _WIN32
+    if (owned) {
+        (void)!chown(payload.c_str(), payloadStat.st_uid, payloadStat.st_gid);
+    }
+#endif
+    fs::permissions(payload, payloadPerms, ec);
+    for (const auto& file : plan.parentFiles) {
+        RenameNoReplace(payload / file.filename(), file, ec);
+    }
+    return false;
+}
+
+// A swap that could not run, with the parent's files back in place: the
+// payload's entries move out one by one as if no swap had been planned, and
+// the chain goes, or is replaced by a self-named entry
+static bool MoveOutOfPayload(FolderPlan& plan, Journal& journal, unsigned ringDepth) {
+    const fs::path& payload = plan.chain.back();
+    fs::path parent = plan.folder.parent_path();
+    std::vector<MoveItem> items;
+    fs::path selfNamed;
+    {
+        DirectoryReader reader(ThreadDirectoryBuffer(), DIRECTORY_BUFFER_SIZE);
+        DirectoryEntry entry;
+        std::error_code ec;
+        if (reader.Open(payload, ec)) {
+            while (reader.Next(entry, ec)) {
+                MoveItem item = { ChildPath(payload, entry.name), ChildPath(parent, entry.name) };
+                if (SameName(item.to.filename(), plan.folder.filename())) {
+                    selfNamed = std::move(item.from);
+                } else {
+                    items.push_back(std::move(item));
+                }
+            }
+        }
+        if (ec) {
+            return false;
+        }
+    }
+
+    std::vector<Resolution> actions(items.size(), Resolution::Move);
+    uint64_t firstId = journal.Plan(items, actions, plan.chain);
+    if (!journal.Sync()) {
+        FailFolder(plan, FolderFailure::JournalFailed);
+        return false;
+    }
+    std::vector<const MoveItem*> batch;
+    for (const auto& item : items) {
+        batch.push_back(&item);
+    }
+    std::vector<MoveStatus> statuses;
+    RenameNoReplaceBatch(batch, ringDepth, statuses);
+    bool moved = true;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (statuses[i] == MoveStatus::Moved) {
+            journal.Completed(firstId + i);
+        } else {
+            moved = false;
+        }
+    }
+    if (!moved) {
+        return false;
+    }
+
+    if (selfNamed.empty()) {
+        return RemoveFolderChain(plan.chain);
+    }
+    fs::path temp = LiftTempPath(plan.chain.front());
+    PathInfo info;
+    std::error_code ec;
+    if (temp.empty() || !StatPath(selfNamed, false, info, ec)) {
+        return false;
+    }
+    journal.Lift(selfNamed, temp, plan.chain, info.identity);
+    if (!journal.Sync()) {
+        FailFolder(plan, FolderFailure::JournalFailed);
+        return false;
+    }
+    return LiftIntoPlace(selfNamed, plan.chain, temp);
+}
+
+void FinishFolders(const std::vector<std::pair<FolderPlan*, FolderRun*>>& folders, Journal& journal, unsigned ringDepth) {
+    TraceSpan span("fs", "delete folders");
+    std::vector<const std::vector<fs::path>*> chains;
+    std::vector<size_t> owner;
+    std::vector<size_t> lifts;      // folders replaced by one of their entries
+    std::vector<fs::path> temps;
+    for (size_t i = 0; i < folders.size(); i++) {
+        FolderPlan& plan = *folders[i].first;
+        if (plan.skipped > 0) {
+            FailFolder(plan, FolderFailure::Skipped);
+        } else if (folders[i].second->remaining > 0) {
+            FailFolder(plan, FolderFailure::NotEmpty);
+        } else if (plan.swapParent || !plan.selfNamed.empty()) {
+            // Journaled up front, so recovery can find the entry wherever its lift stops
+            const fs::path& entry = plan.swapParent ? plan.chain.back() : plan.selfNamed;
+            std::vector<fs::path> chain = plan.swapParent ? SwapChain(plan) : plan.chain;
+            // An empty temp makes the lift fail, and a swap then falls back to moving entries
+            fs::path temp = LiftTempPath(chain.front());
+            PathInfo info;
+            std::error_code ec;
+            if (temp.empty() || !StatPath(entry, false, info, ec)) {
+                temp.clear();
+            } else {
+                journal.Lift(entry, temp, chain, info.identity);
+            }
+            lifts.push_back(i);
+            temps.push_back(temp);
+        } else {
+            chains.push_back(&plan.chain);
+            owner.push_back(i);
+        }
+    }
+
+    bool synced = lifts.empty() || journal.Sync();
+    for (size_t l = 0; l < lifts.size(); l++) {
+        FolderPlan& plan = *folders[lifts[l]].first;
+        if (!synced) {
+            FailFolder(plan, FolderFailure::JournalFailed);
+            continue;
+        }
+        bool lifted = plan.swapParent ? SwapIntoParent(plan, temps[l]) || MoveOutOfPayload(plan, journal, ringDepth)
+                                      : LiftIntoPlace(plan.selfNamed, plan.chain, temps[l]);
+        if (lifted) {
+            folders[lifts[l]].second->succeeded = true;
+        } else if (plan.failure.empty()) {
+            FailFolder(plan, FolderFailure::DeleteFailed);
+        }
+    }
+
+    std::vector<bool> removed;
+    RemoveEmptyFolderChains(chains, ringDepth, removed);
+    for (size_t c = 0; c < chains.size(); c++) {
+        if (removed[c]) {
+            folders[owner[c]].second->succeeded = true;
+        } else {
+            FailFolder(*folders[owner[c]].first, FolderFailure::DeleteFailed);   // also when entries appeared after planning
+        }
+    }
+}
+
+FolderProcessResult ExecutePlan(UnfoldPlan& plan, const UnfoldOptions& options) {
+    FolderProcessResult result = {0, 0, L""};
+    auto& folders = plan.folders;
+
+    // A plan made earlier only runs against the tree it was made for. Every
+    // fingerprint is checked before anything moves, since moves touch the parents.
+    for (auto& folder : folders) {
+        if (folder.failure.empty() && !folder.fingerprint.empty()
+            && folder.fingerprint != Fingerprint(folder.folder.parent_path(), folder.chain)) {
+            FailFolder(folder, FolderFailure::Changed);
+        }
+    }
+
+    int64_t traceStart = TraceClock();
+    if (!options.traceDirectory.empty()) {
+        StartTrace();
+    }
+
+    // Every planned move is journaled before it runs, so an interrupted job can be recovered
+    Journal journal;
+    if (!options.journalDirectory.empty()) {
+        journal.Open(options.journalDirectory);
+    }
+
+    std::vector<FolderRun> runs(folders.size());
+    auto byParent = GroupByParent(plan);
+    ThreadPool pool(PoolSize(options, byParent.size()));
+    for (const auto& group : byParent) {
+        const std::vector<size_t>* members = &group.second;
+        pool.Submit([&folders, &runs, &journal, &options, members] {
+            for (size_t index : *members) {
+                if (folders[index].failure.empty() && !folders[index].chain.empty()) {
+                    runs[index].firstId = journal.Plan(folders[index].items, folders[index].actions, folders[index].chain);
+                }
+            }
+
+            // One sync per parent rather than per folder or per entry
+            bool synced;
+            {
+                TraceSpan span("journal", "sync");
+                synced = journal.Sync();
+            }
+            for (size_t index : *members) {
+                if (!synced && folders[index].failure.empty() && !folders[index].chain.empty()) {
+                    FailFolder(folders[index], FolderFailure::JournalFailed);
+                }
+                if (folders[index].failure.empty()) {
+                    TraceSpan span("job", "move folder", folders[index].folder);
+                    MoveFolder(folders[index], runs[index], journal, options);
+                }
+            }
+        });
+    }
+    pool.Wait();
+
+    // Do the remaining moves all at once so conflicts are resolved in a single dialog
+    std::vector<MoveItem> slowItems;
+    std::vector<size_t> slowOwner;
+    std::vector<uint64_t> slowIds;
+    for (size_t i = 0; i < runs.size(); i++) {
+        for (auto& item : runs[i].slowItems) {
+            slowItems.push_back(std::move(item));
+            slowOwner.push_back(i);
+        }
+        slowIds.insert(slowIds.end(), runs[i].slowIds.begin(), runs[i].slowIds.end());
+    }
+
+    MoveReport report;
+    {
+        TraceSpan span("job", "slow path");
+        MoveSlowPath(slowItems, report);
+    }
+    std::vector<bool> slowFailed(slowItems.size(), false);
+    for (size_t index : report.failed) {
+        FailFolder(folders[slowOwner[index]], FolderFailure::MoveFailed);
+        slowFailed[index] = true;
+    }
+    for (size_t i = 0; i < slowIds.size(); i++) {
+        if (!slowFailed[i]) {
+            journal.Completed(slowIds[i]);
+            runs[slowOwner[i]].remaining--;
+        }
+    }
+    result.bytesCopied = report.bytesCopied;
+    result.copySeconds = report.copySeconds;
+
+    // Delete empty folders
+    for (const auto& group : byParent) {
+        const std::vector<size_t>* members = &group.second;
+        pool.Submit([&folders, &runs, &options, &journal, members] {
+            std::vector<std::pair<FolderPlan*, FolderRun*>> drained;
+            for (size_t index : *members) {
+                if (!folders[index].chain.empty() && folders[index].failure.empty()) {
+                    drained.push_back({ &folders[index], &runs[index] });
+                }
+            }
+            FinishFolders(drained, journal, options.ioRingDepth);
+        });
+    }
+    pool.Wait();
+    journal.Close();
+
+    for (size_t i = 0; i < folders.size(); i++) {
+        AppendFolderResult(result, folders[i], runs[i]);
+    }
+
+    if (!options.traceDirectory.empty()) {
+        RecordSpan("job", "execute plan", traceStart);
+        FlushTrace(options.traceDirectory);
+    }
+    return result;
+}
+
+void AppendFolderResult(FolderProcessResult& result, const FolderPlan& folder, const FolderRun& run) {
+    if (!folder.failure.empty()) {
+        result.errorMessages += folder.folder.wstring() + L"\n";
+        result.errorMessages += L"  Reason: " + folder.failure + L"\n\n";
+        result.failureCount++;
+        Metrics().Failure(folder.failureReason);
+    } else if (run.succeeded) {
+        result.successCount++;
+        Metrics().foldersUnfolded.Add();
+    }
+}
+
+PlanSummary SummarizePlan(const UnfoldPlan& plan) {
+    PlanSummary summary;
+    for (const auto& folder : plan.folders) {
+        if (!folder.failure.empty()) {
+            summary.invalid++;
+            continue;
+        }
+        if (folder.chain.empty()) {
+            continue;
+        }
+        summary.folders++;
+        summary.conflicts += folder.conflicts;
+        summary.skipped += folder.skipped;
+        if (!folder.selfNamed.empty()) {
+            summary.entries++;
+            summary.renames++;
+        }
+        for (size_t i = 0; i < folder.items.size(); i++) {
+            summary.entries++;
+            if (folder.actions[i] == Resolution::Ask) {
+                summary.asked++;
+            }
+            if (folder.actions[i] == Resolution::Drop) {
+                summary.dropped++;
+                continue;
+            }
+            if (i < folder.copied.size() && folder.copied[i]) {
+                summary.copies++;
+                summary.bytesToCopy += folder.bytes[i];
+            } else {
+                summary.renames++;
+            }
+        }
+    }
+    summary.estimatedSeconds = summary.renames * ESTIMATE_SECONDS_PER_RENAME
+                             + summary.copies * ESTIMATE_SECONDS_PER_COPY
+                             + summary.bytesToCopy / ESTIMATE_COPY_BYTES_PER_SECOND;
+    return summary;
+}
+
+std::wstring DescribePlan(const PlanSummary& summary) {
+    std::wstringstream text;
+    text << summary.folders << L" folder(s), " << summary.entries << L" entries to move\n"
+         << summary.renames << L" renamed in place, " << summary.copies << L" copied across devices ("
+         << summary.bytesToCopy / (1024.0 * 1024.0) << L" MB)\n"
+         << summary.conflicts << L" conflict(s): " << summary.asked << L" left to ask, "
+         << summary.skipped << L" skipped, " << summary.dropped << L" dropped if identical\n";
+    if (summary.invalid > 0) {
+        text << summary.invalid << L" folder(s) cannot be unfolded\n";
+    }
+    text << L"Estimated time: " << summary.estimatedSeconds << L" s";
+    return text.str();
+}
+
+static const char* ActionName(Resolution action) {
+    switch (action) {
+    case Resolution::Replace: return "replace";
+    case Resolution::Ask: return "ask";
+    case Resolution::Merge: return "merge";
+    case Resolution::Drop: return "drop";
+    default: return "rename";
+    }
+}
+
+static void AppendPath(std::string& out, const fs::path& path) {
+    AppendJsonString(out, path.u8string());
+}
+
+std::string PlanToJson(const UnfoldPlan& plan) {
+    PlanSummary summary = SummarizePlan(plan);
+    std::string out = "{\n  \"version\": 1,\n  \"summary\": {";
+    out += "\"folders\": " + std::to_string(summary.folders);
+    out += ", \"entries\": " + std::to_string(summary.entries);
+    out += ", \"renames\": " + std::to_string(summary.renames);
+    out += ", \"copies\": " + std::to_string(summary.copies);
+    out += ", \"conflicts\": " + std::to_string(summary.conflicts);
+    out += ", \"asked\": " + std::to_string(summary.asked);
+    out += ", \"skipped\": " + std::to_string(summary.skipped);
+    out += ", \"invalid\": " + std::to_string(summary.invalid);
+    out += ", \"bytesToCopy\": " + std::to_string(summary.bytesToCopy);
+    out += ", \"estimatedSeconds\": " + std::to_string(summary.estimatedSeconds);
+    out += "},\n  \"folders\": [";
+
+    for (size_t f = 0; f < plan.folders.size(); f++) {
+        const auto& folder = plan.folders[f];
+        out += f == 0 ? "\n    {" : ",\n    {";
+        out += "\"folder\": ";
+        AppendPath(out, folder.folder);
+        if (!folder.failure.empty()) {
+            out += ", \"failure\": ";
+            AppendJsonString(out, fs::path(folder.failure).u8string());
+        }
+        out += ", \"crossDevice\": ";
+        out += folder.crossDevice ? "true" : "false";
+        out += ", \"conflicts\": " + std::to_string(folder.conflicts);
+        out += ", \"skipped\": " + std::to_string(folder.skipped);
+        out += ", \"fingerprint\": [";
+        for (size_t i = 0; i < folder.fingerprint.size(); i++) {
+            out += (i == 0 ? "" : ", ") + std::to_string(folder.fingerprint[i]);
+        }
+        out += "], \"chain\": [";
+        for (size_t i = 0; i < folder.chain.size(); i++) {
+            out += i == 0 ? "" : ", ";
+            AppendPath(out, folder.chain[i]);
+        }
+        out += "]";
+        if (!folder.selfNamed.empty()) {
+            out += ", \"selfNamed\": ";
+            AppendPath(out, folder.selfNamed);
+        }
+        if (folder.swapParent) {
+            out += ", \"swapParent\": true";
+        }
+        out += ", \"entries\": [";
+        for (size_t i = 0; i < folder.items.size(); i++) {
+            out += i == 0 ? "\n      {\"from\": " : ",\n      {\"from\": ";
+            AppendPath(out, folder.items[i].from);
+            out += ", \"to\": ";
+            AppendPath(out, folder.items[i].to);
+            out += ", \"action\": \"";
+            out += ActionName(folder.actions[i]);
+            out += "\"";
+            if (i < folder.copied.size() && folder.copied[i]) {
+                out += ", \"copy\": true, \"bytes\": " + std::to_string(folder.bytes[i]);
+            }
+            out += "}";
+        }
+        out += folder.items.empty() ? "]}" : "\n    ]}";
+    }
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+static int64_t IntegerOf(const JsonValue* value) {
+    return value != nullptr && value->type == JsonValue::Type::Number ? value->integer : 0;
+}
+
+static bool PathOf(const JsonValue* value, fs::path& path) {
+    if (value == nullptr || value->type != JsonValue::Type::String) {
+        return false;
+    }
+    path = fs::u8path(value->string);
+    return true;
+}
+
+bool PlanFromJson(const std::string& text, UnfoldPlan& plan) {
+    JsonValue root;
+    if (!ParseJson(text, root) || IntegerOf(root.Find("version")) != 1) {
+        return false;
+    }
+    const JsonValue* folders = root.Find("folders");
+    if (folders == nullptr || folders->type != JsonValue::Type::Array) {
+        return false;
+    }
+
+    plan.folders.clear();
+    for (const auto& node : folders->array) {
+        FolderPlan folder;
+        if (!PathOf(node.Find("folder"), folder.folder)) {
+            return false;
+        }
+        fs::path failure;
+        if (PathOf(node.Find("failure"), failure)) {
+            folder.failure = failure.wstring();
+            for (size_t reason = 0; reason < static_cast<size_t>(FolderFailure::Count); reason++) {
+                if (folder.failure == FAILURE_MESSAGES[reason]) {
+                    folder.failureReason = static_cast<FolderFailure>(reason);
+                }
+            }
+        }
+        const JsonValue* crossDevice = node.Find("crossDevice");
+        folder.crossDevice = crossDevice != nullptr && crossDevice->boolean;
+        folder.conflicts = static_cast<size_t>(IntegerOf(node.Find("conflicts")));
+        folder.skipped = static_cast<size_t>(IntegerOf(node.Find("skipped")));
+
+        if (const JsonValue* stamps = node.Find("fingerprint")) {
+            for (const auto& stamp : stamps->array) {
+                folder.fingerprint.push_back(stamp.integer);
+            }
+        }
+        if (const JsonValue* chain = node.Find("chain")) {
+            for (const auto& link : chain->array) {
+                fs::path path;
+                if (!PathOf(&link, path)) {
+                    return false;
+                }
+                folder.chain.push_back(path);
+            }
+        }
+        if (const JsonValue* entries = node.Find("entries")) {
+            for (const auto& entry : entries->array) {
+                MoveItem item;
+                if (!PathOf(entry.Find("from"), item.from) || !PathOf(entry.Find("to"), item.to)) {
+                    return false;
+                }
+                const JsonValue* action = entry.Find("action");
+                std::string name = action != nullptr ? action->string : "rename";
+                folder.actions.push_back(name == "replace" ? Resolution::Replace
+                                         : name == "ask" ? Resolution::Ask
+                                         : name == "merge" ? Resolution::Merge
+                                         : name == "drop" ? Resolution::Drop : Resolution::Move);
+                const JsonValue* copy = entry.Find("copy");
+                folder.copied.push_back(copy != nullptr && copy->boolean);
+                folder.bytes.push_back(static_cast<uint64_t>(IntegerOf(entry.Find("bytes"))));
+                folder.items.push_back(std::move(item));
+            }
+        }
+        PathOf(node.Find("selfNamed"), folder.selfNamed);
+        const JsonValue* swapParent = node.Find("swapParent");
+        folder.swapParent = swapParent != nullptr && swapParent->boolean;
+        if (folder.swapParent) {
+            for (const auto& item : folder.items) {
+                folder.parentFiles.push_back(item.from);
+            }
+        }
+        if ((!folder.items.empty() || !folder.selfNamed.empty()) && folder.chain.empty()) {
+            return false;
+        }
+        plan.folders.push_back(std::move(folder));
+    }
+    return true;
+}
+
+bool WritePlanFile(const fs::path& file, const UnfoldPlan& plan) {
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out << PlanToJson(plan);
+    return static_cast<bool>(out);
+}
+
+bool ReadPlanFile(const fs::path& file, UnfoldPlan& plan) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return PlanFromJson(text, plan);
+}
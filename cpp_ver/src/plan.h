@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "conflict.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "move_engine.h"
+#include "unfold.h"
+
+namespace fs = std::filesystem;
+
+// Entries PlanFolder classifies before handing them on to be moved
+#define PLAN_CHUNK_ENTRIES 8192
+
+class Journal;
+
+// One selected folder and the moves that unfold it
+struct FolderPlan {
+    fs::path folder;
+    std::vector<fs::path> chain;        // folder and its lifted wrappers; empty if nothing to move
+    std::vector<MoveItem> items;        // entries to move, with their final destination
+    std::vector<Resolution> actions;    // how each entry is moved
+    fs::path selfNamed;                 // entry named like the folder, lifted into its place once drained
+    bool swapParent = false;            // items are the parent's files going into the payload, which
+                                        // then takes the parent's place
+    std::vector<fs::path> parentFiles;  // those files where they were, to put back if the swap fails
+    std::vector<bool> copied;           // entry crosses devices and will be copied (dry run only)
+    std::vector<uint64_t> bytes;        // data copied for that entry (dry run only)
+    std::vector<int64_t> fingerprint;   // parent and chain modification times when planned
+    bool crossDevice = false;           // payload folder is on another volume than the parent
+    size_t conflicts = 0;               // entries whose name was already taken
+    size_t skipped = 0;                 // conflicting entries the policy leaves in place
+    std::wstring failure;               // why the folder cannot be unfolded
+    FolderFailure failureReason = FolderFailure::Invalid;  // the same, for metrics
+};
+
+// Every move of a job, decided without touching anything
+struct UnfoldPlan {
+    std::vector<FolderPlan> folders;
+};
+
+// Totals of a plan and a rough duration estimate
+struct PlanSummary {
+    size_t folders = 0;
+    size_t entries = 0;
+    size_t renames = 0;
+    size_t copies = 0;
+    size_t conflicts = 0;
+    size_t asked = 0;    // conflicts left to the user
+    size_t dropped = 0;  // conflicts deleted if still identical when they run
+    size_t skipped = 0;
+    size_t invalid = 0;
+    uint64_t bytesToCopy = 0;
+    double estimatedSeconds = 0;
+};
+
+// Follow single-folder wrappers below folder, at most depth levels (0 = no limit).
+// chain receives folder and every wrapper under it, top-down; the last one is the
+// folder whose entries get lifted.
+void FindPayloadFolder(const fs::path& folder, int depth, std::vector<fs::path>& chain);
+
+// Remove the drained folder and the wrappers above it, bottom-up
+bool RemoveFolderChain(const std::vector<fs::path>& chain);
+
+// Enumerate the selection and resolve every conflict. A dry run also measures
+// which entries cross devices, how many bytes they hold, and fingerprints the
+// folders so the plan can be executed later.
+UnfoldPlan PlanUnfold(const std::vector<std::wstring>& folderPaths, const UnfoldOptions& options, bool dryRun = false);
+
+// Carry out a plan. Folders whose fingerprint no longer matches are not touched.
+FolderProcessResult ExecutePlan(UnfoldPlan& plan, const UnfoldOptions& options);
+
+// Steps of running a plan, shared by ExecutePlan and UnfoldJob
+
+// Progress of one folder while its plan runs
+struct FolderRun {
+    uint64_t firstId = 0;              // journal id of items[0]
+    std::vector<MoveItem> slowItems;   // entries left for the slow path
+    std::vector<uint64_t> slowIds;
+    size_t remaining = 0;              // planned entries not moved yet
+    bool succeeded = false;
+};
+
+// Mark a folder failed, with the message shown for reason
+void FailFolder(FolderPlan& plan, FolderFailure reason);
+
+// Selected folder path without a trailing separator
+fs::path SelectedFolder(const std::wstring& path);
+
+// Enumerate a selection and decide where every entry goes. index holds the names
+// taken in the parent, shared by every selection with that parent; metadata is
+// the job's snapshot, which stats each parent once.
+// With emit set, every PLAN_CHUNK_ENTRIES classified entries are passed on while
+// enumeration continues; emit takes plan.items and plan.actions, and whatever
+// is left when PlanFolder returns is the last chunk. plan.chain and
+// plan.crossDevice are set before the first chunk. A folder that fails to read
+// after a chunk was emitted is left partly moved. Dry runs never emit.
+void PlanFolder(FolderPlan& plan, const UnfoldOptions& options, NameIndex& index, MetadataSnapshot& metadata, bool dryRun,
+                const std::function<void(FolderPlan&)>& emit = {});
+
+// Rename what can be renamed in place and copy cross-device replacements over
+// their destinations (CopyReplace); unresolved conflicts and other cross-device
+// entries are left for the slow path. Batches go through options.ioRingDepth
+// and merges use up to options.workers threads.
+void MoveFolder(FolderPlan& plan, FolderRun& run, Journal& journal, const UnfoldOptions& options);
+
+// Delete drained folders. A folder is known to be empty when every planned
+// entry has moved and none was skipped, so it is not read again. A folder with
+// a self-named entry is replaced by that entry instead, and a swapped folder's
+// payload replaces the parent; both lifts are journaled and synced first.
+void FinishFolders(const std::vector<std::pair<FolderPlan*, FolderRun*>>& folders, Journal& journal, unsigned ringDepth = 0);
+
+// Count a folder's outcome into result
+void AppendFolderResult(FolderProcessResult& result, const FolderPlan& folder, const FolderRun& run);
+
+PlanSummary SummarizePlan(const UnfoldPlan& plan);
+
+// One-paragraph description of a summary for the user
+std::wstring DescribePlan(const PlanSummary& summary);
+
+std::string PlanToJson(const UnfoldPlan& plan);
+bool PlanFromJson(const std::string& text, UnfoldPlan& plan);
+
+bool WritePlanFile(const fs::path& file, const UnfoldPlan& plan);
+bool ReadPlanFile(const fs::path& file, UnfoldPlan& plan);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Bounded hand-off between two stages of a pipeline. Items are weighted (by the
+// entries they carry) and Push blocks while the queue holds capacity or more,
+// so a fast producer runs at most that far ahead of its consumer. An empty
+// queue admits any item, however heavy.
+template<typename T>
+class StageQueue {
+public:
+    explicit StageQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    StageQueue(const StageQueue&) = delete;
+    StageQueue& operator=(const StageQueue&) = delete;
+
+    void Push(T item, size_t weight) {
+        std::unique_lock<std::mutex> lock(mutex);
+        hasRoom.wait(lock, [this] { return load < capacity; });
+        items.push_back({ std::move(item), weight });
+        load += weight;
+        hasItems.notify_one();
+    }
+
+    // Block for the next item; false once the queue is closed and empty
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        hasItems.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front().first);
+        load -= items.front().second;
+        items.pop_front();
+        hasRoom.notify_all();
+        return true;
+    }
+
+    // Block for at least one item and take everything queued
+    bool PopAll(std::vector<T>& out) {
+        std::unique_lock<std::mutex> lock(mutex);
+        hasItems.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) {
+            return false;
+        }
+        for (auto& entry : items) {
+            out.push_back(std::move(entry.first));
+        }
+        items.clear();
+        load = 0;
+        hasRoom.notify_all();
+        return true;
+    }
+
+    // No more items; consumers finish what is queued and then stop
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        hasItems.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable hasItems;
+    std::condition_variable hasRoom;
+    std::deque<std::pair<T, size_t>> items;
+    size_t capacity;
+    size_t load = 0;
+    bool closed = false;
+};
@@ -0,0 +1,103 @@
+#include "timing.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "json.h"
+
+static const char* const PHASE_NAMES[] = {
+    "startup", "arguments", "handoff", "config", "recovery", "collect", "scan",
+    "plan", "journal", "move", "slow_path", "delete", "job", "total",
+};
+static_assert(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]) == static_cast<size_t>(Phase::Count),
+              "every phase needs a name");
+
+static std::atomic<int64_t> phaseNanos[static_cast<size_t>(Phase::Count)];
+
+const char* PhaseName(Phase phase) {
+    return PHASE_NAMES[static_cast<size_t>(phase)];
+}
+
+void AddPhaseTime(Phase phase, std::chrono::steady_clock::duration elapsed) {
+    phaseNanos[static_cast<size_t>(phase)].fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+}
+
+void ResetPhaseTimes() {
+    for (auto& nanos : phaseNanos) {
+        nanos.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::chrono::steady_clock::duration ProcessAge() {
+#ifdef _WIN32
+    FILETIME creation, exitTime, kernel, user, now;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user)) {
+        return {};
+    }
+    GetSystemTimePreciseAsFileTime(&now);
+    ULARGE_INTEGER start = { { creation.dwLowDateTime, creation.dwHighDateTime } };
+    ULARGE_INTEGER current = { { now.dwLowDateTime, now.dwHighDateTime } };
+    if (current.QuadPart < start.QuadPart) {
+        return {};
+    }
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::nanoseconds((current.QuadPart - start.QuadPart) * 100));
+#else
+    // Field 22 of /proc/self/stat is the start time in clock ticks since boot
+    std::ifstream statFile("/proc/self/stat");
+    std::string stat((std::istreambuf_iterator<char>(statFile)), std::istreambuf_iterator<char>());
+    size_t field = stat.rfind(')');
+    if (field == std::string::npos) {
+        return {};
+    }
+    std::istringstream fields(stat.substr(field + 2));
+    std::string skipped;
+    for (int i = 3; i < 22; i++) {
+        fields >> skipped;
+    }
+    unsigned long long startTicks;
+    timespec boot;
+    if (!(fields >> startTicks) || clock_gettime(CLOCK_BOOTTIME, &boot) != 0) {
+        return {};
+    }
+    long ticksPerSecond = sysconf(_SC_CLK_TCK);
+    int64_t started = static_cast<int64_t>(startTicks) * 1000000000 / ticksPerSecond;
+    int64_t now = static_cast<int64_t>(boot.tv_sec) * 1000000000 + boot.tv_nsec;
+    return std::chrono::nanoseconds(now > started ? now - started : 0);
+#endif
+}
+
+bool WriteTimingRecord(const fs::path& log, const char* mode, size_t folders, const FolderProcessResult& result) {
+    std::string line = "{\"time\":" + std::to_string(static_cast<long long>(std::time(nullptr)));
+    line += ",\"mode\":";
+    AppendJsonString(line, mode);
+    line += ",\"folders\":" + std::to_string(folders);
+    line += ",\"succeeded\":" + std::to_string(result.successCount);
+    line += ",\"failed\":" + std::to_string(result.failureCount);
+    line += ",\"us\":{";
+    for (size_t i = 0; i < static_cast<size_t>(Phase::Count); i++) {
+        int64_t nanos = phaseNanos[i].exchange(0, std::memory_order_relaxed);
+        line += i == 0 ? "\"" : ",\"";
+        line += PHASE_NAMES[i];
+        line += "\":" + std::to_string(nanos / 1000);
+    }
+    line += "}}\n";
+
+    // One write per record, so concurrent instances append whole lines
+    std::error_code ec;
+    fs::create_directories(log.parent_path(), ec);
+    std::ofstream file(log, std::ios::binary | std::ios::app);
+    file.write(line.data(), static_cast<std::streamsize>(line.size()));
+    return static_cast<bool>(file);
+}
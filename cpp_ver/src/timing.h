@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+
+#include "unfold.h"
+
+namespace fs = std::filesystem;
+
+// Stages of a run, from process creation to the last folder deleted. Scan, Plan,
+// Journal, Move and Delete run on every worker at once, so their times are summed
+// over workers and can exceed Job, the wall time from the first folder added to
+// the job's end.
+enum class Phase {
+    Startup,    // process creation to main (OS start time, so clock-tick resolution on Linux)
+    Arguments,
+    Handoff,    // daemon submission, mutex and shared ring setup or send
+    Config,
+    Recovery,
+    Collect,    // admitting folders from other instances once our own are done
+    Scan,       // parent name indexes
+    Plan,
+    Journal,
+    Move,
+    SlowPath,
+    Delete,
+    Job,
+    Total,
+    Count
+};
+
+const char* PhaseName(Phase phase);
+
+void AddPhaseTime(Phase phase, std::chrono::steady_clock::duration elapsed);
+
+// Adds the lifetime of the enclosing scope to a phase. Two clock reads per
+// stage or batch, so the timers stay on and only the log is switched.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() { AddPhaseTime(phase, std::chrono::steady_clock::now() - start); }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Zero every phase
+void ResetPhaseTimes();
+
+// Time since the OS created this process
+std::chrono::steady_clock::duration ProcessAge();
+
+// Append one JSON line with every phase in microseconds to log, then zero the
+// phases so a daemon's next job starts clean. mode names how the run went
+// ("first", "join", "daemon-client", "daemon", "watch", "plan", "extract").
+bool WriteTimingRecord(const fs::path& log, const char* mode, size_t folders, const FolderProcessResult& result);
@@ -0,0 +1,174 @@
+#include "trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "json.h"
+
+// Spans buffered per thread before a buffer grows
+#define TRACE_BUFFER_RESERVE 4096
+
+std::atomic<bool> tracingEnabled{false};
+
+struct TraceEvent {
+    const char* category;
+    const char* name;
+    int64_t start;
+    int64_t duration;
+    uint32_t detail;   // index into the thread's details, or NO_DETAIL
+};
+
+#define NO_DETAIL UINT32_MAX
+
+// One thread's spans. The lock is only ever contended while a trace is written.
+struct ThreadTrace {
+    std::mutex mutex;
+    uint64_t tid;
+    std::vector<TraceEvent> events;
+    std::vector<std::string> details;
+};
+
+// Buffers outlive their threads, so a pool torn down mid-job loses nothing
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadTrace>> threadTraces;
+static std::atomic<int64_t> traceOrigin{0};
+
+static uint64_t CurrentThreadId() {
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    return static_cast<uint64_t>(syscall(SYS_gettid));
+#endif
+}
+
+static ThreadTrace& ThisThreadTrace() {
+    thread_local ThreadTrace* trace = nullptr;
+    if (trace == nullptr) {
+        std::unique_ptr<ThreadTrace> created(new ThreadTrace);
+        created->tid = CurrentThreadId();
+        created->events.reserve(TRACE_BUFFER_RESERVE);
+        std::lock_guard<std::mutex> lock(registryMutex);
+        trace = created.get();
+        threadTraces.push_back(std::move(created));
+    }
+    return *trace;
+}
+
+int64_t TraceClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RecordSpan(const char* category, const char* name, int64_t start, const std::string& detail) {
+    int64_t end = TraceClock();
+    ThreadTrace& trace = ThisThreadTrace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    uint32_t detailIndex = NO_DETAIL;
+    if (!detail.empty()) {
+        detailIndex = static_cast<uint32_t>(trace.details.size());
+        trace.details.push_back(detail);
+    }
+    trace.events.push_back({ category, name, start, end - start, detailIndex });
+}
+
+void StartTrace() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& trace : threadTraces) {
+        std::lock_guard<std::mutex> threadLock(trace->mutex);
+        trace->events.clear();
+        trace->details.clear();
+    }
+    traceOrigin.store(TraceClock(), std::memory_order_relaxed);
+    tracingEnabled.store(true, std::memory_order_relaxed);
+}
+
+// Append nanoseconds as microseconds with three decimals, without printf
+static void AppendMicros(std::string& out, int64_t nanos) {
+    if (nanos < 0) {
+        out += '-';
+        nanos = -nanos;
+    }
+    char digits[24];
+    int length = 0;
+    do {
+        digits[length++] = static_cast<char>('0' + nanos % 10);
+        nanos /= 10;
+    } while (nanos > 0 || length < 4);
+    while (length > 3) {
+        out += digits[--length];
+    }
+    out += '.';
+    while (length > 0) {
+        out += digits[--length];
+    }
+}
+
+fs::path FlushTrace(const fs::path& directory) {
+    tracingEnabled.store(false, std::memory_order_relaxed);
+
+    static std::atomic<unsigned> traceNumber{0};
+#ifdef _WIN32
+    unsigned long long pid = GetCurrentProcessId();
+#else
+    unsigned long long pid = static_cast<unsigned long long>(getpid());
+#endif
+    char name[96];
+    std::snprintf(name, sizeof(name), "unfold-%lld-%llu-%u.json", static_cast<long long>(std::time(nullptr)), pid,
+                  traceNumber.fetch_add(1));
+    fs::path file = directory / name;
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return fs::path();
+    }
+
+    int64_t origin = traceOrigin.load(std::memory_order_relaxed);
+    std::string pidText = std::to_string(pid);
+    bool first = true;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& trace : threadTraces) {
+        std::lock_guard<std::mutex> threadLock(trace->mutex);
+        // Everything up to the category is the same for every span of a thread
+        std::string prefix = "{\"ph\":\"X\",\"pid\":" + pidText + ",\"tid\":" + std::to_string(trace->tid) + ",\"cat\":\"";
+        std::string chunk;
+        chunk.reserve(trace->events.size() * (prefix.size() + 64));
+        for (const auto& event : trace->events) {
+            chunk += first ? "\n" : ",\n";
+            first = false;
+            chunk += prefix;
+            chunk += event.category;
+            chunk += "\",\"name\":\"";
+            chunk += event.name;
+            chunk += "\",\"ts\":";
+            AppendMicros(chunk, event.start - origin);
+            chunk += ",\"dur\":";
+            AppendMicros(chunk, event.duration);
+            if (event.detail != NO_DETAIL) {
+                chunk += ",\"args\":{\"path\":";
+                AppendJsonString(chunk, trace->details[event.detail]);
+                chunk += "}";
+            }
+            chunk += "}";
+        }
+        out << chunk;
+        // Give the memory back; a daemon's next job may be much smaller
+        std::vector<TraceEvent>().swap(trace->events);
+        std::vector<std::string>().swap(trace->details);
+    }
+    out << "\n]}\n";
+    return out.flush() ? file : fs::path();
+}
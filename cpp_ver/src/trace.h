@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Opt-in span recorder writing Chrome trace-event JSON (Perfetto, chrome://tracingEnabled).
+// Each thread appends to its own buffer; nothing is formatted or written until
+// the job ends. While tracingEnabled is off a span costs one relaxed load.
+
+extern std::atomic<bool> tracingEnabled;
+
+// Nanoseconds on the steady clock
+int64_t TraceClock();
+
+// Record a finished span. category and name must be string literals.
+void RecordSpan(const char* category, const char* name, int64_t start, const std::string& detail = std::string());
+
+// Records the lifetime of the enclosing scope
+class TraceSpan {
+public:
+    TraceSpan(const char* category, const char* name)
+        : category(category), name(tracingEnabled.load(std::memory_order_relaxed) ? name : nullptr) {
+        if (this->name != nullptr) {
+            start = TraceClock();
+        }
+    }
+    // detail (a folder, usually) is only converted when tracingEnabled is on
+    TraceSpan(const char* category, const char* name, const fs::path& detail) : TraceSpan(category, name) {
+        if (this->name != nullptr) {
+            this->detail = detail.u8string();
+        }
+    }
+    ~TraceSpan() {
+        if (name != nullptr) {
+            RecordSpan(category, name, start, detail);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* category;
+    const char* name;
+    int64_t start = 0;
+    std::string detail;
+};
+
+// Drop anything buffered and start recording
+void StartTrace();
+
+// Stop recording and write every buffered span to a new trace file in directory.
+// Returns the file, or an empty path when it could not be written.
+fs::path FlushTrace(const fs::path& directory);
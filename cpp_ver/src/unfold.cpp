@@ -0,0 +1,61 @@
+#include "unfold.h"
+#include "directory_reader.h"
+#include "job.h"
+#include "move_engine.h"
+#include "path_list.h"
+#include "plan.h"
+
+#include <iostream>
+
+bool MoveFilesToParent(const std::vector<fs::path>& files, const fs::path& parent) {
+    if (files.empty()) {
+        return true;
+    }
+
+    std::vector<MoveItem> items;
+    items.reserve(files.size());
+    for (const auto& file : files) {
+        items.push_back({ file, ChildPath(parent, file) });
+    }
+
+    MoveReport report = MoveEntries(items, SameDevice(files.front().parent_path(), parent));
+    if (!report.failed.empty() || report.aborted) {
+        for (size_t index : report.failed) {
+            std::wcout << L"file not moved: " << items[index].from.wstring() << L"\n"; // 记录未移动的文件
+        }
+        return false; // 失败（用户可能选择了跳过）
+    }
+    return true; // 移动成功
+}
+
+bool MoveFolderContents(const fs::path& folder, int depth) {
+    fs::path parent = folder.parent_path();
+    std::vector<fs::path> chain;
+    std::vector<fs::path> files;
+
+    FindPayloadFolder(folder, depth, chain);
+    DirectoryReader reader(ThreadDirectoryBuffer(), DIRECTORY_BUFFER_SIZE);
+    DirectoryEntry entry;
+    std::error_code ec;
+    if (reader.Open(chain.back(), ec)) {
+        while (reader.Next(entry, ec)) {
+            files.push_back(ChildPath(chain.back(), entry.name));
+        }
+    }
+    if (ec) {
+        return false; // 无法读取文件夹
+    }
+
+    // Every entry listed has moved, so the payload folder is empty
+    if (MoveFilesToParent(files, parent)) {
+        return RemoveFolderChain(chain);
+    }
+
+    return false; // 移动失败或文件夹非空
+}
+
+FolderProcessResult ProcessMultipleFolders(const std::vector<std::wstring>& folderPaths, const UnfoldOptions& options) {
+    UnfoldJob job(options);
+    job.Add(folderPaths);
+    return job.Finish();
+}
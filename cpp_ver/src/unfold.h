@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "conflict.h"
+
+namespace fs = std::filesystem;
+
+// Process multiple folders at once
+struct FolderProcessResult {
+    int successCount;
+    int failureCount;
+    std::wstring errorMessages;
+    uint64_t bytesCopied = 0;   // data copied because it crossed devices
+    double copySeconds = 0;
+};
+
+// How far a folder is unfolded
+struct UnfoldOptions {
+    // Levels of single-folder wrappers to lift through (a/b/c/payload is depth 3).
+    // 0 collapses every wrapper down to the first level that holds more than one
+    // entry or a file.
+    int depth = 1;
+
+    // Worker threads for selections with different parents (0 = one per core)
+    int workers = 0;
+
+    // Applied to every entry whose name is already taken in the destination
+    ConflictPolicy conflictPolicy = ConflictPolicy::Ask;
+
+    // Renames and folder deletes kept in flight through io_uring (Linux);
+    // 0 issues them one syscall at a time
+    unsigned ioRingDepth = 0;
+
+    // When the parent holds only a few files besides a large selection, move
+    // those into the selection and let it take the parent's place (POSIX).
+    // Off by default: the parent's timestamps, ACLs and xattrs are not kept.
+    bool swapParent = false;
+
+    // Where the write-ahead journal goes; empty runs the job unjournaled
+    fs::path journalDirectory;
+
+    // Where each job writes a Chrome trace of its spans; empty leaves tracing off
+    fs::path traceDirectory;
+};
+
+// Move files into parent, renaming natively where possible
+bool MoveFilesToParent(const std::vector<fs::path>& files, const fs::path& parent);
+
+// 处理整个文件夹
+bool MoveFolderContents(const fs::path& folder, int depth = 1);
+
+FolderProcessResult ProcessMultipleFolders(const std::vector<std::wstring>& folderPaths, const UnfoldOptions& options = {});
@@ -0,0 +1,359 @@
+#include "watch.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+#endif
+
+#include "config.h"
+#include "daemon.h"
+#include "plan.h"
+#include "trace.h"
+
+#define WATCH_EVENT_BUFFER 65536   // bytes of events taken per read (the most a network share delivers on Windows)
+
+#ifdef __linux__
+// Changes that keep a new folder's tree from counting as settled
+#define WATCH_TREE_EVENTS (IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB)
+#endif
+
+#ifdef _WIN32
+// One root, with its pending ReadDirectoryChangesW over the whole subtree
+struct WatchedRoot {
+    fs::path path;
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    OVERLAPPED overlapped = {};
+    DWORD buffer[WATCH_EVENT_BUFFER / sizeof(DWORD)];
+
+    ~WatchedRoot() {
+        if (handle != INVALID_HANDLE_VALUE) {
+            // The kernel writes into buffer until the cancelled read completes
+            DWORD bytes;
+            if (CancelIoEx(handle, &overlapped) || GetLastError() != ERROR_NOT_FOUND) {
+                GetOverlappedResult(handle, &overlapped, &bytes, TRUE);
+            }
+            CloseHandle(handle);
+        }
+        if (overlapped.hEvent != NULL) {
+            CloseHandle(overlapped.hEvent);
+        }
+    }
+
+    bool Listen() {
+        ResetEvent(overlapped.hEvent);
+        return ReadDirectoryChangesW(handle, buffer, sizeof(buffer), TRUE,
+                                     FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_FILE_NAME |
+                                         FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                     NULL, &overlapped, NULL) != 0;
+    }
+};
+#endif
+
+FolderWatcher::FolderWatcher(int settleMs) : settle(settleMs) {
+#ifdef _WIN32
+    wake = CreateEventW(NULL, TRUE, FALSE, NULL);
+#elif defined(__linux__)
+    notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+}
+
+FolderWatcher::~FolderWatcher() {
+#ifdef _WIN32
+    roots.clear();
+    if (wake != nullptr) {
+        CloseHandle(wake);
+    }
+#else
+    if (notify >= 0) {
+        close(notify);
+    }
+    if (wake >= 0) {
+        close(wake);
+    }
+#endif
+}
+
+bool FolderWatcher::Watch(const fs::path& root, std::error_code& ec) {
+    ec.clear();
+#ifdef _WIN32
+    std::unique_ptr<WatchedRoot> watch(new WatchedRoot);
+    watch->path = root;
+    watch->handle = CreateFileW(root.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    watch->overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (watch->handle == INVALID_HANDLE_VALUE || watch->overlapped.hEvent == NULL || !watch->Listen()) {
+        ec.assign(static_cast<int>(GetLastError()), std::system_category());
+        return false;
+    }
+    if (roots.size() + 1 >= MAXIMUM_WAIT_OBJECTS) {
+        ec = std::make_error_code(std::errc::too_many_files_open);
+        return false;
+    }
+    roots.push_back(std::move(watch));
+    return true;
+#elif defined(__linux__)
+    int wd = notify < 0 || wake < 0 ? -1 : inotify_add_watch(notify, root.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0) {
+        ec.assign(errno, std::generic_category());
+        return false;
+    }
+    watched[wd] = WatchedFolder{ root, fs::path() };
+    return true;
+#else
+    (void)root;
+    ec = std::make_error_code(std::errc::not_supported);
+    return false;
+#endif
+}
+
+void FolderWatcher::Stop() {
+    stopped = true;
+#ifdef _WIN32
+    SetEvent(wake);
+#elif defined(__linux__)
+    uint64_t one = 1;
+    if (write(wake, &one, sizeof(one)) < 0) {
+        // the counter is already set
+    }
+#endif
+}
+
+// Record activity under folder; a folder that just appeared becomes a candidate
+void FolderWatcher::Changed(const fs::path& folder, bool appeared) {
+    auto now = std::chrono::steady_clock::now();
+    if (appeared) {
+        pending[folder].changed = now;
+        return;
+    }
+    auto candidate = pending.find(folder);
+    if (candidate != pending.end()) {
+        candidate->second.changed = now;
+    }
+}
+
+#ifdef __linux__
+// Watch folder and every folder already below it as part of candidate. A
+// folder created while this runs shows up as an event on its parent.
+void FolderWatcher::WatchTree(const fs::path& folder, const fs::path& candidate) {
+    auto entry = pending.find(candidate);
+    if (entry == pending.end()) {
+        return;
+    }
+    auto add = [&](const fs::path& path) {
+        // Past the inotify watch limit the candidate settles on what the watched part shows
+        int wd = inotify_add_watch(notify, path.c_str(), WATCH_TREE_EVENTS | IN_ONLYDIR | IN_DONT_FOLLOW);
+        if (wd >= 0) {
+            watched[wd] = WatchedFolder{ path, candidate };
+            entry->second.watches.push_back(wd);
+        }
+    };
+    add(folder);
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec) && !it->is_symlink(ec)) {
+            add(it->path());
+        }
+    }
+}
+
+// Drop the watches that still belong to candidate; a watch handed to a folder
+// that reused the inode stays
+void FolderWatcher::Unwatch(const fs::path& candidate, const std::vector<int>& watches) {
+    for (int wd : watches) {
+        auto it = watched.find(wd);
+        if (it != watched.end() && it->second.candidate == candidate) {
+            inotify_rm_watch(notify, wd);
+            watched.erase(it);
+        }
+    }
+}
+#endif
+
+bool FolderWatcher::WaitForEvents(int timeoutMs) {
+#ifdef _WIN32
+    std::vector<HANDLE> handles;
+    for (const auto& root : roots) {
+        handles.push_back(root->overlapped.hEvent);
+    }
+    handles.push_back(wake);
+    DWORD waited = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE,
+                                          timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs));
+    return waited < WAIT_OBJECT_0 + handles.size();
+#elif defined(__linux__)
+    pollfd fds[2] = { { notify, POLLIN, 0 }, { wake, POLLIN, 0 } };
+    int ready = poll(fds, 2, timeoutMs);
+    return ready > 0;
+#else
+    (void)timeoutMs;
+    return false;
+#endif
+}
+
+void FolderWatcher::ReadEvents() {
+#ifdef _WIN32
+    for (auto& root : roots) {
+        DWORD bytes = 0;
+        if (WaitForSingleObject(root->overlapped.hEvent, 0) != WAIT_OBJECT_0 ||
+            !GetOverlappedResult(root->handle, &root->overlapped, &bytes, FALSE)) {
+            continue;
+        }
+        if (bytes == 0) {
+            // The buffer overflowed and the events are lost: hold every candidate back
+            for (auto& candidate : pending) {
+                candidate.second.changed = std::chrono::steady_clock::now();
+            }
+        }
+        const char* next = reinterpret_cast<const char*>(root->buffer);
+        while (bytes > 0) {
+            const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(next);
+            std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+            size_t slash = name.find(L'\\');
+            fs::path folder = root->path / name.substr(0, slash);
+            bool created = info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME;
+            bool appeared = false;
+            if (slash == std::wstring::npos && created && !name.empty() && name[0] != L'.') {
+                DWORD attributes = GetFileAttributesW(folder.c_str());
+                appeared = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+                           !(attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+            }
+            Changed(folder, appeared);
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            next += info->NextEntryOffset;
+        }
+        root->Listen();
+    }
+#elif defined(__linux__)
+    uint64_t count;
+    if (read(wake, &count, sizeof(count)) < 0) {
+        // nothing to clear
+    }
+    alignas(inotify_event) char buffer[WATCH_EVENT_BUFFER];
+    for (;;) {
+        ssize_t length = read(notify, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            return; // drained
+        }
+        for (const char* next = buffer; next < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(next);
+            next += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (auto& candidate : pending) {
+                    candidate.second.changed = std::chrono::steady_clock::now();
+                }
+                continue;
+            }
+            auto it = watched.find(event->wd);
+            if (it == watched.end()) {
+                continue; // removed while the event was queued
+            }
+            if (event->mask & IN_IGNORED) {
+                watched.erase(it);
+                continue;
+            }
+            bool newFolder = (event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) && event->len > 0;
+            fs::path parent = it->second.path;
+            fs::path candidate = it->second.candidate;
+            if (candidate.empty()) {
+                // A root: only folders appearing in it are of interest, and
+                // hidden ones are temporary (our own swaps among them)
+                if (newFolder && event->name[0] != '.') {
+                    fs::path folder = parent / event->name;
+                    Changed(folder, true);
+                    WatchTree(folder, folder);
+                }
+                continue;
+            }
+            Changed(candidate, false);
+            if (newFolder) {
+                WatchTree(parent / event->name, candidate);
+            }
+        }
+    }
+#endif
+}
+
+// Hand over every candidate quiet for the settle time that turned out to be a wrapper
+size_t FolderWatcher::TakeSettled(std::vector<std::wstring>& paths) {
+    auto now = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (auto it = pending.begin(); it != pending.end();) {
+        if (now - it->second.changed < settle) {
+            ++it;
+            continue;
+        }
+#ifdef __linux__
+        Unwatch(it->first, it->second.watches);
+#endif
+        std::vector<fs::path> chain;
+        FindPayloadFolder(it->first, 2, chain);
+        if (chain.size() == 2) {
+            paths.push_back(chain.back().wstring());
+            found++;
+        }
+        it = pending.erase(it);
+    }
+    return found;
+}
+
+size_t FolderWatcher::Receive(std::vector<std::wstring>& paths, int timeoutMs) {
+    auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        size_t found = TakeSettled(paths);
+        if (found > 0 || stopped) {
+            return stopped ? 0 : found;
+        }
+
+        // Sleep until the caller's deadline or the first candidate's, whichever comes first
+        auto now = std::chrono::steady_clock::now();
+        int wait = -1;
+        if (timeoutMs >= 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(start + std::chrono::milliseconds(timeoutMs) - now);
+            if (left.count() <= 0) {
+                return 0;
+            }
+            wait = static_cast<int>(left.count());
+        }
+        for (const auto& candidate : pending) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(candidate.second.changed + settle - now);
+            int ms = left.count() > 0 ? static_cast<int>(left.count()) + 1 : 0;
+            if (wait < 0 || ms < wait) {
+                wait = ms;
+            }
+        }
+        if (WaitForEvents(wait)) {
+            TraceSpan span("watch", "read events");
+            ReadEvents();
+        }
+    }
+}
+
+int RunWatch(const std::vector<std::wstring>& folders, const fs::path& configPath,
+             const std::function<void(const FolderProcessResult&)>& report, std::wstring& error) {
+    if (folders.empty()) {
+        error = L"No folders to watch";
+        return 1;
+    }
+    FolderWatcher watcher(ReadConfigInt(configPath, L"WatchSettle", WATCH_SETTLE_MS));
+    for (const auto& folder : folders) {
+        std::error_code ec;
+        if (!watcher.Watch(folder, ec)) {
+            error = L"Cannot watch " + folder + L": " + fs::path(ec.message()).wstring();
+            return 1;
+        }
+    }
+    return ServeJobs(watcher, configPath, "watch", report);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "path_ring.h"
+#include "unfold.h"
+
+namespace fs = std::filesystem;
+
+// Quiet time before a new folder counts as finished, in ms (config key WatchSettle)
+#define WATCH_SETTLE_MS 2000
+
+struct WatchedRoot;
+
+// Folders appearing directly in the watched roots, delivered as their wrapped
+// child once nothing under them has changed for the settle time: a new folder
+// whose only entry is another folder hands over that folder, anything else is
+// left alone. Linux watches each new folder's tree with inotify; Windows
+// watches every root's subtree with ReadDirectoryChangesW. Receive sleeps in
+// the kernel until an event or a deadline, so an idle watcher costs nothing.
+class FolderWatcher : public PathSource {
+public:
+    explicit FolderWatcher(int settleMs = WATCH_SETTLE_MS);
+    ~FolderWatcher();
+
+    FolderWatcher(const FolderWatcher&) = delete;
+    FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+    // Start reporting folders created in or moved into root
+    bool Watch(const fs::path& root, std::error_code& ec);
+
+    // Append the wrapped folders that settle within timeoutMs (negative waits
+    // forever). Returns how many were found; 0 once Stop was called.
+    size_t Receive(std::vector<std::wstring>& paths, int timeoutMs) override;
+
+    // Wake Receive from another thread and make it return from now on
+    void Stop();
+
+private:
+    // A new folder still being written
+    struct Candidate {
+        std::chrono::steady_clock::time_point changed;
+        std::vector<int> watches;
+    };
+
+    bool WaitForEvents(int timeoutMs);
+    void ReadEvents();
+    void Changed(const fs::path& folder, bool appeared);
+    size_t TakeSettled(std::vector<std::wstring>& paths);
+
+    std::chrono::milliseconds settle;
+    std::map<fs::path, Candidate> pending;
+    std::atomic<bool> stopped{ false };
+#ifdef _WIN32
+    std::vector<std::unique_ptr<WatchedRoot>> roots;
+    void* wake = nullptr;
+#else
+    struct WatchedFolder {
+        fs::path path;
+        fs::path candidate;   // empty for a root
+    };
+
+    void WatchTree(const fs::path& folder, const fs::path& candidate);
+    void Unwatch(const fs::path& candidate, const std::vector<int>& watches);
+
+    std::unordered_map<int, WatchedFolder> watched;
+    int notify = -1;
+    int wake = -1;
+#endif
+};
+
+// Unfold the wrappers that appear in folders until the process is killed,
+// through ServeJobs with the daemon's warm pool. Returns 1 with a message in
+// error when a folder cannot be watched.
+int RunWatch(const std::vector<std::wstring>& folders, const fs::path& configPath,
+             const std::function<void(const FolderProcessResult&)>& report, std::wstring& error);
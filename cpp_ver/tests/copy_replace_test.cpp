@@ -0,0 +1,60 @@
+// CopyReplace must leave the destination alone until the copy is complete: a
+// copy that fails partway (a fifo cannot be copied) keeps the old destination
+// and the source, and a complete one takes the destination's place and removes
+// the source. Exits 1 otherwise.
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "move_engine.h"
+
+static std::string ReadFile(const fs::path& path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+static int failures = 0;
+
+static void Expect(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "failed: %s\n", what);
+        failures++;
+    }
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("unfolder-copy-replace-test-" + std::to_string(getpid()));
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir / "source" / "sub");
+    fs::create_directories(dir / "target");
+    std::ofstream(dir / "source" / "sub" / "new") << "new";
+    std::ofstream(dir / "target" / "old") << "old";
+    mkfifo((dir / "source" / "fifo").c_str(), 0600);
+
+    uint64_t bytes = 0;
+    Expect(CopyReplace(dir / "source", dir / "target", bytes, ec) == MoveStatus::Failed, "copy with a fifo fails");
+    Expect(ReadFile(dir / "target" / "old") == "old", "failed copy keeps the destination");
+    Expect(fs::exists(dir / "source" / "sub" / "new"), "failed copy keeps the source");
+    Expect(!fs::exists(dir / ".target.unfold"), "failed copy removes its temporary");
+
+    fs::remove(dir / "source" / "fifo");
+    Expect(CopyReplace(dir / "source", dir / "target", bytes, ec) == MoveStatus::Moved, "folder copy succeeds");
+    Expect(ReadFile(dir / "target" / "sub" / "new") == "new", "copy takes the destination's place");
+    Expect(!fs::exists(dir / "target" / "old"), "old destination is gone");
+    Expect(!fs::exists(dir / "source"), "source is deleted after the copy");
+    Expect(bytes == 3, "copied bytes are counted");
+
+    std::ofstream(dir / "file") << "file";
+    std::ofstream(dir / "other") << "other";
+    Expect(CopyReplace(dir / "file", dir / "other", bytes, ec) == MoveStatus::Moved, "file copy succeeds");
+    Expect(ReadFile(dir / "other") == "file" && !fs::exists(dir / "file"), "file replaces file");
+
+    fs::remove_all(dir, ec);
+    return failures == 0 ? 0 : 1;
+}
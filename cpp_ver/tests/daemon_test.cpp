@@ -0,0 +1,51 @@
+// A relative folder submitted to the daemon must reach it resolved against the
+// client's working directory, not the daemon's. Exits 1 on a mismatch.
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "daemon.h"
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("unfolder-daemon-test-" + std::to_string(getpid()));
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir / "daemon" / "p" / "a");
+    fs::create_directories(dir / "client" / "p" / "a");
+
+    // An endpoint of our own, so a daemon the user runs is left alone
+    setenv("XDG_RUNTIME_DIR", dir.c_str(), 1);
+
+    int failures = 0;
+    {
+        fs::current_path(dir / "daemon");
+        DaemonServer server;
+        if (!server.Listen()) {
+            std::fprintf(stderr, "daemon endpoint could not be claimed\n");
+            return 1;
+        }
+
+        fs::current_path(dir / "client");
+        fs::path expected = fs::current_path() / "p" / "a";
+        if (!SubmitToDaemon({ L"p/a" })) {
+            std::fprintf(stderr, "daemon did not acknowledge the job\n");
+            failures++;
+        }
+
+        fs::current_path(dir / "daemon");
+        std::vector<std::wstring> paths;
+        server.Receive(paths, 2000);
+        if (paths.size() != 1 || fs::path(paths[0]) != expected) {
+            std::fprintf(stderr, "expected %s, daemon got %s\n", expected.c_str(),
+                         paths.empty() ? "nothing" : fs::path(paths[0]).c_str());
+            failures++;
+        }
+    }
+
+    fs::current_path(fs::temp_directory_path());
+    fs::remove_all(dir, ec);
+    return failures == 0 ? 0 : 1;
+}
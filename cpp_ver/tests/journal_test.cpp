@@ -0,0 +1,77 @@
+// A job whose journal cannot be written must not move anything: with writes
+// past a few bytes refused (RLIMIT_FSIZE), every folder fails with the journal
+// error and its entries stay where they were. Exits 1 otherwise.
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "job.h"
+#include "plan.h"
+
+// -1 when the folder is gone
+static int CountEntries(const fs::path& folder) {
+    std::error_code ec;
+    int count = 0;
+    for (fs::directory_iterator it(folder, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        count++;
+    }
+    return ec ? -1 : count;
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("unfolder-journal-test-" + std::to_string(getpid()));
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    for (const char* name : { "one", "two" }) {
+        fs::create_directories(dir / "parent" / name / "wrapper");
+        for (int i = 0; i < 20; i++) {
+            std::ofstream(dir / "parent" / name / "wrapper" / ("entry-" + std::to_string(i))) << i;
+        }
+    }
+    fs::create_directories(dir / "journal");
+
+    // Larger writes fail with EFBIG instead of killing us
+    signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit;
+    getrlimit(RLIMIT_FSIZE, &limit);
+    rlim_t unlimited = limit.rlim_cur;
+    limit.rlim_cur = 16;
+    setrlimit(RLIMIT_FSIZE, &limit);
+
+    UnfoldOptions options;
+    options.depth = 0;
+    options.journalDirectory = dir / "journal";
+    std::vector<std::wstring> paths = { (dir / "parent" / "one").wstring(), (dir / "parent" / "two").wstring() };
+    FolderProcessResult result;
+    {
+        UnfoldJob job(options);
+        job.Add(paths);
+        result = job.Finish();
+    }
+    limit.rlim_cur = unlimited;
+    setrlimit(RLIMIT_FSIZE, &limit); // stderr may be a file
+
+    int failures = 0;
+    if (result.failureCount != 2 || result.errorMessages.find(L"Failed to write the job journal") == std::wstring::npos) {
+        std::fprintf(stderr, "expected both folders to fail on the journal, %d failed\n", result.failureCount);
+        failures++;
+    }
+    for (const char* name : { "one", "two" }) {
+        if (CountEntries(dir / "parent" / name / "wrapper") != 20) {
+            std::fprintf(stderr, "entries of %s moved without a journal\n", name);
+            failures++;
+        }
+    }
+    if (CountEntries(dir / "parent") != 2) {
+        std::fprintf(stderr, "parent holds %d entries, expected 2\n", CountEntries(dir / "parent"));
+        failures++;
+    }
+
+    fs::remove_all(dir, ec);
+    return failures == 0 ? 0 : 1;
+}
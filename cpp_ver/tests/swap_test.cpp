@@ -0,0 +1,216 @@
+// Swap equivalence check: builds small trees where swapping the payload into
+// its parent's place may apply, unfolds each copy three ways (entry by entry,
+// with SwapParent, and through a dry-run plan written to JSON, read back and
+// executed) and compares the results: names, types, sizes, contents, symlink
+// targets and permissions. Exits 1 if any two trees differ or a folder fails.
+// The trees go under --dir=DIR, or the temporary folder by default.
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "job.h"
+#include "plan.h"
+
+// One entry of a tree as compared
+struct Snapshot {
+    char type;                 // f(ile), d(irectory), l(ink)
+    std::string content;       // file bytes or link target
+    unsigned mode;
+};
+
+using Tree = std::map<std::string, Snapshot>;
+
+static void WriteFile(const fs::path& path, const std::string& content) {
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+// Everything under root, by path relative to it; root itself by "."
+static Tree TakeSnapshot(const fs::path& root) {
+    Tree tree;
+    std::function<void(const fs::path&)> walk = [&](const fs::path& path) {
+        struct stat info;
+        if (lstat(path.c_str(), &info) != 0) {
+            return;
+        }
+        Snapshot entry = { 'f', std::string(), static_cast<unsigned>(info.st_mode & 07777) };
+        if (S_ISLNK(info.st_mode)) {
+            entry.type = 'l';
+            entry.content = fs::read_symlink(path).string();
+        } else if (S_ISDIR(info.st_mode)) {
+            entry.type = 'd';
+        } else {
+            std::ifstream in(path, std::ios::binary);
+            std::ostringstream bytes;
+            bytes << in.rdbuf();
+            entry.content = bytes.str();
+        }
+        tree[path.lexically_relative(root).string()] = entry;
+        if (entry.type == 'd') {
+            for (const auto& child : fs::directory_iterator(path)) {
+                walk(child.path());
+            }
+        }
+    };
+    walk(root);
+    return tree;
+}
+
+// First path where a and b differ, or empty when they are the same
+static std::string FirstDifference(const Tree& a, const Tree& b) {
+    for (const auto& entry : a) {
+        auto other = b.find(entry.first);
+        if (other == b.end()) {
+            return entry.first + " missing";
+        }
+        if (other->second.type != entry.second.type || other->second.content != entry.second.content) {
+            return entry.first + " differs";
+        }
+        if (other->second.mode != entry.second.mode) {
+            return entry.first + " mode differs";
+        }
+    }
+    for (const auto& entry : b) {
+        if (a.find(entry.first) == a.end()) {
+            return entry.first + " extra";
+        }
+    }
+    return std::string();
+}
+
+// A case builds parent/sel (and whatever surrounds it) under a root
+struct Case {
+    const char* name;
+    std::function<void(const fs::path& parent)> build;
+};
+
+static void Files(const fs::path& folder, int count, const char* prefix) {
+    fs::create_directories(folder);
+    for (int i = 0; i < count; i++) {
+        WriteFile(folder / (std::string(prefix) + std::to_string(i) + ".txt"), std::string(prefix) + std::to_string(i * 7));
+    }
+}
+
+static std::vector<Case> Cases() {
+    return {
+        { "wide", [](const fs::path& parent) {
+              Files(parent / "sel", 200, "entry-");
+              WriteFile(parent / "a.txt", "parent a");
+              WriteFile(parent / "b.bin", std::string("\0\1\2", 3));
+          } },
+        { "wrapped", [](const fs::path& parent) {
+              Files(parent / "sel" / "inner" / "payload", 120, "entry-");
+              WriteFile(parent / "readme", "parent file");
+          } },
+        { "conflicting-file", [](const fs::path& parent) {
+              Files(parent / "sel", 100, "entry-");
+              WriteFile(parent / "entry-3.txt", "taken");
+          } },
+        { "folder-sibling", [](const fs::path& parent) {
+              Files(parent / "sel", 100, "entry-");
+              Files(parent / "other", 2, "o-");
+          } },
+        { "tiny-payload", [](const fs::path& parent) {
+              Files(parent / "sel", 3, "entry-");
+              WriteFile(parent / "a.txt", "a");
+              WriteFile(parent / "b.txt", "b");
+          } },
+        { "self-named", [](const fs::path& parent) {
+              Files(parent / "sel", 100, "entry-");
+              Files(parent / "sel" / "sel", 2, "inner-");
+              WriteFile(parent / "a.txt", "a");
+          } },
+        { "links-and-modes", [](const fs::path& parent) {
+              Files(parent / "sel", 80, "entry-");
+              Files(parent / "sel" / "sub", 3, "s-");
+              fs::create_symlink("entry-1.txt", parent / "sel" / "link");
+              fs::create_symlink("../elsewhere", parent / "sel" / "dangling");
+              WriteFile(parent / "script", "#!/bin/sh\n");
+              fs::permissions(parent / "script", fs::perms(0750));
+              fs::permissions(parent, fs::perms(0750));
+          } },
+        { "swap-fallback", [](const fs::path& parent) {
+              // Every temporary name taken: the swap fails at run time and the
+              // payload's entries are moved out instead
+              Files(parent / "sel", 100, "entry-");
+              WriteFile(parent / "a.txt", "a");
+              for (int n = 0; n < 100; n++) {
+                  fs::create_directory(parent.parent_path() / (".parent.unfold" + (n == 0 ? std::string() : "-" + std::to_string(n))));
+              }
+          } },
+    };
+}
+
+int main(int argc, char* argv[]) {
+    fs::path base = fs::temp_directory_path();
+    if (argc == 2 && std::strncmp(argv[1], "--dir=", 6) == 0) {
+        base = argv[1] + 6;
+    } else if (argc != 1) {
+        std::fprintf(stderr, "Usage: unfolder_swap_test [--dir=DIR]\n");
+        return 1;
+    }
+    fs::path dir = base / ("unfolder-swap-test-" + std::to_string(getpid()));
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+
+    UnfoldOptions normal;
+    normal.depth = 0;
+    normal.conflictPolicy = ConflictPolicy::RenameSuffix;
+    UnfoldOptions swap = normal;
+    swap.swapParent = true;
+
+    bool allSame = true;
+    for (const auto& test : Cases()) {
+        // Each way gets its own copy: root/<way>/parent/sel
+        const char* ways[] = { "normal", "swap", "plan" };
+        Tree trees[3];
+        bool swapped = false;
+        bool succeeded = true;
+        for (int way = 0; way < 3; way++) {
+            fs::path root = dir / test.name / ways[way];
+            fs::path parent = root / "parent";
+            fs::create_directories(parent);
+            test.build(parent);
+            std::vector<std::wstring> paths = { (parent / "sel").wstring() };
+            struct stat before, after;
+            lstat(parent.c_str(), &before);
+
+            FolderProcessResult result;
+            if (way == 2) {
+                UnfoldPlan planned = PlanUnfold(paths, swap, true);
+                UnfoldPlan loaded;
+                if (!PlanFromJson(PlanToJson(planned), loaded)) {
+                    std::fprintf(stderr, "%s: plan did not read back\n", test.name);
+                    return 1;
+                }
+                result = ExecutePlan(loaded, swap);
+            } else {
+                UnfoldJob job(way == 0 ? normal : swap);
+                job.Add(paths);
+                result = job.Finish();
+            }
+            succeeded = succeeded && result.failureCount == 0;
+            if (way == 1 && lstat(parent.c_str(), &after) == 0) {
+                swapped = after.st_ino != before.st_ino;
+            }
+            trees[way] = TakeSnapshot(root);
+        }
+
+        std::string swapDifference = FirstDifference(trees[0], trees[1]);
+        std::string planDifference = FirstDifference(trees[0], trees[2]);
+        bool same = succeeded && swapDifference.empty() && planDifference.empty();
+        allSame = allSame && same;
+        std::printf("%-18s %-8s %-10s %s%s%s\n", test.name, swapped ? "swapped" : "moved", same ? "same" : "DIFFERENT",
+                    succeeded ? "" : "(a folder failed) ", swapDifference.empty() ? "" : ("swap: " + swapDifference + " ").c_str(),
+                    planDifference.empty() ? "" : ("plan: " + planDifference).c_str());
+    }
+    fs::remove_all(dir, ec);
+    return allSame ? 0 : 1;
+}